@@ -9,13 +9,11 @@ layout (location = 0) in vec4 position;
 layout (location = 1) in uint block_type; // fed in via instance array!
 
 // Quad input
-layout (location = 2) in uint q_block_type;
-layout (location = 3) in ivec3 q_corner1;
-layout (location = 4) in ivec3 q_corner2;
-layout (location = 5) in ivec3 q_face;
+// q_packed is a PackedQuad (see render.h -- keep the two in sync):
+//   q_packed.x: corner1.xyz (bits 0-14), corner2.xyz (bits 15-29), 5 bits each
+//   q_packed.y: face idx (bits 0-2), block (3-10), lighting (11-18), metadata (19-22)
+layout (location = 2) in uvec2 q_packed;
 layout (location = 6) in ivec3 q_base_coords;
-layout (location = 7) in uint q_lighting;
-layout (location = 8) in uint q_metadata;
 
 //out vec2 vs_tex_coords; // texture coords in [0.0, 1.0]
 out uint vs_block_type;
@@ -44,14 +42,23 @@ float rand(float seed) {
 	return fract(1.610612741 * seed);
 }
 
+// face idx -> face direction: (axis * 2) + (1 if it points backwards)
+ivec3 idx_to_face(uint face_idx) {
+	ivec3 result = ivec3(0);
+	result[face_idx >> 1] = (face_idx & 1u) != 0u ? -1 : 1;
+	return result;
+}
+
 void main(void)
 {
+	// unpack quad
+	vs_corner1 = ivec3(bitfieldExtract(q_packed.x, 0, 5), bitfieldExtract(q_packed.x, 5, 5), bitfieldExtract(q_packed.x, 10, 5));
+	vs_corner2 = ivec3(bitfieldExtract(q_packed.x, 15, 5), bitfieldExtract(q_packed.x, 20, 5), bitfieldExtract(q_packed.x, 25, 5));
+	vs_face = idx_to_face(bitfieldExtract(q_packed.y, 0, 3));
+	vs_block_type = bitfieldExtract(q_packed.y, 3, 8);
+	vs_lighting = bitfieldExtract(q_packed.y, 11, 8);
+	vs_metadata = bitfieldExtract(q_packed.y, 19, 4);
+
 	// data passthrough
-	vs_block_type = q_block_type;
-	vs_face = q_face;
-	vs_corner1 = q_corner1;
-	vs_corner2 = q_corner2;
 	vs_base_coords = q_base_coords;
-	vs_lighting = q_lighting;
-	vs_metadata = q_metadata;
 }
@@ -14,7 +14,6 @@
 #include "GL/gl3w.h"
 #include "GLFW/glfw3.h"
 #include "vmath.h"
-#include "zmq.hpp"
 
 #include <cassert>
 #include <memory>
@@ -23,15 +22,11 @@
 #include <unordered_map>
 #include <utility>
 
-void run_game(std::shared_ptr<zmq::context_t> ctx);
+void run_game();
 
 class App {
 public:
-	// zmq
-	std::shared_ptr<zmq::context_t> ctx;
-	BusNode bus;
-
-	App(std::shared_ptr<zmq::context_t> ctx_);
+	App();
 	~App();
 
 	/* INPUTS */
@@ -0,0 +1,112 @@
+#include "block_accessor.h"
+
+#include "world.h"
+
+#include <cassert>
+
+
+BlockType BlockNeighborhood::get_type(const vmath::ivec3& dxyz) const {
+	vmath::ivec3 rel;
+	const MiniChunk* mini = find(dxyz, rel);
+	return mini ? mini->get_block(rel) : BlockType(BlockType::Air);
+}
+
+Metadata BlockNeighborhood::get_metadata(const vmath::ivec3& dxyz) const {
+	vmath::ivec3 rel;
+	const MiniChunk* mini = find(dxyz, rel);
+	return mini ? mini->get_metadata(rel) : Metadata(0);
+}
+
+bool BlockNeighborhood::is_solid(const vmath::ivec3& dxyz) const {
+	vmath::ivec3 rel;
+	const MiniChunk* mini = find(dxyz, rel);
+	return mini ? mini->is_solid(rel) : false;
+}
+
+
+BlockAccessor::BlockAccessor(WorldDataPart& world_, const vmath::ivec3& xyz_) : world(world_), xyz(xyz_) {
+	chunk_coords = { xyz[0] >> 4, xyz[2] >> 4 };
+	chunk = world.find_chunk(chunk_coords);
+	move_to(xyz);
+}
+
+// move to block at `xyz`
+void BlockAccessor::move_to(const vmath::ivec3& xyz_) {
+	xyz = xyz_;
+
+	// only look chunk up again if we left it
+	const vmath::ivec2 new_chunk_coords = { xyz[0] >> 4, xyz[2] >> 4 };
+	if (new_chunk_coords != chunk_coords) {
+		chunk_coords = new_chunk_coords;
+		chunk = world.find_chunk(chunk_coords);
+	}
+
+	const bool in_range = BLOCK_MIN_HEIGHT <= xyz[1] && xyz[1] <= BLOCK_MAX_HEIGHT;
+	mini = chunk && in_range ? chunk->minis[xyz[1] / MINICHUNK_HEIGHT].get() : nullptr;
+}
+
+BlockType BlockAccessor::get_type() const {
+	return mini ? mini->get_block(mini_rel()) : BlockType(BlockType::Air);
+}
+
+Metadata BlockAccessor::get_metadata() const {
+	return mini ? mini->get_metadata(mini_rel()) : Metadata(0);
+}
+
+bool BlockAccessor::is_solid() const {
+	return mini ? mini->is_solid(mini_rel()) : false;
+}
+
+void BlockAccessor::set_type(const BlockType& val) {
+	if (!mini) {
+		return;
+	}
+
+	chunk->set_block(xyz[0] & 15, xyz[1], xyz[2] & 15, val);
+
+	// mini might've been copied (see Chunk::get_writable_mini_with_y_level)
+	mini = chunk->minis[xyz[1] / MINICHUNK_HEIGHT].get();
+	world.mark_unsaved(chunk_coords);
+}
+
+void BlockAccessor::set_metadata(const Metadata& val) {
+	if (!mini) {
+		return;
+	}
+
+	chunk->set_metadata(xyz[0] & 15, xyz[1], xyz[2] & 15, val);
+	mini = chunk->minis[xyz[1] / MINICHUNK_HEIGHT].get();
+	world.mark_unsaved(chunk_coords);
+}
+
+// get the 3x3x3 blocks around (and including) ours
+BlockNeighborhood BlockAccessor::gather() const {
+	BlockNeighborhood result;
+	result.center_rel = mini_rel();
+
+	// along each axis, the box is either inside our mini, or pokes 1 block into a neighbor
+	int min_offset[3], max_offset[3];
+	for (int i = 0; i < 3; i++) {
+		min_offset[i] = result.center_rel[i] == 0 ? -1 : 0;
+		max_offset[i] = result.center_rel[i] == 15 ? 1 : 0;
+	}
+
+	for (int dx = min_offset[0]; dx <= max_offset[0]; dx++) {
+		for (int dz = min_offset[2]; dz <= max_offset[2]; dz++) {
+			// reuse our chunk if we can
+			const Chunk* c = dx == 0 && dz == 0 ? chunk : world.find_chunk(chunk_coords + vmath::ivec2(dx, dz));
+			if (!c) {
+				continue;
+			}
+
+			for (int dy = min_offset[1]; dy <= max_offset[1]; dy++) {
+				const int y = xyz[1] + dy * MINICHUNK_HEIGHT;
+				if (BLOCK_MIN_HEIGHT <= y && y <= BLOCK_MAX_HEIGHT) {
+					result.minis[dx + 1][dy + 1][dz + 1] = c->minis[y / MINICHUNK_HEIGHT].get();
+				}
+			}
+		}
+	}
+
+	return result;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "block.h"
+#include "chunk.h"
+#include "chunkdata.h"
+#include "minichunk.h"
+#include "util.h"
+
+#include "vmath.h"
+
+#include <cassert>
+#include <cstdlib>
+
+class WorldDataPart;
+
+// the 3x3x3 blocks around a block, see BlockAccessor::gather()
+// every mini they touch (at most 8) is resolved up front, so reading any of them is just an index
+class BlockNeighborhood
+{
+public:
+	// get block at `dxyz` relative to the center (each of x/y/z in [-1, 1])
+	// unloaded/out-of-range blocks are air
+	BlockType get_type(const vmath::ivec3& dxyz) const;
+	Metadata get_metadata(const vmath::ivec3& dxyz) const;
+	bool is_solid(const vmath::ivec3& dxyz) const;
+
+private:
+	friend class BlockAccessor;
+
+	// center's coordinates relative to its mini
+	vmath::ivec3 center_rel;
+
+	// [x][y][z] mini offset + 1 -> mini (or nullptr)
+	// only the ones our blocks touch are set
+	const MiniChunk* minis[3][3][3] = {};
+
+	// get mini containing block at `dxyz`, and that block's coordinates relative to it
+	inline const MiniChunk* find(const vmath::ivec3& dxyz, vmath::ivec3& rel) const {
+		assert(abs(dxyz[0]) <= 1 && abs(dxyz[1]) <= 1 && abs(dxyz[2]) <= 1 && "block not in neighborhood");
+		const vmath::ivec3 block = center_rel + dxyz;
+		rel = { block[0] & 15, block[1] & 15, block[2] & 15 };
+		return minis[(block[0] >> 4) + 1][(block[1] >> 4) + 1][(block[2] >> 4) + 1];
+	}
+};
+
+// cursor over the world's blocks
+// remembers the chunk and mini it's in, so walking between neighboring blocks doesn't look them up again
+// holds raw pointers: don't keep one around across chunk unloading (WorldDataPart::unload_chunks), or across edits made through anything else
+class BlockAccessor
+{
+public:
+	BlockAccessor(WorldDataPart& world, const vmath::ivec3& xyz);
+
+	// move to block at `xyz`
+	void move_to(const vmath::ivec3& xyz);
+
+	inline void move_to(const vmath::ivec4& xyz_) {
+		move_to(vmath::ivec3(xyz_[0], xyz_[1], xyz_[2]));
+	}
+
+	// move by `dxyz`
+	inline BlockAccessor& move(const vmath::ivec3& dxyz) {
+		move_to(xyz + dxyz);
+		return *this;
+	}
+
+	inline BlockAccessor& north() { return move(INORTH); }
+	inline BlockAccessor& south() { return move(ISOUTH); }
+	inline BlockAccessor& east() { return move(IEAST); }
+	inline BlockAccessor& west() { return move(IWEST); }
+	inline BlockAccessor& up() { return move(IUP); }
+	inline BlockAccessor& down() { return move(IDOWN); }
+
+	inline const vmath::ivec3& get_coords() const {
+		return xyz;
+	}
+
+	// whether our block's mini is loaded
+	inline bool loaded() const {
+		return mini != nullptr;
+	}
+
+	// get our block
+	// unloaded/out-of-range blocks are air
+	BlockType get_type() const;
+	Metadata get_metadata() const;
+	bool is_solid() const;
+
+	// set our block, marking its chunk unsaved
+	// does nothing if it's unloaded
+	void set_type(const BlockType& val);
+	void set_metadata(const Metadata& val);
+
+	// get the 3x3x3 blocks around (and including) ours
+	BlockNeighborhood gather() const;
+
+private:
+	WorldDataPart& world;
+	vmath::ivec3 xyz;
+
+	// chunk/mini containing xyz (or nullptr)
+	vmath::ivec2 chunk_coords;
+	Chunk* chunk;
+	MiniChunk* mini;
+
+	// our block's coordinates relative to `mini`
+	inline vmath::ivec3 mini_rel() const {
+		return { xyz[0] & 15, xyz[1] & 15, xyz[2] & 15 };
+	}
+};
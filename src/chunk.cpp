@@ -3,15 +3,11 @@
 #include "chunkdata.h"
 #include "util.h"
 
-#include "FastNoise.h"
-
+#include <algorithm>
 #include <cassert>
 
 constexpr int WATER_HEIGHT = 64;
 
-// TODO: Each chunk generator should have their own tmp storage
-static std::array<BlockType, CHUNK_SIZE> __chunk_tmp_storage;
-
 using namespace std;
 using namespace vmath;
 
@@ -108,6 +104,21 @@ void Chunk::set_mini_with_y_level(const int y, std::shared_ptr<MiniChunk> mini)
 	}
 }
 
+// get mini for editing
+// if someone else has a copy of it, it's copied and replaced first
+std::shared_ptr<MiniChunk> Chunk::get_writable_mini_with_y_level(const int y) {
+	std::shared_ptr<MiniChunk> mini = get_mini_with_y_level(y);
+
+	// If someone else has a copy (besides `minis` and us), make a copy before updating
+	if (mini.use_count() > 2)
+	{
+		mini = std::make_shared<MiniChunk>(*mini);
+		set_mini_with_y_level(y, mini);
+	}
+
+	return mini;
+}
+
 // get block at these coordinates
 BlockType Chunk::get_block(const int& x, const int& y, const int& z) {
 	return get_mini_with_y_level(y) == nullptr ? BlockType(BlockType::Air) : get_mini_with_y_level(y)->get_block(x, y % MINICHUNK_HEIGHT, z);
@@ -138,27 +149,64 @@ void Chunk::set_blocks(BlockType* new_blocks) {
 }
 
 // set block at these coordinates
-// TODO: create a set_block_range that takes a min_xyz and max_xyz and efficiently set them.
 void Chunk::set_block(int x, int y, int z, const BlockType& val) {
-	std::shared_ptr<MiniChunk> mini = get_mini_with_y_level(y);
+	get_writable_mini_with_y_level(y)->set_block(x, y % MINICHUNK_HEIGHT, z, val);
+}
 
-	// If someone else has a copy, make a copy before updating
-	bool copy = mini.use_count() > 1;
-	if (copy)
-	{
-		mini = std::make_shared<MiniChunk>(*mini);
+void Chunk::set_block(const vmath::ivec3& xyz, const BlockType& val) { return set_block(xyz[0], xyz[1], xyz[2], val); }
+void Chunk::set_block(const vmath::ivec4& xyz_, const BlockType& val) { return set_block(xyz_[0], xyz_[1], xyz_[2], val); }
+
+// set every block in [min_xyz, max_xyz] to `val`
+uint16_t Chunk::fill_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& val) {
+	uint16_t modified = 0;
+
+	for (int i = std::max(min_xyz[1], 0) / MINICHUNK_HEIGHT; i <= std::min(max_xyz[1], BLOCK_MAX_HEIGHT) / MINICHUNK_HEIGHT; i++) {
+		const int base_y = i * MINICHUNK_HEIGHT;
+		const vmath::ivec3 mini_min = { min_xyz[0], std::max(min_xyz[1] - base_y, 0), min_xyz[2] };
+		const vmath::ivec3 mini_max = { max_xyz[0], std::min(max_xyz[1] - base_y, MINICHUNK_HEIGHT - 1), max_xyz[2] };
+
+		get_writable_mini_with_y_level(base_y)->fill_box(mini_min, mini_max, val);
+		modified |= 1 << i;
 	}
 
-	mini->set_block(x, y % MINICHUNK_HEIGHT, z, val);
+	return modified;
+}
 
-	if (copy)
-	{
-		set_mini_with_y_level(y, mini);
+// set every `from` block in [min_xyz, max_xyz] to `to`
+uint16_t Chunk::replace_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& from, const BlockType& to) {
+	uint16_t modified = 0;
+
+	for (int i = std::max(min_xyz[1], 0) / MINICHUNK_HEIGHT; i <= std::min(max_xyz[1], BLOCK_MAX_HEIGHT) / MINICHUNK_HEIGHT; i++) {
+		const int base_y = i * MINICHUNK_HEIGHT;
+		const vmath::ivec3 mini_min = { min_xyz[0], std::max(min_xyz[1] - base_y, 0), min_xyz[2] };
+		const vmath::ivec3 mini_max = { max_xyz[0], std::min(max_xyz[1] - base_y, MINICHUNK_HEIGHT - 1), max_xyz[2] };
+
+		// don't copy minis that have nothing to replace
+		if (minis[i]->count_in_box(mini_min, mini_max, from) == 0) {
+			continue;
+		}
+
+		get_writable_mini_with_y_level(base_y)->replace_in_box(mini_min, mini_max, from, to);
+		modified |= 1 << i;
 	}
+
+	return modified;
 }
 
-void Chunk::set_block(const vmath::ivec3& xyz, const BlockType& val) { return set_block(xyz[0], xyz[1], xyz[2], val); }
-void Chunk::set_block(const vmath::ivec4& xyz_, const BlockType& val) { return set_block(xyz_[0], xyz_[1], xyz_[2], val); }
+// paste schematic so that its (0, 0, 0) lands on `origin`, clipping whatever doesn't fit
+uint16_t Chunk::paste(const Schematic& schematic, const vmath::ivec3& origin) {
+	uint16_t modified = 0;
+
+	for (int i = std::max(origin[1], 0) / MINICHUNK_HEIGHT; i <= std::min(origin[1] + schematic.size[1] - 1, BLOCK_MAX_HEIGHT) / MINICHUNK_HEIGHT; i++) {
+		const int base_y = i * MINICHUNK_HEIGHT;
+
+		if (get_writable_mini_with_y_level(base_y)->paste(schematic, origin - vmath::ivec3(0, base_y, 0)) > 0) {
+			modified |= 1 << i;
+		}
+	}
+
+	return modified;
+}
 
 // get metadata at these coordinates
 Metadata Chunk::get_metadata(const int& x, const int& y, const int& z) {
@@ -190,16 +238,53 @@ std::vector<vmath::ivec2> Chunk::surrounding_chunks_sides() const {
 	return surrounding_chunks_sides_s(coords);
 }
 
-void Chunk::generate() {
+// serialize every mini, bottom to top (format: see region.h)
+std::vector<uint8_t> Chunk::serialize() const {
+	std::vector<uint8_t> result;
+	for (const auto& mini : minis) {
+		assert(mini && "tried to serialize chunk that isn't initialized");
+		mini->serialize(result);
+	}
+	return result;
+}
+
+// replace our minis with ones read from serialize()'d data
+bool Chunk::deserialize(const uint8_t* data, const size_t size) {
+	init_minichunks();
+
+	const uint8_t* end = data + size;
+	for (auto& mini : minis) {
+		if (!mini->deserialize(data, end)) {
+			return false;
+		}
+	}
+
+	// should've used up everything
+	return data == end;
+}
+
+// memory used by us and our minis (bytes)
+size_t Chunk::memory_usage() const {
+	size_t result = sizeof(*this);
+	for (const auto& mini : minis) {
+		if (mini) {
+			result += mini->memory_usage();
+		}
+	}
+	return result;
+}
+
+void Chunk::generate(ChunkGenContext& ctx) {
 	// generate this chunk
 	// NOTE: traverse x, then z, then y, whenever possible
-	FastNoise fn;
+	FastNoise& fn = ctx.noise;
+	auto& blocks = ctx.blocks;
 
 	// create chunk
 	init_minichunks();
 
 	// create chunk data array
-	std::fill(__chunk_tmp_storage.begin(), __chunk_tmp_storage.end(), BlockType::Air);
+	std::fill(blocks.begin(), blocks.end(), BlockType::Air);
 
 	// fill data
 	for (int z = 0; z < CHUNK_DEPTH; z++) {
@@ -216,9 +301,9 @@ void Chunk::generate() {
 
 			// fill everything under that height
 			for (int i = 0; i < y; i++) {
-				__chunk_tmp_storage[c2idx_chunk(x, i, z)] = BlockType::Stone;
+				blocks[c2idx_chunk(x, i, z)] = BlockType::Stone;
 			}
-			__chunk_tmp_storage[c2idx_chunk(x, (int)floor(y), z)] = BlockType::Grass;
+			blocks[c2idx_chunk(x, (int)floor(y), z)] = BlockType::Grass;
 
 			// generate tree if we wanna
 			if (y >= WATER_HEIGHT) {
@@ -233,7 +318,7 @@ void Chunk::generate() {
 								if (x + dx < 0 || x + dx >= 16 || z + dz < 0 || z + dz >= 16) {
 									continue;
 								}
-								__chunk_tmp_storage[c2idx_chunk(x + dx, y + dy, z + dz)] = BlockType::OakLeaves;
+								blocks[c2idx_chunk(x + dx, y + dy, z + dz)] = BlockType::OakLeaves;
 							}
 						}
 					}
@@ -243,7 +328,7 @@ void Chunk::generate() {
 								if (x + dx < 0 || x + dx >= 16 || z + dz < 0 || z + dz >= 16) {
 									continue;
 								}
-								__chunk_tmp_storage[c2idx_chunk(x + dx, y + dy, z + dz)] = BlockType::OakLeaves;
+								blocks[c2idx_chunk(x + dx, y + dy, z + dz)] = BlockType::OakLeaves;
 							}
 						}
 					}
@@ -253,14 +338,14 @@ void Chunk::generate() {
 								if (x + dx < 0 || x + dx >= 16 || z + dz < 0 || z + dz >= 16) {
 									continue;
 								}
-								__chunk_tmp_storage[c2idx_chunk(x + dx, y + dy, z + dz)] = BlockType::OakLeaves;
+								blocks[c2idx_chunk(x + dx, y + dy, z + dz)] = BlockType::OakLeaves;
 							}
 						}
 					}
 
 					// generate logs
 					for (int dy = 1; dy <= 5; dy++) {
-						__chunk_tmp_storage[c2idx_chunk(x, y + dy, z)] = BlockType::OakWood;
+						blocks[c2idx_chunk(x, y + dy, z)] = BlockType::OakWood;
 					}
 				}
 			}
@@ -268,11 +353,11 @@ void Chunk::generate() {
 			// Fill water
 			if (y < WATER_HEIGHT - 1) {
 				for (int y2 = y + 1; y2 < WATER_HEIGHT; y2++) {
-					__chunk_tmp_storage[c2idx_chunk(x, y2, z)] = BlockType::StillWater;
+					blocks[c2idx_chunk(x, y2, z)] = BlockType::StillWater;
 				}
 			}
 		}
 	}
 
-	set_blocks(&__chunk_tmp_storage[0]);
+	set_blocks(&blocks[0]);
 }
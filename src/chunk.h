@@ -3,6 +3,9 @@
 #include "block.h"
 #include "minichunk.h"
 
+#include "FastNoise.h"
+
+#include <array>
 #include <memory>
 
 constexpr int CHUNK_WIDTH = 16;
@@ -10,6 +13,13 @@ constexpr int CHUNK_HEIGHT = 256;
 constexpr int CHUNK_DEPTH = 16;
 constexpr int CHUNK_SIZE = CHUNK_WIDTH * CHUNK_DEPTH * CHUNK_HEIGHT;
 
+// scratch space for generating chunks
+// each chunk gen worker owns one, so workers can generate in parallel without sharing anything
+struct ChunkGenContext {
+	std::array<BlockType, CHUNK_SIZE> blocks;
+	FastNoise noise;
+};
+
 /*
 *
 * CHUNK FORMAT
@@ -36,6 +46,10 @@ public:
 
 	void set_mini_with_y_level(const int y, std::shared_ptr<MiniChunk> mini);
 
+	// get mini for editing
+	// if someone else has a copy of it, it's copied and replaced first
+	std::shared_ptr<MiniChunk> get_writable_mini_with_y_level(const int y);
+
 	// get block at these coordinates
 	BlockType get_block(const int& x, const int& y, const int& z);
 
@@ -46,12 +60,24 @@ public:
 	void set_blocks(BlockType* new_blocks);
 
 	// set block at these coordinates
-	// TODO: create a set_block_range that takes a min_xyz and max_xyz and efficiently set them.
 	void set_block(int x, int y, int z, const BlockType& val);
 
 	void set_block(const vmath::ivec3& xyz, const BlockType& val);
 	void set_block(const vmath::ivec4& xyz_, const BlockType& val);
 
+	// bulk edits
+	// boxes are inclusive and in chunk-relative coordinates, and each mini is edited once
+	// return a mask of modified minis (bit i => minis[i])
+
+	// set every block in [min_xyz, max_xyz] to `val`
+	uint16_t fill_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& val);
+
+	// set every `from` block in [min_xyz, max_xyz] to `to`
+	uint16_t replace_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& from, const BlockType& to);
+
+	// paste schematic so that its (0, 0, 0) lands on `origin`, clipping whatever doesn't fit
+	uint16_t paste(const Schematic& schematic, const vmath::ivec3& origin);
+
 	// get metadata at these coordinates
 	Metadata get_metadata(const int& x, const int& y, const int& z);
 
@@ -71,8 +97,18 @@ public:
 
 	std::vector<vmath::ivec2> surrounding_chunks_sides() const;
 
-	// generate this chunk
-	void generate();
+	// generate this chunk, using ctx as scratch space
+	void generate(ChunkGenContext& ctx);
+
+	// serialize every mini, bottom to top (format: see region.h)
+	std::vector<uint8_t> serialize() const;
+
+	// replace our minis with ones read from serialize()'d data
+	// returns false if the data is invalid
+	bool deserialize(const uint8_t* data, const size_t size);
+
+	// memory used by us and our minis (bytes)
+	size_t memory_usage() const;
 };
 
 // simple chunk hash function
@@ -0,0 +1,93 @@
+#include "chunk_ring.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+
+ChunkRing::ChunkRing() {
+	reset({ 0, 0 }, 0);
+}
+
+// smallest size (log2) whose window fits every chunk within `radius` of its center
+int ChunkRing::fit_size_log2(const int radius) {
+	assert(radius >= 0 && "invalid radius");
+
+	// smallest power of 2 that fits [center - radius, center + radius]
+	int result = 0;
+	while ((1 << result) < 2 * radius + 1) {
+		result++;
+	}
+	return result;
+}
+
+// center window on `center`, big enough to fit every chunk within `radius`
+void ChunkRing::reset(const vmath::ivec2& center, const int radius) {
+	size_log2 = fit_size_log2(radius);
+	mask = size() - 1;
+	window_min = center - vmath::ivec2(size() / 2, size() / 2);
+
+	// every slot starts out pointing at a chunk outside the window, so lookups miss
+	slots.assign(static_cast<size_t>(size()) * size(), { window_min - vmath::ivec2(1, 1), nullptr });
+}
+
+// re-center window on `center`, keeping chunks that stay inside it
+// Each slot holds exactly one of the window's coords, so the slots of chunks leaving the window are exactly the ones chunks
+// coming into it need -- refilling the rows/columns that came in is enough.
+void ChunkRing::recenter(const vmath::ivec2& center, const int radius, const lookup_fn& lookup) {
+	const int new_size_log2 = fit_size_log2(radius);
+	const int new_size = 1 << new_size_log2;
+	const vmath::ivec2 new_min = center - vmath::ivec2(new_size / 2, new_size / 2);
+	const vmath::ivec2 shift = new_min - window_min;
+
+	// nothing to keep => start over
+	if (new_size_log2 != size_log2 || std::abs(shift[0]) >= size() || std::abs(shift[1]) >= size()) {
+		reset(center, radius);
+		for (int z = window_min[1]; z < window_min[1] + size(); z++) {
+			for (int x = window_min[0]; x < window_min[0] + size(); x++) {
+				set({ x, z }, lookup({ x, z }));
+			}
+		}
+		return;
+	}
+
+	if (shift == vmath::ivec2(0, 0)) {
+		return;
+	}
+
+	window_min = new_min;
+
+	// x's that came in: [x_begin, x_end)
+	const int x_begin = shift[0] > 0 ? window_min[0] + size() - shift[0] : window_min[0];
+	const int x_end = shift[0] > 0 ? window_min[0] + size() : window_min[0] - shift[0];
+
+	// columns that came in
+	for (int x = x_begin; x < x_end; x++) {
+		for (int z = window_min[1]; z < window_min[1] + size(); z++) {
+			set({ x, z }, lookup({ x, z }));
+		}
+	}
+
+	// rows that came in (minus the bits of them already done above)
+	const int z_begin = shift[1] > 0 ? window_min[1] + size() - shift[1] : window_min[1];
+	const int z_end = shift[1] > 0 ? window_min[1] + size() : window_min[1] - shift[1];
+	for (int z = z_begin; z < z_end; z++) {
+		for (int x = window_min[0]; x < window_min[0] + size(); x++) {
+			if (x_begin <= x && x < x_end) {
+				continue;
+			}
+			set({ x, z }, lookup({ x, z }));
+		}
+	}
+}
+
+// set chunk at `coords` (nullptr to remove it)
+void ChunkRing::set(const vmath::ivec2& coords, const std::shared_ptr<Chunk>& chunk) {
+	if (!in_window(coords)) {
+		return;
+	}
+
+	Slot& slot = slots[slot_idx(coords)];
+	slot.coords = coords;
+	slot.chunk = chunk;
+}
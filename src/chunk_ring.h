@@ -0,0 +1,78 @@
+#pragma once
+
+#include "chunk.h"
+
+#include "vmath.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Toroidal index of the chunks around the player
+// A size x size grid of slots (size = power of 2), where chunk (x, z) lives in slot (x & mask, z & mask).
+// Every chunk in the size x size window starting at window_min gets its own slot, so looking one up is two masks and an index -- no hashing.
+// Chunks outside the window aren't stored here (see WorldDataPart::chunk_map).
+class ChunkRing
+{
+private:
+	struct Slot {
+		vmath::ivec2 coords;
+		std::shared_ptr<Chunk> chunk;
+	};
+
+	std::vector<Slot> slots;
+	int size_log2 = 0;
+	int mask = 0;
+
+	// window covers [window_min, window_min + size) in both x and z
+	vmath::ivec2 window_min = { 0, 0 };
+
+	inline int slot_idx(const vmath::ivec2& coords) const {
+		return (coords[0] & mask) + ((coords[1] & mask) << size_log2);
+	}
+
+	// smallest size (log2) whose window fits every chunk within `radius` of its center
+	static int fit_size_log2(const int radius);
+
+public:
+	// returns chunk at coords, or nullptr if it isn't loaded
+	using lookup_fn = std::function<std::shared_ptr<Chunk>(const vmath::ivec2&)>;
+
+	ChunkRing();
+
+	// center window on `center`, big enough to fit every chunk within `radius`
+	// removes every chunk, so re-add them after
+	void reset(const vmath::ivec2& center, const int radius);
+
+	// same, but keeps chunks that stay inside the window, and fills in chunks that come into it with `lookup`
+	// only touches the rows/columns that came in, unless the size changed or we moved more than a whole window
+	void recenter(const vmath::ivec2& center, const int radius, const lookup_fn& lookup);
+
+	// width/depth of window
+	inline int size() const {
+		return 1 << size_log2;
+	}
+
+	// whether `coords` is inside the window
+	inline bool in_window(const vmath::ivec2& coords) const {
+		return static_cast<unsigned>(coords[0] - window_min[0]) < static_cast<unsigned>(size())
+			&& static_cast<unsigned>(coords[1] - window_min[1]) < static_cast<unsigned>(size());
+	}
+
+	// get chunk at `coords` or nullptr
+	// `coords` must be inside the window
+	inline Chunk* get(const vmath::ivec2& coords) const {
+		const Slot& slot = slots[slot_idx(coords)];
+		return slot.coords == coords ? slot.chunk.get() : nullptr;
+	}
+
+	// same as get(), but shares ownership
+	inline std::shared_ptr<Chunk> get_shared(const vmath::ivec2& coords) const {
+		const Slot& slot = slots[slot_idx(coords)];
+		return slot.coords == coords ? slot.chunk : nullptr;
+	}
+
+	// set chunk at `coords` (nullptr to remove it)
+	// ignored if `coords` is outside the window
+	void set(const vmath::ivec2& coords, const std::shared_ptr<Chunk>& chunk);
+};
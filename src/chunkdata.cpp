@@ -5,6 +5,7 @@
 
 #include "vmath.h"
 
+#include <algorithm>
 #include <cassert>
 
 
@@ -62,6 +63,198 @@ bool Lighting::operator==(const Lighting& l) const { return data == l.data; }
 bool Lighting::operator!=(const Lighting& l) const { return data != l.data; }
 
 
+/* Schematic */
+
+
+Schematic::Schematic(const vmath::ivec3& size) : size(size), blocks(size[0] * size[1] * size[2], BlockType::Air) {
+	assert(0 < size[0] && 0 < size[1] && 0 < size[2] && "invalid schematic size");
+}
+
+// convert coordinates to idx
+int Schematic::c2idx(const int x, const int y, const int z) const {
+	return x + z * size[0] + y * size[0] * size[2];
+}
+
+BlockType Schematic::get_block(const int x, const int y, const int z) const {
+	return blocks[c2idx(x, y, z)];
+}
+
+void Schematic::set_block(const int x, const int y, const int z, const BlockType& val) {
+	blocks[c2idx(x, y, z)] = val;
+}
+
+
+/* BlockPalette */
+
+
+BlockPalette::BlockPalette() : bits_log2(0), num_blocks(0) {}
+
+// reset to `num_blocks` blocks of `fill`
+void BlockPalette::init(const int num_blocks_, const BlockType& fill) {
+	num_blocks = num_blocks_;
+	bits_log2 = 0;
+
+	palette.assign(1, fill);
+	counts.assign(1, (uint16_t)num_blocks);
+
+	// 1 bit per block, all pointing at entry 0
+	data.assign((num_blocks + 63) / 64, 0);
+}
+
+// free all memory
+void BlockPalette::release() {
+	std::vector<BlockType>().swap(palette);
+	std::vector<uint16_t>().swap(counts);
+	std::vector<uint64_t>().swap(data);
+	bits_log2 = 0;
+	num_blocks = 0;
+}
+
+// find palette entry for `val`, adding it if required (may widen indices)
+int BlockPalette::find_or_add(const BlockType& val) {
+	int free_slot = -1;
+
+	for (int i = 0; i < (int)palette.size(); i++) {
+		if (palette[i] == val) {
+			return i;
+		}
+		if (counts[i] == 0 && free_slot == -1) {
+			free_slot = i;
+		}
+	}
+
+	// re-use an entry nobody points to anymore
+	if (free_slot != -1) {
+		palette[free_slot] = val;
+		return free_slot;
+	}
+
+	// add new entry, widening indices if they can't address it
+	palette.push_back(val);
+	counts.push_back(0);
+
+	if (palette.size() > (size_t(1) << (1 << bits_log2))) {
+		assert(bits_log2 < 3 && "palette cannot hold more than 256 block types");
+		repack(bits_log2 + 1);
+	}
+
+	return (int)palette.size() - 1;
+}
+
+// re-pack indices with 2^new_bits_log2 bits each
+void BlockPalette::repack(const int new_bits_log2) {
+	BlockPalette result;
+	result.bits_log2 = new_bits_log2;
+	result.num_blocks = num_blocks;
+	result.data.assign((num_blocks * (1 << new_bits_log2) + 63) / 64, 0);
+
+	for (int i = 0; i < num_blocks; i++) {
+		result.set_idx(i, get_idx(i));
+	}
+
+	data = std::move(result.data);
+	bits_log2 = new_bits_log2;
+}
+
+void BlockPalette::set(const int idx, const BlockType& val) {
+	assert(0 <= idx && idx < num_blocks && "BlockPalette::set invalid idx");
+
+	const int old_idx = get_idx(idx);
+	if (palette[old_idx] == val) {
+		return;
+	}
+
+	const int new_idx = find_or_add(val);
+	counts[old_idx]--;
+	counts[new_idx]++;
+	set_idx(idx, new_idx);
+}
+
+// set [begin, end) -> val
+// looks up val's palette entry once, then overwrites whole words of indices at a time
+void BlockPalette::set_range(const int begin, const int end, const BlockType& val) {
+	assert(0 <= begin && begin <= end && end <= num_blocks && "BlockPalette::set_range invalid range");
+	if (begin == end) {
+		return;
+	}
+
+	// before reading any indices, since it may re-pack them
+	const int new_idx = find_or_add(val);
+
+	const int bits = 1 << bits_log2;
+	const int per_word = 64 >> bits_log2;
+	const uint64_t mask = (uint64_t(1) << bits) - 1;
+	const uint64_t ones = ~uint64_t(0) / mask; // lowest bit of every index set
+	const uint64_t fill = ones * new_idx;
+
+	int i = begin;
+
+	// up to first word boundary
+	for (; i < end && (i & (per_word - 1)) != 0; i++) {
+		counts[get_idx(i)]--;
+		set_idx(i, new_idx);
+	}
+
+	// whole words
+	for (; i + per_word <= end; i += per_word) {
+		uint64_t& word = data[i >> (6 - bits_log2)];
+		const int first = word & mask;
+		if (word == ones * first) {
+			counts[first] -= (uint16_t)per_word;
+		}
+		else {
+			for (int j = 0; j < 64; j += bits) {
+				counts[(word >> j) & mask]--;
+			}
+		}
+		word = fill;
+	}
+
+	// rest
+	for (; i < end; i++) {
+		counts[get_idx(i)]--;
+		set_idx(i, new_idx);
+	}
+
+	counts[new_idx] += (uint16_t)(end - begin);
+}
+
+// whether any block is `val`
+bool BlockPalette::contains(const BlockType& val) const {
+	return contains_if([&val](const BlockType& b) { return b == val; });
+}
+
+// number of (used) palette entries
+int BlockPalette::num_types() const {
+	int result = 0;
+	for (auto count : counts) {
+		result += count > 0;
+	}
+	return result;
+}
+
+// heap memory used (bytes)
+size_t BlockPalette::memory_usage() const {
+	return palette.capacity() * sizeof(BlockType) + counts.capacity() * sizeof(uint16_t) + data.capacity() * sizeof(uint64_t);
+}
+
+// number of runs of equal blocks, i.e. the size this would take as an IntervalMap
+int BlockPalette::num_runs() const {
+	if (num_blocks == 0) {
+		return 0;
+	}
+
+	int result = 1;
+	int prev = get_idx(0);
+	for (int i = 1; i < num_blocks; i++) {
+		const int cur = get_idx(i);
+		result += cur != prev;
+		prev = cur;
+	}
+	return result;
+}
+
+
 /* ChunkData */
 
 
@@ -69,24 +262,30 @@ ChunkData::ChunkData(const int width, const int height, const int depth) : width
 	assert(0 < width && "invalid chunk width");
 	assert(0 < depth && "invalid chunk depth");
 	assert(0 < height && "invalid chunk height");
+
+	// all air
+	opaque_mask.assign((size() + 63) / 64, 0);
+	solid_mask.assign((size() + 63) / 64, 0);
 }
 
 // Copy
 ChunkData::ChunkData(const ChunkData& other)
-	: blocks(other.blocks), metadatas(other.metadatas), lightings(other.lightings),
+	: palette_blocks(other.palette_blocks), palette_mode(other.palette_mode),
+	opaque_mask(other.opaque_mask), solid_mask(other.solid_mask),
+	blocks(other.blocks), metadatas(other.metadatas), lightings(other.lightings),
 	width(other.width), height(other.height), depth(other.depth)
 {
 }
 
 void ChunkData::allocate() {
-	blocks.clear(BlockType::Air);
+	set_all_air();
 	metadatas.clear(0);
 	lightings.clear(0);
 }
 
 // TODO: replace allocate() and clear() with just reset()
 void ChunkData::clear() {
-	blocks.clear(BlockType::Air);
+	set_all_air();
 	metadatas.clear(0);
 	lightings.clear(0);
 }
@@ -112,6 +311,10 @@ BlockType ChunkData::get_block(const int& x, const int& y, const int& z) const {
 		return BlockType::Air;
 	}
 
+	if (palette_mode) {
+		return palette_blocks.get(c2idx(x, y, z));
+	}
+
 	return blocks[c2idx(x, y, z)];
 }
 
@@ -124,7 +327,26 @@ void ChunkData::set_block(const int x, const int y, const int z, const BlockType
 	assert(0 <= y && y < height && "set_block invalid y coordinate");
 	assert(0 <= z && z < depth && "set_block invalid z coordinate");
 
+	set_masks(c2idx(x, y, z), c2idx(x, y, z) + 1, val);
+
+	if (palette_mode) {
+		palette_blocks.set(c2idx(x, y, z), val);
+
+		// every now and then, check if runs got long enough to go back to RLE
+		if (++edits_since_check >= PALETTE_RECHECK_EDITS) {
+			edits_since_check = 0;
+			if (palette_blocks.num_runs() < RLE_MAX_INTERVALS) {
+				use_rle();
+			}
+		}
+		return;
+	}
+
 	blocks.set_interval(c2idx(x, y, z), c2idx(x, y, z) + 1, val);
+
+	if (blocks.num_intervals() > PALETTE_MIN_INTERVALS) {
+		use_palette();
+	}
 }
 
 void ChunkData::set_block(const vmath::ivec3& xyz, const BlockType& val) { return set_block(xyz[0], xyz[1], xyz[2], val); }
@@ -133,7 +355,7 @@ void ChunkData::set_block(const vmath::ivec4& xyz_, const BlockType& val) { retu
 // set blocks in map using array, efficiently
 // relies on x -> z -> y
 void ChunkData::set_blocks(BlockType* new_blocks) {
-	blocks.clear(BlockType::Air);
+	set_all_air();
 
 	int start = 0;
 	BlockType start_block = new_blocks[0];
@@ -156,44 +378,260 @@ void ChunkData::set_blocks(BlockType* new_blocks) {
 
 	// add last interval
 	blocks.set_interval(start, width * depth * height, start_block);
+
+	// rebuild occupancy bitmasks
+	for (int i = 0; i < size(); i++) {
+		if (!new_blocks[i].is_translucent()) {
+			opaque_mask[i / 64] |= uint64_t(1) << (i % 64);
+		}
+		if (new_blocks[i].is_solid()) {
+			solid_mask[i / 64] |= uint64_t(1) << (i % 64);
+		}
+	}
+
+	// too noisy for RLE
+	if (blocks.num_intervals() > PALETTE_MIN_INTERVALS) {
+		use_palette();
+	}
+}
+
+// copy all blocks into array (x -> z -> y), a whole run at a time
+void ChunkData::extract_blocks(BlockType* result) const {
+	if (palette_mode) {
+		for (int i = 0; i < size(); i++) {
+			result[i] = palette_blocks.get(i);
+		}
+		return;
+	}
+
+	for (auto iter = blocks.get_interval(0); iter != blocks.end() && iter->first < size(); ++iter) {
+		const int start = std::max(0, (int)iter->first);
+		const int end = std::next(iter) != blocks.end() ? std::min((int)std::next(iter)->first, size()) : size();
+		std::fill(result + start, result + end, iter->second);
+	}
+}
+
+// copy one layer of blocks into array, walking the runs once
+void ChunkData::extract_layer(const int layers_idx, const int layer_no, BlockType* result) const {
+	assert(0 <= layers_idx && layers_idx < 3 && "invalid layers_idx");
+
+	// layer's (outer, inner) coordinates -- inner varies fastest, so idx only ever increases
+	const int outer_size = layers_idx == 1 ? depth : height;
+	const int inner_size = layers_idx == 0 ? depth : width;
+	const auto layer_c2idx = [&](const int outer, const int inner) {
+		switch (layers_idx) {
+		case 0: return c2idx(layer_no, outer, inner);
+		case 1: return c2idx(inner, layer_no, outer);
+		default: return c2idx(inner, outer, layer_no);
+		}
+	};
+
+	if (palette_mode) {
+		for (int outer = 0; outer < outer_size; outer++) {
+			for (int inner = 0; inner < inner_size; inner++) {
+				result[outer * inner_size + inner] = palette_blocks.get(layer_c2idx(outer, inner));
+			}
+		}
+		return;
+	}
+
+	auto iter = blocks.get_interval(0);
+	for (int outer = 0; outer < outer_size; outer++) {
+		for (int inner = 0; inner < inner_size; inner++) {
+			const int idx = layer_c2idx(outer, inner);
+			while (std::next(iter) != blocks.end() && std::next(iter)->first <= idx) {
+				++iter;
+			}
+			result[outer * inner_size + inner] = iter->second;
+		}
+	}
+}
+
+// serialized runs: uint16 num_runs, then num_runs * { uint16 start, uint8 value }
+static void write_u16(std::vector<uint8_t>& out, const uint16_t val) {
+	out.push_back(val & 0xFF);
+	out.push_back(val >> 8);
+}
+
+static uint16_t read_u16(const uint8_t*& in) {
+	const uint16_t result = in[0] | (in[1] << 8);
+	in += 2;
+	return result;
+}
+
+template <typename V>
+static void write_runs(std::vector<uint8_t>& out, const FlatIntervalMap<short, V>& map, const int size) {
+	const size_t num_runs_pos = out.size();
+	write_u16(out, 0);
+
+	// clipped to our range (first run starts at lowest K)
+	uint16_t num_runs = 0;
+	for (auto iter = map.get_interval(0); iter != map.end() && iter->first < size; ++iter) {
+		write_u16(out, std::max(0, (int)iter->first));
+		out.push_back(static_cast<uint8_t>(iter->second));
+		num_runs++;
+	}
+
+	out[num_runs_pos] = num_runs & 0xFF;
+	out[num_runs_pos + 1] = num_runs >> 8;
+}
+
+// read runs written by write_runs, calling on_run(start, end, value) for each one
+// returns false if they're invalid
+template <typename F>
+static bool read_runs(const uint8_t*& in, const uint8_t* end, const int size, F on_run) {
+	if (end - in < 2) {
+		return false;
+	}
+
+	const int num_runs = read_u16(in);
+	if (num_runs < 1 || end - in < num_runs * 3) {
+		return false;
+	}
+
+	int start = read_u16(in);
+	uint8_t val = *in++;
+	if (start != 0) {
+		return false;
+	}
+
+	for (int i = 1; i <= num_runs; i++) {
+		int next_start = size;
+		uint8_t next_val = 0;
+		if (i < num_runs) {
+			next_start = read_u16(in);
+			next_val = *in++;
+			if (next_start <= start || next_start >= size) {
+				return false;
+			}
+		}
+
+		on_run(start, next_start, val);
+		start = next_start;
+		val = next_val;
+	}
+
+	return true;
+}
+
+// append blocks, metadata and lighting to `out`, as runs (format: see region.h)
+void ChunkData::serialize(std::vector<uint8_t>& out) const {
+	if (palette_mode) {
+		// find runs ourselves
+		const size_t num_runs_pos = out.size();
+		write_u16(out, 0);
+
+		uint16_t num_runs = 0;
+		BlockType last = palette_blocks.get(0);
+		for (int i = 0; i < size(); i++) {
+			const BlockType block = palette_blocks.get(i);
+			if (i == 0 || block != last) {
+				write_u16(out, i);
+				out.push_back(static_cast<uint8_t>(block));
+				num_runs++;
+				last = block;
+			}
+		}
+
+		out[num_runs_pos] = num_runs & 0xFF;
+		out[num_runs_pos + 1] = num_runs >> 8;
+	}
+	else {
+		write_runs(out, blocks, size());
+	}
+
+	write_runs(out, metadatas, size());
+	write_runs(out, lightings, size());
+}
+
+// read back what serialize() wrote, advancing `in`
+bool ChunkData::deserialize(const uint8_t*& in, const uint8_t* end) {
+	set_all_air();
+	metadatas.clear(0);
+	lightings.clear(0);
+
+	const bool ok = read_runs(in, end, size(), [this](const int start, const int end, const uint8_t val) { set_block_range(start, end, BlockType(val)); })
+		&& read_runs(in, end, size(), [this](const int start, const int end, const uint8_t val) { metadatas.set_interval(start, end, Metadata(val)); })
+		&& read_runs(in, end, size(), [this](const int start, const int end, const uint8_t val) { lightings.set_interval(start, end, Metadata(val)); });
+
+	update_block_storage();
+	return ok;
+}
+
+// switch block storage to bit-packed palette
+void ChunkData::use_palette() {
+	assert(!palette_mode && "already using palette");
+
+	palette_blocks.init(size(), blocks[0]);
+
+	// fill runs in, clipped to our range (first run starts at lowest K)
+	for (auto iter = blocks.begin(); iter != blocks.end(); ++iter) {
+		const int start = std::max(0, (int)iter->first);
+		const int end = std::next(iter) != blocks.end() ? std::next(iter)->first : size();
+		palette_blocks.set_range(start, std::min(end, size()), iter->second);
+	}
+
+	blocks.clear(BlockType::Air);
+	palette_mode = true;
+	edits_since_check = 0;
+}
+
+// switch block storage back to run-length encoding
+void ChunkData::use_rle() {
+	assert(palette_mode && "already using RLE");
+
+	blocks.clear(BlockType::Air);
+
+	int start = 0;
+	BlockType start_block = palette_blocks.get(0);
+
+	for (int i = 1; i < size(); i++) {
+		const BlockType block = palette_blocks.get(i);
+		if (block != start_block) {
+			blocks.set_interval(start, i, start_block);
+			start = i;
+			start_block = block;
+		}
+	}
+
+	// add last interval
+	blocks.set_interval(start, size(), start_block);
+
+	palette_blocks.release();
+	palette_mode = false;
+	edits_since_check = 0;
 }
 
 /**
- * Given a cube of chunkdata coordinates, convert it into optimal intervals.
+ * Given a cube of chunkdata coordinates [min_xyz, max_xyz] (inclusive), convert it into as few [start, end) intervals as possible.
  * NOTE: Relies on the fact that we go in the order x, z, y.
  */
 std::vector<std::pair<int, int>> ChunkData::optimize_intervals(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz) {
-	// TODO: Make sure it works. Right now I think there's an off-by-one error. (Should be doing <= instead of <.)
-	assert(min_xyz[0] < max_xyz[0] && min_xyz[1] < max_xyz[1] && min_xyz[2] < max_xyz[2]);
+	assert(min_xyz[0] <= max_xyz[0] && min_xyz[1] <= max_xyz[1] && min_xyz[2] <= max_xyz[2]);
+	assert(0 <= min_xyz[0] && max_xyz[0] < width && "optimize_intervals invalid x coordinate");
+	assert(0 <= min_xyz[1] && max_xyz[1] < height && "optimize_intervals invalid y coordinate");
+	assert(0 <= min_xyz[2] && max_xyz[2] < depth && "optimize_intervals invalid z coordinate");
 
 	std::vector<std::pair<int, int>> result;
 
-	const vmath::ivec3 diffs = max_xyz - min_xyz;
-
-	// if x is 16
-	if (diffs[0] == 16) {
-		// if z is 16, only need one interval
-		if (diffs[2] == 16) {
-			result.push_back({ c2idx(min_xyz), c2idx(max_xyz) });
+	// if x spans the whole width, rows are contiguous along z
+	if (min_xyz[0] == 0 && max_xyz[0] == width - 1) {
+		// if z spans the whole depth too, layers are contiguous along y, so only need one interval
+		if (min_xyz[2] == 0 && max_xyz[2] == depth - 1) {
+			result.push_back({ c2idx(0, min_xyz[1], 0), c2idx(0, max_xyz[1] + 1, 0) });
 		}
-		// x is 16 but z is not 16
+		// one interval per y layer
 		else {
-			for (int y = min_xyz[1]; y < max_xyz[1]; y++) {
-				result.push_back({
-					c2idx(min_xyz[0], y, min_xyz[2]),
-					c2idx(max_xyz[0], y, max_xyz[2])
-					});
+			for (int y = min_xyz[1]; y <= max_xyz[1]; y++) {
+				result.push_back({ c2idx(0, y, min_xyz[2]), c2idx(0, y, max_xyz[2] + 1) });
 			}
 		}
 	}
-	// neither x nor z are 16
+	// one interval per row
 	else {
-		for (int y = min_xyz[1]; y < max_xyz[1]; y++) {
-			for (int z = min_xyz[2]; z < max_xyz[2]; z++) {
-				result.push_back({
-					c2idx(min_xyz[0], y, z),
-					c2idx(max_xyz[0], y, z)
-					});
+		for (int y = min_xyz[1]; y <= max_xyz[1]; y++) {
+			for (int z = min_xyz[2]; z <= max_xyz[2]; z++) {
+				result.push_back({ c2idx(min_xyz[0], y, z), c2idx(max_xyz[0], y, z) + 1 });
 			}
 		}
 	}
@@ -201,11 +639,164 @@ std::vector<std::pair<int, int>> ChunkData::optimize_intervals(const vmath::ivec
 	return result;
 }
 
-bool ChunkData::all_air() {
+// set blocks [begin, end) -> val, without re-evaluating block storage
+void ChunkData::set_block_range(const int begin, const int end, const BlockType& val) {
+	set_masks(begin, end, val);
+
+	if (palette_mode) {
+		palette_blocks.set_range(begin, end, val);
+	}
+	else {
+		blocks.set_interval(begin, end, val);
+	}
+}
+
+// switch block storage if a bulk edit made the current one a bad fit
+void ChunkData::update_block_storage() {
+	if (palette_mode) {
+		edits_since_check = 0;
+		if (palette_blocks.num_runs() < RLE_MAX_INTERVALS) {
+			use_rle();
+		}
+	}
+	else if (blocks.num_intervals() > PALETTE_MIN_INTERVALS) {
+		use_palette();
+	}
+}
+
+// set every block in [min_xyz, max_xyz] (inclusive) to `val`
+void ChunkData::fill_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& val) {
+	for (const auto& [start, end] : optimize_intervals(min_xyz, max_xyz)) {
+		set_block_range(start, end, val);
+	}
+
+	update_block_storage();
+}
+
+// find [start, end) ranges of `block` inside [min_xyz, max_xyz] (inclusive)
+std::vector<std::pair<int, int>> ChunkData::find_block_ranges(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& block) {
+	std::vector<std::pair<int, int>> result;
+
+	for (const auto& [start, end] : optimize_intervals(min_xyz, max_xyz)) {
+		if (palette_mode) {
+			int range_start = -1;
+			for (int i = start; i < end; i++) {
+				const bool match = palette_blocks.get(i) == block;
+				if (match && range_start == -1) {
+					range_start = i;
+				}
+				else if (!match && range_start != -1) {
+					result.push_back({ range_start, i });
+					range_start = -1;
+				}
+			}
+			if (range_start != -1) {
+				result.push_back({ range_start, end });
+			}
+		}
+		else {
+			// walk runs overlapping [start, end)
+			for (auto iter = blocks.get_interval(start); iter != blocks.end() && iter->first < end; ++iter) {
+				if (iter->second == block) {
+					const int run_end = std::next(iter) != blocks.end() ? std::next(iter)->first : size();
+					result.push_back({ std::max(start, (int)iter->first), std::min(end, run_end) });
+				}
+			}
+		}
+	}
+
+	return result;
+}
+
+// count `block` blocks in [min_xyz, max_xyz] (inclusive)
+int ChunkData::count_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& block) {
+	int result = 0;
+	for (const auto& [start, end] : find_block_ranges(min_xyz, max_xyz, block)) {
+		result += end - start;
+	}
+	return result;
+}
+
+// set every `from` block in [min_xyz, max_xyz] (inclusive) to `to`
+// returns number of blocks replaced
+int ChunkData::replace_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& from, const BlockType& to) {
+	if (from == to) {
+		return 0;
+	}
+
+	// find all ranges first, since replacing them would invalidate run iterators
+	int num_replaced = 0;
+	for (const auto& [start, end] : find_block_ranges(min_xyz, max_xyz, from)) {
+		set_block_range(start, end, to);
+		num_replaced += end - start;
+	}
+
+	if (num_replaced > 0) {
+		update_block_storage();
+	}
+
+	return num_replaced;
+}
+
+// paste schematic so that its (0, 0, 0) lands on `origin` (which may be outside of us), clipping whatever doesn't fit
+// returns number of blocks written
+int ChunkData::paste(const Schematic& schematic, const vmath::ivec3& origin) {
+	// overlap of schematic and us, in our coordinates
+	const vmath::ivec3 min_xyz = { std::max(origin[0], 0), std::max(origin[1], 0), std::max(origin[2], 0) };
+	const vmath::ivec3 max_xyz = {
+		std::min(origin[0] + schematic.size[0], width) - 1,
+		std::min(origin[1] + schematic.size[1], height) - 1,
+		std::min(origin[2] + schematic.size[2], depth) - 1,
+	};
+
+	if (min_xyz[0] > max_xyz[0] || min_xyz[1] > max_xyz[1] || min_xyz[2] > max_xyz[2]) {
+		return 0;
+	}
+
+	int num_written = 0;
+
+	// go row by row, writing each run of equal blocks at once
+	for (int y = min_xyz[1]; y <= max_xyz[1]; y++) {
+		for (int z = min_xyz[2]; z <= max_xyz[2]; z++) {
+			int x = min_xyz[0];
+			while (x <= max_xyz[0]) {
+				const BlockType block = schematic.get_block(x - origin[0], y - origin[1], z - origin[2]);
+
+				int run_end = x + 1;
+				while (run_end <= max_xyz[0] && schematic.get_block(run_end - origin[0], y - origin[1], z - origin[2]) == block) {
+					run_end++;
+				}
+
+				if (schematic.paste_air || block != BlockType::Air) {
+					set_block_range(c2idx(x, y, z), c2idx(run_end - 1, y, z) + 1, block);
+					num_written += run_end - x;
+				}
+
+				x = run_end;
+			}
+		}
+	}
+
+	if (num_written > 0) {
+		update_block_storage();
+	}
+
+	return num_written;
+}
+
+bool ChunkData::all_air() const {
+	if (palette_mode) {
+		return palette_blocks.num_types() == 1 && palette_blocks.contains(BlockType::Air);
+	}
+
 	return blocks[0] == BlockType::Air && blocks.num_intervals() == 1;
 }
 
 bool ChunkData::any_air() {
+	if (palette_mode) {
+		return palette_blocks.contains(BlockType::Air);
+	}
+
 	for (auto iter = blocks.get_interval(0); iter != blocks.end(); ++iter) {
 		if (iter->first < width * depth * height && iter->second == BlockType::Air) {
 			return true;
@@ -218,6 +809,10 @@ bool ChunkData::any_air() {
 }
 
 bool ChunkData::any_translucent() {
+	if (palette_mode) {
+		return palette_blocks.contains_if([](const BlockType& b) { return b.is_translucent(); });
+	}
+
 	for (auto iter = this->blocks.get_interval(0); iter != blocks.end(); ++iter) {
 		if (iter->first < width * depth * height && iter->second.is_translucent()) {
 			return true;
@@ -231,6 +826,113 @@ bool ChunkData::any_translucent() {
 
 void ChunkData::set_all_air() {
 	blocks.clear(BlockType::Air);
+	std::fill(opaque_mask.begin(), opaque_mask.end(), 0);
+	std::fill(solid_mask.begin(), solid_mask.end(), 0);
+
+	if (palette_mode) {
+		palette_blocks.release();
+		palette_mode = false;
+		edits_since_check = 0;
+	}
+}
+
+// whether blocks are currently stored bit-packed
+bool ChunkData::uses_palette() const {
+	return palette_mode;
+}
+
+// memory used, including heap (bytes)
+size_t ChunkData::memory_usage() const {
+	return sizeof(*this)
+		+ palette_blocks.memory_usage()
+		+ (opaque_mask.capacity() + solid_mask.capacity()) * sizeof(uint64_t)
+		+ blocks.memory_usage() + metadatas.memory_usage() + lightings.memory_usage();
+}
+
+// update occupancy bitmasks for blocks [begin, end) -> val
+void ChunkData::set_masks(const int begin, const int end, const BlockType& val) {
+	const bool opaque = !val.is_translucent();
+	const bool solid = val.is_solid();
+
+	// one word at a time
+	for (int i = begin; i < end;) {
+		const int word = i / 64;
+		const int bit = i % 64;
+		const int num_bits = std::min(64 - bit, end - i);
+		const uint64_t bits = (num_bits == 64 ? ~uint64_t(0) : (uint64_t(1) << num_bits) - 1) << bit;
+
+		opaque_mask[word] = opaque ? opaque_mask[word] | bits : opaque_mask[word] & ~bits;
+		solid_mask[word] = solid ? solid_mask[word] | bits : solid_mask[word] & ~bits;
+
+		i += num_bits;
+	}
+}
+
+// whether block at these coordinates is opaque (i.e. not translucent)
+bool ChunkData::is_opaque(const int x, const int y, const int z) const {
+	assert(0 <= x && x < width && "is_opaque invalid x coordinate");
+	assert(0 <= z && z < depth && "is_opaque invalid z coordinate");
+
+	// Outside of height range is just air
+	if (y < 0 || y >= height) {
+		return false;
+	}
+
+	const int idx = c2idx(x, y, z);
+	return (opaque_mask[idx / 64] >> (idx % 64)) & 1;
+}
+
+bool ChunkData::is_opaque(const vmath::ivec3& xyz) const { return is_opaque(xyz[0], xyz[1], xyz[2]); }
+
+// whether block at these coordinates is solid
+bool ChunkData::is_solid(const int x, const int y, const int z) const {
+	assert(0 <= x && x < width && "is_solid invalid x coordinate");
+	assert(0 <= z && z < depth && "is_solid invalid z coordinate");
+
+	// Outside of height range is just air
+	if (y < 0 || y >= height) {
+		return false;
+	}
+
+	const int idx = c2idx(x, y, z);
+	return (solid_mask[idx / 64] >> (idx % 64)) & 1;
+}
+
+bool ChunkData::is_solid(const vmath::ivec3& xyz) const { return is_solid(xyz[0], xyz[1], xyz[2]); }
+
+// whether every block is opaque
+bool ChunkData::all_opaque() const {
+	return std::all_of(opaque_mask.begin(), opaque_mask.end(), [](const uint64_t word) { return word == ~uint64_t(0); });
+}
+
+// whether every block in a layer is opaque
+// layers_idx: axis the layer is perpendicular to (0 = x, 1 = y, 2 = z)
+// layer_no: which layer along that axis
+bool ChunkData::layer_opaque(const int layers_idx, const int layer_no) const {
+	// each word holds 4 x-rows of the same y-layer
+	assert(width == 16 && depth == 16 && "layer_opaque only supports 16x16 layers");
+
+	switch (layers_idx) {
+	// x = layer_no: one bit in each x-row
+	case 0: {
+		const uint64_t pattern = uint64_t(0x0001000100010001) << layer_no;
+		return std::all_of(opaque_mask.begin(), opaque_mask.end(), [pattern](const uint64_t word) { return (word & pattern) == pattern; });
+	}
+	// y = layer_no: 4 whole words
+	case 1:
+		return std::all_of(opaque_mask.begin() + layer_no * 4, opaque_mask.begin() + layer_no * 4 + 4, [](const uint64_t word) { return word == ~uint64_t(0); });
+	// z = layer_no: one x-row in every y-layer
+	case 2:
+		for (int y = 0; y < height; y++) {
+			if (((opaque_mask[y * 4 + layer_no / 4] >> (16 * (layer_no % 4))) & 0xFFFF) != 0xFFFF) {
+				return false;
+			}
+		}
+		return true;
+	default:
+		assert(false && "invalid layers_idx");
+		return false;
+	}
 }
 
 // get metadata at these coordinates
@@ -10,6 +10,14 @@ constexpr int BLOCK_MIN_HEIGHT = 0;
 constexpr int BLOCK_MAX_HEIGHT = 255;
 constexpr int MINIS_PER_CHUNK = 16; // TODO: = (CHUNK_HEIGHT / MINICHUNK_HEIGHT);
 
+// Block storage switching
+// A run costs 4 bytes, so past ~512 runs a 16^3 mini is smaller bit-packed (<= 2KB at 4 bits per block).
+// Switching back happens at a lower count, so a mini hovering around the threshold doesn't flip-flop.
+constexpr int PALETTE_MIN_INTERVALS = 512;
+constexpr int RLE_MAX_INTERVALS = 256;
+// while bit-packed, re-count runs after this many single-block edits
+constexpr int PALETTE_RECHECK_EDITS = 256;
+
 
 // block metadata
 // stores some extra info depending on block type
@@ -55,13 +63,139 @@ public:
 	bool operator!=(const Lighting& l) const;
 };
 
+// a box of blocks that can be pasted into a ChunkData/Chunk/World
+// stored x -> z -> y, same as ChunkData
+struct Schematic {
+	vmath::ivec3 size;
+	std::vector<BlockType> blocks;
+
+	// if false, air in the schematic leaves the destination block alone
+	bool paste_air = false;
+
+	Schematic(const vmath::ivec3& size);
+
+	// convert coordinates to idx
+	int c2idx(const int x, const int y, const int z) const;
+
+	BlockType get_block(const int x, const int y, const int z) const;
+	void set_block(const int x, const int y, const int z, const BlockType& val);
+};
+
+// Bit-packed block storage
+// Stores a palette of block types, plus one palette index per block.
+// Indices are 1/2/4/8 bits wide, growing with the palette, so reads are O(1) and size doesn't depend on how noisy the blocks are.
+class BlockPalette {
+private:
+	std::vector<BlockType> palette;
+	std::vector<uint16_t> counts; // how many blocks use each palette entry (0 = free slot)
+	std::vector<uint64_t> data;
+	int bits_log2;
+	int num_blocks;
+
+	inline int get_idx(const int idx) const {
+		const int word = idx >> (6 - bits_log2);
+		const int shift = (idx & ((64 >> bits_log2) - 1)) << bits_log2;
+		const uint64_t mask = (uint64_t(1) << (1 << bits_log2)) - 1;
+		return (data[word] >> shift) & mask;
+	}
+
+	inline void set_idx(const int idx, const int palette_idx) {
+		const int word = idx >> (6 - bits_log2);
+		const int shift = (idx & ((64 >> bits_log2) - 1)) << bits_log2;
+		const uint64_t mask = (uint64_t(1) << (1 << bits_log2)) - 1;
+		data[word] = (data[word] & ~(mask << shift)) | (uint64_t(palette_idx) << shift);
+	}
+
+	// find palette entry for `val`, adding it if required (may widen indices)
+	int find_or_add(const BlockType& val);
+
+	// re-pack indices with 2^new_bits_log2 bits each
+	void repack(const int new_bits_log2);
+
+public:
+	BlockPalette();
+
+	// reset to `num_blocks` blocks of `fill`
+	void init(const int num_blocks, const BlockType& fill);
+
+	// free all memory
+	void release();
+
+	inline BlockType get(const int idx) const {
+		return palette[get_idx(idx)];
+	}
+
+	void set(const int idx, const BlockType& val);
+
+	// set [begin, end) -> val
+	void set_range(const int begin, const int end, const BlockType& val);
+
+	// whether any block is `val`
+	bool contains(const BlockType& val) const;
+
+	// whether any block satisfies `pred`
+	template <typename F>
+	bool contains_if(F pred) const {
+		for (size_t i = 0; i < palette.size(); i++) {
+			if (counts[i] > 0 && pred(palette[i])) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// number of (used) palette entries
+	int num_types() const;
+
+	// number of runs of equal blocks, i.e. the size this would take as an IntervalMap
+	int num_runs() const;
+
+	// bits used per block
+	inline int bits_per_block() const {
+		return 1 << bits_log2;
+	}
+
+	// heap memory used (bytes)
+	size_t memory_usage() const;
+};
+
 // Chunk Data is always stored as width wide and depth deep
 class ChunkData {
+private:
+	// blocks are stored in one of two ways -- see PALETTE_MIN_INTERVALS
+	//   RLE:     `blocks`, cheap when blocks come in long runs (air, stone, water)
+	//   Palette: `palette_blocks`, cheap when they don't (ores, leaves, caves)
+	BlockPalette palette_blocks;
+	bool palette_mode = false;
+	int edits_since_check = 0;
+
+	// occupancy bitmasks, one bit per block (bit i of word j => block at idx 64 * j + i)
+	// kept in sync with blocks, so callers can answer "can I see/walk through this" without touching block storage
+	std::vector<uint64_t> opaque_mask; // !is_translucent()
+	std::vector<uint64_t> solid_mask; // is_solid()
+
+	// update occupancy bitmasks for blocks [begin, end) -> val
+	void set_masks(const int begin, const int end, const BlockType& val);
+
+	// switch block storage
+	void use_palette();
+	void use_rle();
+
+	// switch block storage if a bulk edit made the current one a bad fit
+	void update_block_storage();
+
+	// set blocks [begin, end) -> val, without re-evaluating block storage
+	void set_block_range(const int begin, const int end, const BlockType& val);
+
+	// find [start, end) ranges of `block` inside [min_xyz, max_xyz] (inclusive)
+	std::vector<std::pair<int, int>> find_block_ranges(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& block);
+
 public:
 	// TODO: unsigned short
-	IntervalMap<short, BlockType> blocks;
-	IntervalMap<short, Metadata> metadatas;
-	IntervalMap<short, Metadata> lightings;
+	// only valid when !uses_palette()
+	FlatIntervalMap<short, BlockType> blocks;
+	FlatIntervalMap<short, Metadata> metadatas;
+	FlatIntervalMap<short, Metadata> lightings;
 
 	const int width;
 	const int height;
@@ -101,13 +235,43 @@ public:
 	// relies on x -> z -> y
 	void set_blocks(BlockType* new_blocks);
 
+	// copy all blocks into array (x -> z -> y), a whole run at a time
+	void extract_blocks(BlockType* result) const;
+
+	// copy one layer of blocks into array, walking the runs once
+	// layers_idx: axis the layer is perpendicular to (0 = x, 1 = y, 2 = z)
+	// layer_no: which layer along that axis
+	// result holds the other two coordinates in storage order, i.e. [y][z] / [z][x] / [y][x]
+	void extract_layer(const int layers_idx, const int layer_no, BlockType* result) const;
+
+	// append blocks, metadata and lighting to `out`, as runs (format: see region.h)
+	void serialize(std::vector<uint8_t>& out) const;
+
+	// read back what serialize() wrote, advancing `in`
+	// returns false if the data is invalid (leaving us with whatever was read so far)
+	bool deserialize(const uint8_t*& in, const uint8_t* end);
+
 	/**
-	 * Given a cube of chunkdata coordinates, convert it into optimal intervals.
+	 * Given a cube of chunkdata coordinates [min_xyz, max_xyz] (inclusive), convert it into as few [start, end) intervals as possible.
 	 * NOTE: Relies on the fact that we go in the order x, z, y.
 	 */
 	std::vector<std::pair<int, int>> optimize_intervals(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz);
 
-	bool all_air();
+	// set every block in [min_xyz, max_xyz] (inclusive) to `val`
+	void fill_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& val);
+
+	// count `block` blocks in [min_xyz, max_xyz] (inclusive)
+	int count_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& block);
+
+	// set every `from` block in [min_xyz, max_xyz] (inclusive) to `to`
+	// returns number of blocks replaced
+	int replace_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& from, const BlockType& to);
+
+	// paste schematic so that its (0, 0, 0) lands on `origin` (which may be outside of us), clipping whatever doesn't fit
+	// returns number of blocks written
+	int paste(const Schematic& schematic, const vmath::ivec3& origin);
+
+	bool all_air() const;
 
 	bool any_air();
 
@@ -115,6 +279,28 @@ public:
 
 	void set_all_air();
 
+	// whether blocks are currently stored bit-packed
+	bool uses_palette() const;
+
+	// memory used, including heap (bytes)
+	size_t memory_usage() const;
+
+	// whether block at these coordinates is opaque (i.e. not translucent)
+	bool is_opaque(const int x, const int y, const int z) const;
+	bool is_opaque(const vmath::ivec3& xyz) const;
+
+	// whether block at these coordinates is solid
+	bool is_solid(const int x, const int y, const int z) const;
+	bool is_solid(const vmath::ivec3& xyz) const;
+
+	// whether every block is opaque
+	bool all_opaque() const;
+
+	// whether every block in a layer is opaque
+	// layers_idx: axis the layer is perpendicular to (0 = x, 1 = y, 2 = z)
+	// layer_no: which layer along that axis
+	bool layer_opaque(const int layers_idx, const int layer_no) const;
+
 	// get metadata at these coordinates
 	Metadata get_metadata(const int& x, const int& y, const int& z) const;
 
@@ -1,9 +1,10 @@
 #include "chunker.h"
 
+#include "region.h"
+#include "settings.h"
 #include "world_meshing.h"
 
-#include "zmq_addon.hpp"
-
+#include <algorithm>
 #include <cassert>
 
 
@@ -11,23 +12,15 @@ using namespace vmath;
 using namespace std;
 
 
-void ChunkGenThread2(std::shared_ptr<zmq::context_t> ctx, msg::on_ready_fn on_ready)
+void ChunkGenThread2(msg::on_ready_fn on_ready)
 {
-	Chunker c(ctx);
+	Chunker c(get_settings().num_chunk_gen_threads);
 	c.run(on_ready);
 }
 
-Chunker::Chunker(std::shared_ptr<zmq::context_t> ctx_) : ctx(ctx_), bus(ctx_), player_coords({ 0, 0 })
+Chunker::Chunker(const int num_workers_) : mailbox(msg::get_mailboxes().chunker), num_workers(num_workers_), player_coords({ 0, 0 })
 {
-#ifdef _DEBUG
-	bus.out.setsockopt(ZMQ_SUBSCRIBE, "", 0);
-#else
-	for (const auto& m : msg::chunk_gen_thread_incoming)
-	{
-		// TODO: Upgrade cppzmq and replace this with .set()
-		bus.out.setsockopt(ZMQ_SUBSCRIBE, m.c_str(), m.size());
-	}
-#endif // _DEBUG
+	assert(num_workers > 0 && "need at least one chunk gen worker");
 }
 
 // thread for generating new chunk meshes
@@ -35,23 +28,38 @@ void Chunker::run(msg::on_ready_fn on_ready) {
 	// Prove you're connected
 	on_ready();
 
-	// Run thread until stopped
+	// Start workers
+	for (int i = 0; i < num_workers; i++)
+	{
+		workers.push_back(std::make_unique<ChunkGenWorker>());
+	}
+	for (int i = 0; i < num_workers; i++)
+	{
+		workers[i]->thread = std::thread(&Chunker::run_worker, this, i);
+	}
+
+	// Feed them requests until stopped
 	bool stop = false;
 	while (!stop)
 	{
-		// If no queued requests, wait for a message to come in
-		bool wait_for_first = pq.size() == 0;
-		handle_all_messages(wait_for_first, stop);
-		if (stop) break;
+		handle_all_messages(true, stop);
+	}
 
-		// Handle a queued request if exists
-		handle_queued_request();
+	// Stop workers (anything still queued is dropped)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	cv.notify_all();
+	for (auto& worker : workers)
+	{
+		worker->thread.join();
 	}
 }
 
 void Chunker::handle_all_messages(bool wait_for_first, bool& stop)
 {
-	std::vector<zmq::message_t> msg;
+	msg::ChunkerMessage msg;
 	bool wait = wait_for_first;
 	while (read_msg(wait, msg))
 	{
@@ -61,91 +69,247 @@ void Chunker::handle_all_messages(bool wait_for_first, bool& stop)
 	}
 }
 
-void Chunker::on_msg(const std::vector<zmq::message_t>& msg, bool& stop)
+void Chunker::on_msg(msg::ChunkerMessage& msg, bool& stop)
 {
-	if (msg[0].to_string_view() == msg::EXIT)
+	if (std::holds_alternative<msg::Exit>(msg))
 	{
 		stop = true;
 	}
-	else if (msg[0].to_string_view() == msg::CHUNK_GEN_REQUEST)
+	else if (auto reqs = std::get_if<msg::ChunkGenRequests>(&msg))
 	{
 		// Enqueue any chunking requests
-		// TODO: Just enqueue, then later distribute to workers.
-		ChunkGenRequest* req_ = *(msg[1].data<ChunkGenRequest*>());
-		assert(req_);
-		std::shared_ptr<ChunkGenRequest> req(req_);
-		on_chunk_gen_request(req);
-	}
-	else if (msg[0].to_string_view() == msg::EVENT_PLAYER_MOVED_CHUNKS)
-	{
-		vmath::ivec2 new_coords = *(msg[1].data<vmath::ivec2>());
-		update_player_coords(new_coords);
+		on_chunk_gen_requests(*reqs);
 	}
-	else
+	else if (auto event = std::get_if<PlayerMovedChunksEvent>(&msg))
 	{
-#ifndef _DEBUG
-		WindowsException("unknown message");
-#endif // _DEBUG
+		update_player_coords(event->coords, event->render_distance);
 	}
 }
 
-bool Chunker::read_msg(bool wait, std::vector<zmq::message_t>& msg)
+bool Chunker::read_msg(bool wait, msg::ChunkerMessage& msg)
 {
-	msg.clear();
-	auto flags = wait ? zmq::recv_flags::none : zmq::recv_flags::dontwait;
-	auto ret = zmq::recv_multipart(bus.out, std::back_inserter(msg), flags);
-	return ret > 0;
+	if (wait)
+	{
+		mailbox.wait();
+	}
+	return mailbox.try_pop(msg);
 }
 
-bool Chunker::handle_queued_request()
+void Chunker::run_worker(const int worker_idx)
 {
-	if (pq.size())
+	ChunkGenContext& gen_ctx = *workers[worker_idx]->gen_ctx;
+
+	std::shared_ptr<ChunkGenRequest> req;
+	while (next_request(worker_idx, req))
 	{
-		// handle one
-		vmath::ivec2 coords = pq.top().coords;
-		pq.pop();
-		auto search = reqs.find(coords);
-		assert(search != reqs.end());
-		reqs.erase(search);
+		const vmath::ivec2 coords = req->coords;
 
-		// generate a chunk
-		ChunkGenResponse* response = new ChunkGenResponse;
+		// load chunk if it's been saved, otherwise generate it
+		std::unique_ptr<ChunkGenResponse> response = std::make_unique<ChunkGenResponse>();
 		response->coords = coords;
+		response->request_class = req->request_class;
+		response->requested_at = req->requested_at;
 		response->chunk = std::make_unique<Chunk>(coords);
-		response->chunk->generate();
+		if (!get_region_store().load(coords, *response->chunk))
+		{
+			response->chunk->generate(gen_ctx);
+		}
+		get_chunk_work_counters().completed++;
 
 		// send it
-		std::vector<zmq::const_buffer> result({
-			zmq::buffer(msg::CHUNK_GEN_RESPONSE),
-			zmq::buffer(&response, sizeof(response))
-			});
-		auto ret = zmq::send_multipart(bus.in, result, zmq::send_flags::dontwait);
-		assert(ret);
+		msg::get_mailboxes().world.push(Envelope(std::move(response)));
+	}
+}
 
-		return true;
+// get the next request for this worker to handle, waiting if there are none
+// returns false once we're stopping
+bool Chunker::next_request(const int worker_idx, std::shared_ptr<ChunkGenRequest>& result)
+{
+	ChunkGenWorker& me = *workers[worker_idx];
+	while (!stopping)
+	{
+		// take closest from our own queue
+		{
+			std::lock_guard<std::mutex> lock(me.queue_mtx);
+			if (me.queue.size())
+			{
+				result = me.queue.front();
+				me.queue.pop_front();
+				num_in_worker_queues--;
+				return true;
+			}
+		}
+
+		// steal furthest from someone else's queue
+		for (int i = 1; i < num_workers; i++)
+		{
+			ChunkGenWorker& other = *workers[(worker_idx + i) % num_workers];
+			std::lock_guard<std::mutex> lock(other.queue_mtx);
+			if (other.queue.size())
+			{
+				result = other.queue.back();
+				other.queue.pop_back();
+				num_in_worker_queues--;
+				return true;
+			}
+		}
+
+		// take a new batch from the shared queue
+		std::unique_lock<std::mutex> lock(mtx);
+		const auto any_queued = [&] { return std::any_of(std::begin(queues), std::end(queues), [](const auto& queue) { return !queue.empty(); }); };
+		cv.wait(lock, [&] { return stopping || any_queued() || num_in_worker_queues > 0; });
+		if (stopping || !any_queued())
+		{
+			// stopping, or there's something to steal now
+			continue;
+		}
+
+		std::lock_guard<std::mutex> queue_lock(me.queue_mtx);
+		std::shared_ptr<ChunkGenRequest> req;
+		for (int i = 0; i < CHUNK_GEN_BATCH_SIZE && pop_request(req); i++)
+		{
+			me.queue.push_back(req);
+			num_in_worker_queues++;
+		}
+
+		// let idle workers steal the rest of our batch
+		if (me.queue.size() > 1)
+		{
+			cv.notify_all();
+		}
 	}
 
 	return false;
 }
 
-void Chunker::on_chunk_gen_request(std::shared_ptr<ChunkGenRequest> req)
+// take the next request off the queues (must hold mtx)
+// returns false if there are none (left)
+bool Chunker::pop_request(std::shared_ptr<ChunkGenRequest>& result)
 {
-	if (!reqs.contains(req->coords))
+	while (true)
 	{
-		float priority = vmath::distance(req->coords, player_coords);
-		pq.emplace(static_cast<int>(priority), req->coords);
-		reqs.insert(req->coords);
+		bool waiting[NUM_REQUEST_CLASSES];
+		for (int i = 0; i < NUM_REQUEST_CLASSES; i++)
+		{
+			waiting[i] = !queues[i].empty();
+		}
+
+		const int request_class = pick_request_class(waiting, passed_over);
+		if (request_class < 0)
+		{
+			return false;
+		}
+
+		// front one might've been queued before the player moved, so drop it if it's too far now, and make sure its priority's up to date
+		auto& queue = queues[request_class];
+		while (!queue.empty())
+		{
+			const auto& top = queue.top();
+			if (too_far(top.key))
+			{
+				queue.pop();
+				get_chunk_work_counters().cancelled++;
+				continue;
+			}
+
+			const int new_priority = priority(top.key);
+			if (new_priority <= top.priority)
+			{
+				break;
+			}
+			queue.update(top.key, new_priority);
+		}
+
+		// all cancelled => pick again
+		if (queue.empty())
+		{
+			continue;
+		}
+
+		result = queue.pop().value;
+		return true;
+	}
+}
+
+void Chunker::on_chunk_gen_requests(const msg::ChunkGenRequests& reqs)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	for (const auto& req : reqs)
+	{
+		queue_request(req);
+	}
+
+	if (reqs.size() == 1)
+	{
+		cv.notify_one();
+	}
+	else
+	{
+		cv.notify_all();
+	}
+}
+
+void Chunker::queue_request(const ChunkGenRequest& req_)
+{
+	std::shared_ptr<ChunkGenRequest> req = std::make_shared<ChunkGenRequest>(req_);
+
+	// already queued => keep it, unless this one's more urgent
+	for (int i = 0; i < NUM_REQUEST_CLASSES; i++)
+	{
+		std::shared_ptr<ChunkGenRequest>* queued = queues[i].find(req->coords);
+		if (queued)
+		{
+			if (req->request_class >= (*queued)->request_class)
+			{
+				return;
+			}
+
+			req->requested_at = std::min(req->requested_at, (*queued)->requested_at);
+			queues[i].erase(req->coords);
+			break;
+		}
 	}
+
+	queues[static_cast<int>(req->request_class)].push(req->coords, priority(req->coords), req);
 }
 
-void Chunker::update_player_coords(const vmath::ivec2& new_coords)
+void Chunker::update_player_coords(const vmath::ivec2& new_coords, const int render_distance)
 {
-	if (new_coords != player_coords)
+	std::lock_guard<std::mutex> lock(mtx);
+	if (new_coords != player_coords || render_distance != this->render_distance)
 	{
+		// (+ 1, since priorities are rounded down)
+		priority_drift += static_cast<int>(vmath::distance(new_coords, player_coords)) + 1;
+
+		// first time we know render distance, or it shrunk => might be lots to drop right away
+		const bool fewer_wanted = this->render_distance < 0 || render_distance < this->render_distance;
 		player_coords = new_coords;
+		this->render_distance = render_distance;
 
-		// Adjust priority queue priorities:
-		std::function<void(chunker_pq_entry&)> adjust = [&](chunker_pq_entry& e) { e.priority = vmath::distance(vmath::ivec2(e.coords[0], e.coords[2]), player_coords); };
-		update_pq_priorities(pq, adjust);
+		// until they've drifted too far, queued priorities get fixed (and far ones dropped) as they reach the front (see pop_request)
+		if (priority_drift > MAX_QUEUE_PRIORITY_DRIFT || fewer_wanted)
+		{
+			priority_drift = 0;
+
+			// drop whatever's too far now
+			int num_cancelled = 0;
+			for (auto& queue : queues)
+			{
+				num_cancelled += queue.erase_if([&](const auto& entry) { return too_far(entry.key); });
+				queue.reprioritize([&](const vmath::ivec2& coords) { return priority(coords); });
+			}
+			get_chunk_work_counters().cancelled += num_cancelled;
+		}
 	}
 }
+
+int Chunker::priority(const vmath::ivec2& coords) const
+{
+	return static_cast<int>(vmath::distance(coords, player_coords));
+}
+
+bool Chunker::too_far(const vmath::ivec2& coords) const
+{
+	// same test the world uses to drop the result (see WorldDataPart::handle_messages)
+	return render_distance >= 0 && should_unload_chunk(coords, player_coords, render_distance);
+}
@@ -1,62 +1,96 @@
 #pragma once
 
+#include "chunk.h"
+#include "indexed_heap.h"
 #include "messaging.h"
 #include "world_utils.h"
 
 #include "vmath.h"
-#include "zmq.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
-#include <queue>
-#include <unordered_set>
+#include <mutex>
+#include <thread>
 #include <vector>
 
-void ChunkGenThread2(std::shared_ptr<zmq::context_t> ctx, msg::on_ready_fn on_ready);
+// how many requests an idle chunk gen worker takes from the shared queue at once
+// kept small, so requests mostly leave the queue in distance order (and the rest get stolen)
+constexpr int CHUNK_GEN_BATCH_SIZE = 4;
 
-struct chunker_pq_entry
+void ChunkGenThread2(msg::on_ready_fn on_ready);
+
+// a chunk gen worker
+struct ChunkGenWorker
 {
-	chunker_pq_entry(int priority_, const vmath::ivec2& coords_) : priority(priority_), coords(coords_)
-	{
-	}
-
-	friend bool operator<(const chunker_pq_entry& lhs, const chunker_pq_entry& rhs)
-	{
-		return lhs.priority < rhs.priority;
-	}
-
-	friend bool operator>(const chunker_pq_entry& lhs, const chunker_pq_entry& rhs)
-	{
-		return lhs.priority > rhs.priority;
-	}
-
-	int priority;
-	vmath::ivec2 coords;
+	// requests this worker will handle
+	// the owner takes from the front (most urgent first), other workers steal from the back
+	std::mutex queue_mtx;
+	std::deque<std::shared_ptr<ChunkGenRequest>> queue;
+
+	// scratch space + noise generators, only used by this worker
+	std::unique_ptr<ChunkGenContext> gen_ctx = std::make_unique<ChunkGenContext>();
+
+	std::thread thread;
 };
 
+// Chunk generation
+// One thread reads requests out of its mailbox into a shared queue, and num_workers worker threads generate them.
+// Idle workers take a batch from the shared queue, or steal from other workers' batches.
+// The shared queue serves requests by class (see pick_request_class), and within a class closest to the player first.
 class Chunker
 {
 public:
-	Chunker(std::shared_ptr<zmq::context_t> ctx_);
+	Chunker(const int num_workers_);
 	~Chunker() = default;
 
 	void run(msg::on_ready_fn on_ready);
 
 private:
-	bool read_msg(bool wait, std::vector<zmq::message_t>& msg);
+	bool read_msg(bool wait, msg::ChunkerMessage& msg);
 	void handle_all_messages(bool wait_for_first, bool& stop);
-	void on_msg(const std::vector<zmq::message_t>& msg, bool& stop);
-	bool handle_queued_request();
-	void on_chunk_gen_request(std::shared_ptr<ChunkGenRequest> req);
-	void update_player_coords(const vmath::ivec2& new_cords);
+	void on_msg(msg::ChunkerMessage& msg, bool& stop);
+	void run_worker(const int worker_idx);
+	bool next_request(const int worker_idx, std::shared_ptr<ChunkGenRequest>& result);
+	bool pop_request(std::shared_ptr<ChunkGenRequest>& result);
+	void on_chunk_gen_requests(const msg::ChunkGenRequests& reqs);
+
+	// queue request, unless a more urgent one for the same coords is already queued (must hold mtx)
+	void queue_request(const ChunkGenRequest& req);
+	void update_player_coords(const vmath::ivec2& new_cords, const int render_distance);
+
+	// distance from player (must hold mtx)
+	int priority(const vmath::ivec2& coords) const;
+
+	// whether player's too far from coords to bother generating them (must hold mtx)
+	bool too_far(const vmath::ivec2& coords) const;
 
 private:
-	std::shared_ptr<zmq::context_t> ctx;
-	BusNode bus;
+	Mailbox<msg::ChunkerMessage>& mailbox;
+
+	const int num_workers;
+	std::vector<std::unique_ptr<ChunkGenWorker>> workers;
+
+	// number of coords sitting in workers' queues (so idle workers know whether there's anything to steal)
+	std::atomic<int> num_in_worker_queues = 0;
+
+	// everything below is shared with workers -- only touch while holding mtx
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::atomic<bool> stopping = false;
 
 	// Player's last-known coords (so we always generate meshes closest to here)
 	vmath::ivec2 player_coords;
+	int render_distance = -1; // -1 = unknown
+
+	// how far the player's moved since queued priorities were last all recomputed (see MAX_QUEUE_PRIORITY_DRIFT)
+	int priority_drift = 0;
+
+	// Keep queue of incoming requests per class (based on distance to player)
+	// each coords is queued at most once, in its request's class
+	IndexedHeap<vmath::ivec2, std::shared_ptr<ChunkGenRequest>, vecN_hash> queues[NUM_REQUEST_CLASSES];
 
-	// Keep queue of incoming requests (based on distance to player)
-	std::priority_queue<chunker_pq_entry, std::vector<chunker_pq_entry>, std::greater<chunker_pq_entry>> pq;
-	std::unordered_set<vmath::ivec2, vecN_hash> reqs;
+	// how many times in a row each class was passed over (see pick_request_class)
+	int passed_over[NUM_REQUEST_CLASSES] = {};
 };
@@ -0,0 +1,25 @@
+#include "draw_commands.h"
+
+#include <algorithm>
+
+
+// start a new frame
+void DrawCommandList::clear() {
+	commands.clear();
+	total_vertices = 0;
+}
+
+// add a draw, unless it's empty
+void DrawCommandList::add(const uint32_t first, const uint32_t count, const uint32_t base_instance) {
+	if (count == 0) {
+		return;
+	}
+
+	commands.push_back({ count, 1, first, base_instance });
+	total_vertices += count;
+}
+
+// sort draws by where they are in the vertex buffer
+void DrawCommandList::sort_by_first() {
+	std::sort(commands.begin(), commands.end(), [](const DrawArraysIndirectCommand& a, const DrawArraysIndirectCommand& b) { return a.first < b.first; });
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// one draw in a glMultiDrawArraysIndirect call (layout fixed by OpenGL)
+struct DrawArraysIndirectCommand {
+	uint32_t count;
+	uint32_t instance_count;
+	uint32_t first;
+	uint32_t base_instance;
+};
+
+static_assert(sizeof(DrawArraysIndirectCommand) == 16, "DrawArraysIndirectCommand must match GL's layout");
+
+// List of draws to submit with one glMultiDrawArraysIndirect call, built on the CPU each frame
+// No GL in here -- the caller uploads data() to a GL_DRAW_INDIRECT_BUFFER.
+class DrawCommandList
+{
+public:
+	// start a new frame (keeps the memory)
+	void clear();
+
+	// draw `count` vertices starting at `first`, as one instance `base_instance` (i.e. which per-instance attributes to use)
+	// empty draws are skipped
+	void add(const uint32_t first, const uint32_t count, const uint32_t base_instance);
+
+	// sort draws by where they are in the vertex buffer, so the GPU reads it front to back
+	void sort_by_first();
+
+	inline const std::vector<DrawArraysIndirectCommand>& get_commands() const {
+		return commands;
+	}
+
+	inline size_t size() const {
+		return commands.size();
+	}
+
+	inline bool empty() const {
+		return commands.empty();
+	}
+
+	// total vertices drawn
+	inline size_t num_vertices() const {
+		return total_vertices;
+	}
+
+private:
+	std::vector<DrawArraysIndirectCommand> commands;
+	size_t total_vertices = 0;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+// how many payloads of one type exist, and how many were dropped while still in a message
+struct PayloadCounters {
+	std::atomic<int> live = 0;
+	std::atomic<int> dropped = 0;
+};
+
+template <typename T>
+PayloadCounters& get_payload_counters() {
+	static PayloadCounters counters;
+	return counters;
+}
+
+// base for message payloads that keeps get_payload_counters<T>().live up to date
+// so if memory creeps up, live counts show which stage of the pipeline is holding on to things
+template <typename T>
+struct LiveCounted {
+	LiveCounted() {
+		get_payload_counters<T>().live++;
+	}
+
+	LiveCounted(const LiveCounted&) {
+		get_payload_counters<T>().live++;
+	}
+
+	LiveCounted& operator=(const LiveCounted&) = default;
+
+	~LiveCounted() {
+		get_payload_counters<T>().live--;
+	}
+};
+
+// Owning handle for a heap payload in a message
+// The receiver takes the payload out with open(). If an envelope is destroyed (or overwritten) before that, e.g. because a
+// mailbox was drained at shutdown, the payload is freed and counted in get_payload_counters<T>().dropped.
+template <typename T>
+class Envelope {
+private:
+	std::unique_ptr<T> payload;
+
+	inline void drop() {
+		if (payload) {
+			get_payload_counters<T>().dropped++;
+			payload = nullptr;
+		}
+	}
+
+public:
+	Envelope() = default;
+	explicit Envelope(std::unique_ptr<T> payload_) : payload(std::move(payload_)) {}
+
+	Envelope(const Envelope&) = delete;
+	Envelope& operator=(const Envelope&) = delete;
+
+	Envelope(Envelope&& other) noexcept = default;
+	Envelope& operator=(Envelope&& other) noexcept {
+		if (this != &other) {
+			drop();
+			payload = std::move(other.payload);
+		}
+		return *this;
+	}
+
+	~Envelope() {
+		drop();
+	}
+
+	// take the payload out (leaving us empty)
+	inline std::unique_ptr<T> open() {
+		return std::move(payload);
+	}
+
+	inline explicit operator bool() const {
+		return payload != nullptr;
+	}
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+// Which pairs of a mini's 6 faces are connected through non-opaque blocks, i.e. whether you might see in through one face
+// and out through the other (see gen_face_connections)
+// Faces are numbered like face_to_idx: axis * 2, +1 for the negative side (0 = +x, 1 = -x, 2 = +y, 3 = -y, 4 = +z, 5 = -z).
+struct FaceConnections {
+	uint64_t bits = 0; // bit (a * 6 + b) set if a and b are connected (both ways round)
+
+	// every pair of different faces
+	static constexpr FaceConnections all() {
+		FaceConnections result;
+		for (int a = 0; a < 6; a++) {
+			for (int b = 0; b < 6; b++) {
+				if (a != b) {
+					result.connect(a, b);
+				}
+			}
+		}
+		return result;
+	}
+
+	static constexpr FaceConnections none() {
+		return { 0 };
+	}
+
+	constexpr void connect(const int a, const int b) {
+		bits |= (uint64_t(1) << (a * 6 + b)) | (uint64_t(1) << (b * 6 + a));
+	}
+
+	constexpr bool connected(const int a, const int b) const {
+		return (bits >> (a * 6 + b)) & 1;
+	}
+
+	inline bool operator==(const FaceConnections& other) const {
+		return bits == other.bits;
+	}
+};
+
+// face on the other side of the mini (and which face of our neighbor `face` touches)
+inline int opposite_face(const int face) {
+	return face ^ 1;
+}
@@ -0,0 +1,133 @@
+#include "free_list_allocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+FreeListAllocator::FreeListAllocator(const size_t capacity) {
+	grow(capacity);
+}
+
+// best fit
+size_t FreeListAllocator::allocate(const size_t size) {
+	assert(size > 0 && "can't allocate nothing");
+
+	const auto fit = free_by_size.lower_bound({ size, 0 });
+	if (fit == free_by_size.end()) {
+		return NONE;
+	}
+
+	const auto [free_size, offset] = *fit;
+	remove_free(free_by_offset.find(offset));
+
+	// give back whatever we don't need
+	if (free_size > size) {
+		add_free(offset + size, free_size - size);
+	}
+
+	total_used += size;
+	num_allocations++;
+	return offset;
+}
+
+// free range, merging it with free neighbors
+void FreeListAllocator::free(size_t offset, size_t size) {
+	assert(offset + size <= total_capacity && "freeing outside of allocator");
+	assert(total_used >= size && num_allocations > 0 && "freeing more than was allocated");
+	total_used -= size;
+	num_allocations--;
+
+	// merge with next
+	auto next = free_by_offset.lower_bound(offset);
+	assert((next == free_by_offset.end() || next->first >= offset + size) && "double free");
+	if (next != free_by_offset.end() && next->first == offset + size) {
+		size += next->second;
+		remove_free(next);
+	}
+
+	// merge with previous
+	auto prev = free_by_offset.lower_bound(offset);
+	if (prev != free_by_offset.begin()) {
+		prev--;
+		assert(prev->first + prev->second <= offset && "double free");
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			remove_free(prev);
+		}
+	}
+
+	add_free(offset, size);
+}
+
+void FreeListAllocator::grow(const size_t new_capacity) {
+	assert(new_capacity >= total_capacity && "can't shrink");
+	if (new_capacity == total_capacity) {
+		return;
+	}
+
+	// (allocate/free bookkeeping is the same as freeing a range that was never handed out)
+	const size_t old_capacity = total_capacity;
+	total_capacity = new_capacity;
+	total_used += new_capacity - old_capacity;
+	num_allocations++;
+	free(old_capacity, new_capacity - old_capacity);
+}
+
+// pack live ranges to the front
+void FreeListAllocator::compact(const std::vector<Block*>& live) {
+	assert(live.size() == num_allocations && "compact() needs every allocated range");
+
+	std::vector<Block*> sorted = live;
+	std::sort(sorted.begin(), sorted.end(), [](const Block* a, const Block* b) { return a->offset < b->offset; });
+
+	size_t next_offset = 0;
+	for (Block* block : sorted) {
+		assert(block->offset >= next_offset && "overlapping ranges");
+		if (block->offset != next_offset) {
+			total_moved += block->size;
+			block->offset = next_offset;
+		}
+		next_offset += block->size;
+	}
+	assert(next_offset == total_used && "compact() needs every allocated range");
+
+	free_by_offset.clear();
+	free_by_size.clear();
+	if (next_offset < total_capacity) {
+		add_free(next_offset, total_capacity - next_offset);
+	}
+	num_compactions++;
+}
+
+float FreeListAllocator::fragmentation() const {
+	const size_t total_free = total_capacity - total_used;
+	if (total_free == 0) {
+		return 0.0f;
+	}
+
+	const size_t largest = free_by_size.rbegin()->first;
+	return 1.0f - static_cast<float>(largest) / total_free;
+}
+
+FreeListAllocator::Stats FreeListAllocator::get_stats() const {
+	Stats result;
+	result.capacity = total_capacity;
+	result.used = total_used;
+	result.num_allocations = num_allocations;
+	result.num_free_ranges = free_by_offset.size();
+	result.largest_free_range = free_by_size.empty() ? 0 : free_by_size.rbegin()->first;
+	result.num_compactions = num_compactions;
+	result.total_moved = total_moved;
+	return result;
+}
+
+void FreeListAllocator::add_free(const size_t offset, const size_t size) {
+	free_by_offset[offset] = size;
+	free_by_size.insert({ size, offset });
+}
+
+void FreeListAllocator::remove_free(const std::map<size_t, size_t>::iterator it) {
+	free_by_size.erase({ it->second, it->first });
+	free_by_offset.erase(it);
+}
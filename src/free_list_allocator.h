@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+// Sub-allocates ranges of [0, capacity) (in whatever units the caller likes), e.g. for packing many meshes into one GL buffer
+// Doesn't touch any memory itself -- it just hands out offsets, so it can be used (and tested) without a GL context.
+//   allocate: best fit (smallest free range that's big enough), O(log n)
+//   free: merges with neighboring free ranges, O(log n)
+// Freed ranges leave holes, so over time free space can be split into lots of small ranges (see fragmentation()).
+// compact() packs live ranges to the front, leaving one big free range at the end; the caller moves the data.
+class FreeListAllocator
+{
+public:
+	static constexpr size_t NONE = SIZE_MAX;
+
+	// an allocated range
+	struct Block {
+		size_t offset;
+		size_t size;
+	};
+
+	struct Stats {
+		size_t capacity = 0;
+		size_t used = 0;
+		size_t num_allocations = 0;
+		size_t num_free_ranges = 0;
+		size_t largest_free_range = 0;
+		size_t num_compactions = 0;
+		size_t total_moved = 0; // how much compaction has moved, all-time
+	};
+
+	FreeListAllocator(const size_t capacity = 0);
+
+	// offset of a free range of `size`, or NONE if no free range is that big (even if there's that much free space in total)
+	size_t allocate(const size_t size);
+
+	// free range allocated with allocate()
+	void free(const size_t offset, const size_t size);
+
+	// add [capacity, new_capacity) to the free space
+	void grow(const size_t new_capacity);
+
+	// pack `live` (every allocated range) to the front, keeping their order, and updating their offsets
+	// afterwards, all free space is in one range at the end
+	void compact(const std::vector<Block*>& live);
+
+	inline size_t capacity() const {
+		return total_capacity;
+	}
+
+	inline size_t used() const {
+		return total_used;
+	}
+
+	// how badly free space is split up: 0 = it's all in one range, close to 1 = it's in lots of small ones
+	// (1 - largest free range / total free space)
+	float fragmentation() const;
+
+	Stats get_stats() const;
+
+private:
+	size_t total_capacity = 0;
+	size_t total_used = 0;
+	size_t num_allocations = 0;
+	size_t num_compactions = 0;
+	size_t total_moved = 0;
+
+	// free ranges, both (offset -> size) for merging neighbors, and (size, offset) for best fit
+	std::map<size_t, size_t> free_by_offset;
+	std::set<std::pair<size_t, size_t>> free_by_size;
+
+	void add_free(const size_t offset, const size_t size);
+	void remove_free(const std::map<size_t, size_t>::iterator it);
+};
@@ -14,7 +14,6 @@
 #include "examples/imgui_impl_opengl3.h"
 #include "examples/imgui_impl_glfw.h"
 #include "imgui.h"
-#include "zmq_addon.hpp"
 
 #include <algorithm>
 #include <cassert>
@@ -28,22 +27,16 @@
 using namespace std;
 using namespace vmath;
 
-Game::Game(std::shared_ptr<zmq::context_t> ctx_, std::shared_ptr<GLFWwindow> window_, std::shared_ptr<GlfwInfo> windowInfo_, std::shared_ptr<OpenGLInfo> glInfo_)
-	: ctx(ctx_), bus(ctx_), window(window_), windowInfo(windowInfo_), glInfo(glInfo_)
+Game::Game(std::shared_ptr<GLFWwindow> window_, std::shared_ptr<GlfwInfo> windowInfo_, std::shared_ptr<OpenGLInfo> glInfo_)
+	: window(window_), windowInfo(windowInfo_), glInfo(glInfo_)
 {
 	std::fill(held_keys.begin(), held_keys.end(), false);
-	bus.out.setsockopt(ZMQ_SUBSCRIBE, "", 0);
 }
 
 Game::~Game()
 {
 	// Send exit message
-	std::vector<zmq::const_buffer> message({
-		zmq::buffer(msg::EXIT)
-		});
-
-	auto ret = zmq::send_multipart(bus.in, message, zmq::send_flags::dontwait);
-	assert(ret);
+	msg::send_exit();
 }
 
 void Game::startup()
@@ -52,8 +45,8 @@ void Game::startup()
 
 	// set vars
 	std::fill(held_keys.begin(), held_keys.end(), false);
-	world = std::make_unique<World>(ctx);
-	world_render = std::make_unique<WorldRenderPart>(ctx);
+	world = std::make_unique<World>();
+	world_render = std::make_unique<WorldRenderPart>();
 	glfwGetCursorPos(window.get(), &last_mouse_x, &last_mouse_y); // reset mouse position
 
 	running = true;
@@ -169,7 +162,8 @@ void Game::render(float time)
 
 	// Draw ALL our chunks!
 	world_render->handle_messages();
-	world_render->render(glInfo.get(), windowInfo.get(), planes, get_player().staring_at);
+	const vec3 camera_pos = { get_player().coords[0], get_player().coords[1] + CAMERA_HEIGHT, get_player().coords[2] };
+	world_render->render(glInfo.get(), windowInfo.get(), camera_pos, planes, get_player().staring_at);
 
 	// get polygon mode
 	GLint polygon_mode;
@@ -231,6 +225,50 @@ void Game::render_debug_info(float dt)
 	sprintf(lineBuf, "Held block: %d (%s)\n", static_cast<int>(get_player().held_block), get_player().held_block.side_texture().c_str());
 	debugInfo += lineBuf;
 
+	// request latencies: recent average / recent max (see LATENCY_MAX_WINDOW), in ms
+	const RequestLatency& edit_meshes = world_render->get_mesh_latency(RequestClass::Interactive);
+	const RequestLatency& water_meshes = world_render->get_mesh_latency(RequestClass::Water);
+	const RequestLatency& terrain_meshes = world_render->get_mesh_latency(RequestClass::Background);
+	sprintf(lineBuf, "Mesh latency (ms): edit %.1f/%.1f, water %.1f/%.1f, terrain %.1f/%.1f\n",
+		edit_meshes.recent_ms, edit_meshes.recent_max_ms(), water_meshes.recent_ms, water_meshes.recent_max_ms(), terrain_meshes.recent_ms, terrain_meshes.recent_max_ms());
+	debugInfo += lineBuf;
+
+	const RequestLatency& near_chunks = world->data.get_chunk_latency(RequestClass::Interactive);
+	const RequestLatency& far_chunks = world->data.get_chunk_latency(RequestClass::Background);
+	sprintf(lineBuf, "Chunk latency (ms): near %.1f/%.1f, far %.1f/%.1f\n", near_chunks.recent_ms, near_chunks.recent_max_ms(), far_chunks.recent_ms, far_chunks.recent_max_ms());
+	debugInfo += lineBuf;
+
+	// work done vs dropped because the player moved away first
+	const WorkCounters& mesh_work = get_mesh_work_counters();
+	const WorkCounters& chunk_work = get_chunk_work_counters();
+	sprintf(lineBuf, "Meshes: %d done, %d cancelled / Chunks: %d done, %d cancelled\n",
+		mesh_work.completed.load(), mesh_work.cancelled.load(), chunk_work.completed.load(), chunk_work.cancelled.load());
+	debugInfo += lineBuf;
+
+	// payloads alive anywhere in the pipeline (queued, being worked on, or in a message)
+	sprintf(lineBuf, "Live: %d mesh reqs, %d meshes, %d chunk reqs, %d chunks\n",
+		get_payload_counters<MeshGenRequest>().live.load(), get_payload_counters<MeshGenResult>().live.load(),
+		get_payload_counters<ChunkGenRequest>().live.load(), get_payload_counters<ChunkGenResponse>().live.load());
+	debugInfo += lineBuf;
+
+	// mesh arena: quads used / capacity (in thousands), how split up its free space is, and how often it's been rebuilt
+	const FreeListAllocator::Stats arena = world_render->get_mesh_arena().get_stats();
+	sprintf(lineBuf, "Mesh arena: %zuk/%zuk quads, %zu free ranges (%.0f%% fragmented), %d rebuilds\n",
+		arena.used / 1000, arena.capacity / 1000, arena.num_free_ranges, world_render->get_mesh_arena().fragmentation() * 100.0f, world_render->get_mesh_arena().get_num_rebuilds());
+	debugInfo += lineBuf;
+
+	// frustum culling: chunk columns in view / loaded, then minis
+	const MiniCuller& culler = world_render->get_culler();
+	sprintf(lineBuf, "Culling: %zu/%zu columns, %zu minis loaded, %zu reachable past caves\n",
+		culler.num_visible_columns(), culler.num_columns(), culler.num_minis(), world_render->get_visibility().num_visible());
+	debugInfo += lineBuf;
+
+	// draws submitted last frame (one glMultiDrawArraysIndirect each for terrain and water)
+	sprintf(lineBuf, "Draws: %zu terrain (%zuk quads), %zu water (%zuk quads)\n",
+		world_render->get_terrain_draws().size(), world_render->get_terrain_draws().num_vertices() / 1000,
+		world_render->get_water_draws().size(), world_render->get_water_draws().num_vertices() / 1000);
+	debugInfo += lineBuf;
+
 	// Show debug info
 	const float DISTANCE = 10.0f;
 	static int corner = 0;
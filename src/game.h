@@ -13,7 +13,6 @@
 #include "GL/gl3w.h"
 #include "GLFW/glfw3.h"
 #include "vmath.h"
-#include "zmq.hpp"
 
 #include <cassert>
 #include <memory>
@@ -22,17 +21,11 @@
 #include <unordered_map>
 #include <utility>
 
-constexpr int NUM_MESH_GEN_THREADS = 1;
-
-void run_game(std::shared_ptr<zmq::context_t> ctx);
+void run_game();
 
 class Game {
 public:
-	// zmq
-	std::shared_ptr<zmq::context_t> ctx;
-	BusNode bus;
-
-	Game(std::shared_ptr<zmq::context_t> ctx_, std::shared_ptr<GLFWwindow> window_, std::shared_ptr<GlfwInfo> windowInfo_, std::shared_ptr<OpenGLInfo> glInfo_);
+	Game(std::shared_ptr<GLFWwindow> window_, std::shared_ptr<GlfwInfo> windowInfo_, std::shared_ptr<OpenGLInfo> glInfo_);
 	~Game();
 
 	/* INPUTS */
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Min-heap of (key, priority, value), with at most one entry per key
+// Keeps an index of where each key is in the heap, so besides push/pop it can look up, re-prioritize or remove any key:
+//   contains/find: O(1)
+//   push/pop/update/erase: O(log n)
+//   reprioritize/erase_if (all of them at once): O(n)
+// D-ary (D children per node) -- a wider, shallower tree means fewer cache misses per sift than a binary heap.
+template <typename Key, typename Value, typename Hash = std::hash<Key>, int D = 4>
+class IndexedHeap
+{
+public:
+	struct Entry {
+		Key key;
+		int priority;
+		Value value;
+	};
+
+private:
+	std::vector<Entry> heap;
+	std::unordered_map<Key, size_t, Hash> index; // key -> position in heap
+
+	static inline size_t parent(const size_t i) {
+		return (i - 1) / D;
+	}
+
+	static inline size_t first_child(const size_t i) {
+		return D * i + 1;
+	}
+
+	// put `entry` at heap[i], updating the index
+	inline void place(const size_t i, Entry&& entry) {
+		index[entry.key] = i;
+		heap[i] = std::move(entry);
+	}
+
+	// move heap[i] up until its parent's priority is <= its own
+	void sift_up(size_t i) {
+		Entry entry = std::move(heap[i]);
+		while (i > 0 && entry.priority < heap[parent(i)].priority) {
+			place(i, std::move(heap[parent(i)]));
+			i = parent(i);
+		}
+		place(i, std::move(entry));
+	}
+
+	// move heap[i] down until its children's priorities are >= its own
+	void sift_down(size_t i) {
+		Entry entry = std::move(heap[i]);
+		while (true) {
+			const size_t begin = first_child(i);
+			if (begin >= heap.size()) {
+				break;
+			}
+
+			// smallest child
+			const size_t end = std::min(begin + D, heap.size());
+			size_t child = begin;
+			for (size_t c = begin + 1; c < end; c++) {
+				if (heap[c].priority < heap[child].priority) {
+					child = c;
+				}
+			}
+
+			if (heap[child].priority >= entry.priority) {
+				break;
+			}
+
+			place(i, std::move(heap[child]));
+			i = child;
+		}
+		place(i, std::move(entry));
+	}
+
+	// restore heap order everywhere, bottom up (starting from the last node with children)
+	void heapify() {
+		if (heap.size() > 1) {
+			for (size_t i = parent(heap.size() - 1) + 1; i-- > 0;) {
+				sift_down(i);
+			}
+		}
+	}
+
+	// remove heap[i]
+	Entry remove_at(const size_t i) {
+		Entry result = std::move(heap[i]);
+		index.erase(result.key);
+
+		// fill the gap with the last entry, then fix it up
+		if (i != heap.size() - 1) {
+			heap[i] = std::move(heap.back());
+			heap.pop_back();
+			index[heap[i].key] = i;
+			if (i > 0 && heap[i].priority < heap[parent(i)].priority) {
+				sift_up(i);
+			}
+			else {
+				sift_down(i);
+			}
+		}
+		else {
+			heap.pop_back();
+		}
+
+		return result;
+	}
+
+public:
+	inline size_t size() const {
+		return heap.size();
+	}
+
+	inline bool empty() const {
+		return heap.empty();
+	}
+
+	inline bool contains(const Key& key) const {
+		return index.contains(key);
+	}
+
+	// entry with the lowest priority
+	inline const Entry& top() const {
+		assert(!heap.empty() && "heap is empty");
+		return heap[0];
+	}
+
+	// value for `key`, or nullptr
+	Value* find(const Key& key) {
+		const auto search = index.find(key);
+		return search == index.end() ? nullptr : &heap[search->second].value;
+	}
+
+	// add `key` (which mustn't be in here already)
+	void push(const Key& key, const int priority, Value value) {
+		assert(!contains(key) && "key is already in heap");
+		heap.push_back({ key, priority, std::move(value) });
+		index[key] = heap.size() - 1;
+		sift_up(heap.size() - 1);
+	}
+
+	// change `key`'s priority
+	// returns false if it isn't in here
+	bool update(const Key& key, const int priority) {
+		const auto search = index.find(key);
+		if (search == index.end()) {
+			return false;
+		}
+
+		const size_t i = search->second;
+		const int old_priority = heap[i].priority;
+		heap[i].priority = priority;
+		if (priority < old_priority) {
+			sift_up(i);
+		}
+		else if (priority > old_priority) {
+			sift_down(i);
+		}
+		return true;
+	}
+
+	// remove and return entry with the lowest priority
+	Entry pop() {
+		assert(!heap.empty() && "heap is empty");
+		return remove_at(0);
+	}
+
+	// remove `key`, moving its value into `value` (if not nullptr)
+	// returns false if it isn't in here
+	bool erase(const Key& key, Value* value = nullptr) {
+		const auto search = index.find(key);
+		if (search == index.end()) {
+			return false;
+		}
+
+		Entry entry = remove_at(search->second);
+		if (value) {
+			*value = std::move(entry.value);
+		}
+		return true;
+	}
+
+	// remove every entry for which `pred(entry)` is true, then rebuild the heap in one go
+	// returns how many were removed
+	template <typename Pred>
+	size_t erase_if(Pred pred) {
+		size_t kept = 0;
+		for (size_t i = 0; i < heap.size(); i++) {
+			if (pred(static_cast<const Entry&>(heap[i]))) {
+				index.erase(heap[i].key);
+			}
+			else {
+				if (kept != i) {
+					heap[kept] = std::move(heap[i]);
+				}
+				index[heap[kept].key] = kept;
+				kept++;
+			}
+		}
+
+		const size_t removed = heap.size() - kept;
+		heap.resize(kept);
+		heapify();
+		return removed;
+	}
+
+	// recompute every priority with `priority_of(key)`, then rebuild the heap in one go
+	template <typename F>
+	void reprioritize(F priority_of) {
+		for (auto& entry : heap) {
+			entry.priority = priority_of(entry.key);
+		}
+
+		heapify();
+	}
+};
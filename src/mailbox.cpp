@@ -0,0 +1,9 @@
+#include "mailbox.h"
+
+#include <windows.h>
+
+
+// log that a mailbox is full and its sender has to wait
+void warn_mailbox_full() {
+	OutputDebugString("Warn: Mailbox full, waiting for consumer.\n");
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// log that a mailbox is full and its sender has to wait
+// out of line, so <windows.h> stays out of this header (every thread's code includes it)
+void warn_mailbox_full();
+
+// Bounded multi-producer, single-consumer message queue
+// Any thread can push, only the owning thread pops. Messages are moved in and out, so they can be move-only (e.g. unique_ptr).
+// It's a ring of cells, each with a sequence number saying whose turn it is (producer/consumer), so there are no locks:
+//   push: claim a slot by bumping `tail` (CAS), fill it, then publish it by bumping its sequence number
+//   pop:  if the slot at `head` is published, take it and hand the slot back to producers (one lap later)
+// A consumer with nothing to do can sleep in wait(); producers only pay for waking it up if it's actually asleep.
+template <typename T>
+class Mailbox
+{
+private:
+	struct Cell {
+		std::atomic<size_t> seq;
+		T value;
+	};
+
+	const size_t mask;
+	std::unique_ptr<Cell[]> cells;
+
+	// producers' and consumer's positions, on separate cache lines so they don't bounce between cores
+	alignas(64) std::atomic<size_t> tail = 0;
+	alignas(64) size_t head = 0; // only touched by consumer
+
+	// wakeup: consumer sets `sleeping` then waits on `wakeups`, producers bump `wakeups` if it's set
+	alignas(64) std::atomic<bool> sleeping = false;
+	std::atomic<uint32_t> wakeups = 0;
+
+	// whether there's anything published at head (consumer only)
+	inline bool empty() const {
+		return cells[head & mask].seq.load(std::memory_order_acquire) != head + 1;
+	}
+
+public:
+	// capacity must be a power of 2
+	Mailbox(const size_t capacity) : mask(capacity - 1), cells(std::make_unique<Cell[]>(capacity)) {
+		assert(capacity >= 2 && (capacity & (capacity - 1)) == 0 && "mailbox capacity must be a power of 2");
+		for (size_t i = 0; i < capacity; i++) {
+			cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	Mailbox(const Mailbox&) = delete;
+	Mailbox& operator=(const Mailbox&) = delete;
+
+	// add message, without blocking
+	// returns false if it's full (leaving `value` alone)
+	bool try_push(T&& value) {
+		size_t pos = tail.load(std::memory_order_relaxed);
+		Cell* cell;
+		while (true) {
+			cell = &cells[pos & mask];
+			const size_t seq = cell->seq.load(std::memory_order_acquire);
+			const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+
+			// our turn => claim it
+			if (diff == 0) {
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			// consumer hasn't taken the message from a lap ago yet => full
+			else if (diff < 0) {
+				return false;
+			}
+			// another producer claimed it first => try the next one
+			else {
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->value = std::move(value);
+		cell->seq.store(pos + 1, std::memory_order_release);
+
+		// wake up consumer if it's asleep (fence pairs with the one in wait())
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load()) {
+			wakeups.fetch_add(1);
+			wakeups.notify_one();
+		}
+
+		return true;
+	}
+
+	// add message, yielding until there's room if it's full
+	void push(T value) {
+		if (try_push(std::move(value))) {
+			return;
+		}
+
+		warn_mailbox_full();
+		while (!try_push(std::move(value))) {
+			std::this_thread::yield();
+		}
+	}
+
+	// take next message, without blocking (consumer only)
+	// returns false if there are none
+	bool try_pop(T& result) {
+		Cell& cell = cells[head & mask];
+		if (cell.seq.load(std::memory_order_acquire) != head + 1) {
+			return false;
+		}
+
+		result = std::move(cell.value);
+		cell.value = T();
+		cell.seq.store(head + mask + 1, std::memory_order_release);
+		head++;
+		return true;
+	}
+
+	// sleep until there's a message to pop (consumer only)
+	void wait() {
+		while (empty()) {
+			const uint32_t seen = wakeups.load();
+			sleeping.store(true);
+
+			// fence pairs with the one in try_push, so either it sees we're asleep or we see its message
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (empty()) {
+				wakeups.wait(seen);
+			}
+			sleeping.store(false);
+		}
+	}
+};
@@ -0,0 +1,178 @@
+#include "mesh_arena.h"
+
+#include "render.h"
+
+#include "vmath.h"
+
+#include <algorithm>
+#include <cassert>
+#include <tuple>
+#include <vector>
+
+// quad buffer's size when it's first created (8MB)
+constexpr size_t MESH_ARENA_INITIAL_CAPACITY = 1 << 20;
+
+// coords buffer's size when it's first created (in minis)
+constexpr GLuint MESH_ARENA_INITIAL_COORDS_CAPACITY = 1024;
+
+
+MeshArena::MeshArena()
+{
+}
+
+MeshArena::~MeshArena()
+{
+	glDeleteBuffers(1, &quad_buf);
+	glDeleteBuffers(1, &coords_buf);
+}
+
+// reserve room for `size` quads
+MeshArena::Handle MeshArena::allocate(const GLuint size, const vmath::ivec3& coords) {
+	assert(size > 0 && "can't allocate an empty mesh");
+
+	size_t offset = allocator.allocate(size);
+
+	// no free range is big enough => rebuild, compacting it, and growing it too if it'd still be more than 3/4 full
+	if (offset == FreeListAllocator::NONE) {
+		const size_t needed = allocator.used() + size;
+		size_t new_capacity = std::max(allocator.capacity(), MESH_ARENA_INITIAL_CAPACITY);
+		while (new_capacity < needed + needed / 3) {
+			new_capacity *= 2;
+		}
+
+		rebuild(new_capacity);
+		offset = allocator.allocate(size);
+		assert(offset != FreeListAllocator::NONE && "mesh arena rebuild didn't make room");
+	}
+
+	// pick a handle (which is also our coords slot)
+	Handle handle;
+	if (!free_handles.empty()) {
+		handle = free_handles.back();
+		free_handles.pop_back();
+	}
+	else {
+		handle = static_cast<Handle>(records.size());
+		records.push_back({});
+		reserve_coords();
+	}
+
+	records[handle] = { { offset, size }, coords, true };
+	glNamedBufferSubData(coords_buf, sizeof(vmath::ivec3) * handle, sizeof(vmath::ivec3), coords);
+
+	return handle;
+}
+
+// give handle's room back
+void MeshArena::release(Handle& handle) {
+	if (handle == NO_HANDLE) {
+		return;
+	}
+
+	Record& record = records[handle];
+	assert(record.live && "mesh arena handle released twice");
+	allocator.free(record.block.offset, record.block.size);
+	record.live = false;
+	free_handles.push_back(handle);
+
+	handle = NO_HANDLE;
+}
+
+// upload quads to handle's range
+void MeshArena::upload(const Handle handle, const GLuint first, const GLuint count, const PackedQuad* quads) {
+	const Record& record = records[handle];
+	assert(record.live && first + count <= record.block.size && "upload outside of mesh arena range");
+
+	glNamedBufferSubData(quad_buf, sizeof(PackedQuad) * (record.block.offset + first), sizeof(PackedQuad) * count, quads);
+}
+
+// point vao_quad at our buffers and bind it
+void MeshArena::bind(const OpenGLInfo* glInfo) {
+	bound_to = glInfo;
+	glVertexArrayVertexBuffer(glInfo->vao_quad, glInfo->quad_data_bidx, quad_buf, 0, sizeof(PackedQuad));
+	glVertexArrayVertexBuffer(glInfo->vao_quad, glInfo->q_base_coords_bidx, coords_buf, 0, sizeof(vmath::ivec3));
+	glBindVertexArray(glInfo->vao_quad);
+}
+
+// add a draw of some of handle's quads
+void MeshArena::add_draw(DrawCommandList& commands, const Handle handle, const GLuint first, const GLuint count) const {
+	const Record& record = records[handle];
+	assert(record.live && first + count <= record.block.size && "draw outside of mesh arena range");
+
+	// base instance picks our coords slot (base coords have divisor 1)
+	commands.add(static_cast<uint32_t>(record.block.offset + first), count, handle);
+}
+
+// replace quad buffer, compacting it
+void MeshArena::rebuild(const size_t new_capacity) {
+	// where live ranges are now, so we know where to copy from after compacting
+	std::vector<FreeListAllocator::Block*> live;
+	std::vector<size_t> old_offsets;
+	for (Record& record : records) {
+		if (record.live) {
+			live.push_back(&record.block);
+			old_offsets.push_back(record.block.offset);
+		}
+	}
+
+	allocator.grow(new_capacity);
+	allocator.compact(live);
+
+	// (old offset, new offset, size), merging ranges that stay next to each other, so we copy as few times as possible
+	std::vector<std::tuple<size_t, size_t, size_t>> copies;
+	for (size_t i = 0; i < live.size(); i++) {
+		copies.push_back({ old_offsets[i], live[i]->offset, live[i]->size });
+	}
+	std::sort(copies.begin(), copies.end());
+
+	std::vector<std::tuple<size_t, size_t, size_t>> merged;
+	for (const auto& [old_offset, new_offset, size] : copies) {
+		if (!merged.empty()) {
+			auto& [last_old, last_new, last_size] = merged.back();
+			if (last_old + last_size == old_offset && last_new + last_size == new_offset) {
+				last_size += size;
+				continue;
+			}
+		}
+		merged.push_back({ old_offset, new_offset, size });
+	}
+
+	GLuint new_buf;
+	glCreateBuffers(1, &new_buf);
+	glNamedBufferStorage(new_buf, sizeof(PackedQuad) * new_capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+
+	for (const auto& [old_offset, new_offset, size] : merged) {
+		glCopyNamedBufferSubData(quad_buf, new_buf, sizeof(PackedQuad) * old_offset, sizeof(PackedQuad) * new_offset, sizeof(PackedQuad) * size);
+	}
+
+	glDeleteBuffers(1, &quad_buf);
+	quad_buf = new_buf;
+	num_rebuilds++;
+
+	// we might be mid-draw
+	if (bound_to != nullptr) {
+		glVertexArrayVertexBuffer(bound_to->vao_quad, bound_to->quad_data_bidx, quad_buf, 0, sizeof(PackedQuad));
+	}
+}
+
+// make sure coords buffer has a slot for every handle
+void MeshArena::reserve_coords() {
+	if (records.size() <= coords_capacity) {
+		return;
+	}
+
+	coords_capacity = std::max(coords_capacity * 2, MESH_ARENA_INITIAL_COORDS_CAPACITY);
+
+	std::vector<vmath::ivec3> coords(coords_capacity, { 0, 0, 0 });
+	for (size_t i = 0; i < records.size(); i++) {
+		coords[i] = records[i].coords;
+	}
+
+	glDeleteBuffers(1, &coords_buf);
+	glCreateBuffers(1, &coords_buf);
+	glNamedBufferStorage(coords_buf, sizeof(vmath::ivec3) * coords_capacity, coords.data(), GL_DYNAMIC_STORAGE_BIT);
+
+	if (bound_to != nullptr) {
+		glVertexArrayVertexBuffer(bound_to->vao_quad, bound_to->q_base_coords_bidx, coords_buf, 0, sizeof(vmath::ivec3));
+	}
+}
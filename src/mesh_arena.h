@@ -0,0 +1,80 @@
+#pragma once
+
+#include "draw_commands.h"
+#include "free_list_allocator.h"
+#include "render.h"
+
+#include "vmath.h"
+
+#include <vector>
+
+// One big GL buffer holding every mini's quads, so they can all be drawn with glInfo->vao_quad, in one multi-draw
+// Each mini gets a handle: a range of the quad buffer (handed out by a FreeListAllocator) plus a slot in a shared coords
+// buffer. Draws pick the slot with base instance, since base coords are a per-instance attribute.
+// When a range doesn't fit, the quad buffer is rebuilt: live ranges are copied over packed together (compacting it),
+// into a bigger buffer if we're actually short on space.
+// GL thread only.
+class MeshArena
+{
+public:
+	typedef int Handle;
+	static constexpr Handle NO_HANDLE = -1;
+
+	MeshArena();
+	~MeshArena();
+
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	// reserve room for `size` quads, for the mini at `coords`
+	Handle allocate(const GLuint size, const vmath::ivec3& coords);
+
+	// give handle's room back, and reset it to NO_HANDLE
+	void release(Handle& handle);
+
+	// upload `count` quads to handle's range, starting at `first` quads in
+	void upload(const Handle handle, const GLuint first, const GLuint count, const PackedQuad* quads);
+
+	// point glInfo->vao_quad at our buffers and bind it (again after anything else rebinds it, e.g. highlight_block)
+	void bind(const OpenGLInfo* glInfo);
+
+	// add a draw of `count` quads of handle's range, starting at `first` quads in
+	// only valid until the next allocate(), since that can move ranges around
+	void add_draw(DrawCommandList& commands, const Handle handle, const GLuint first, const GLuint count) const;
+
+	inline FreeListAllocator::Stats get_stats() const {
+		return allocator.get_stats();
+	}
+
+	inline float fragmentation() const {
+		return allocator.fragmentation();
+	}
+
+	// how many times the quad buffer was reallocated (see rebuild())
+	inline int get_num_rebuilds() const {
+		return num_rebuilds;
+	}
+
+private:
+	struct Record {
+		FreeListAllocator::Block block;
+		vmath::ivec3 coords;
+		bool live;
+	};
+
+	FreeListAllocator allocator; // in quads
+	std::vector<Record> records; // indexed by handle, which is also the coords slot
+	std::vector<Handle> free_handles;
+
+	GLuint quad_buf = 0;
+	GLuint coords_buf = 0;
+	GLuint coords_capacity = 0; // in slots
+	const OpenGLInfo* bound_to = nullptr; // whose vao_quad we last pointed at our buffers, so a rebuild can re-point it
+	int num_rebuilds = 0;
+
+	// replace quad buffer with one with room for `new_capacity` quads, copying live ranges over packed together
+	void rebuild(const size_t new_capacity);
+
+	// make sure coords buffer has a slot for every handle
+	void reserve_coords();
+};
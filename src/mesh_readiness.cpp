@@ -0,0 +1,65 @@
+#include "mesh_readiness.h"
+
+#include <cassert>
+
+
+// chunk at `coords` loaded at `tick`, with neighbors `present` already here
+bool MeshReadiness::add(const vmath::ivec2& coords, const uint8_t present, const int tick) {
+	if (present == 0xF) {
+		pending.erase(coords);
+		return true;
+	}
+
+	pending[coords] = { tick, present };
+	by_tick.push_back({ tick, coords });
+	return false;
+}
+
+// neighbor `neighbor_idx` of waiting chunk at `coords` arrived
+bool MeshReadiness::neighbor_loaded(const vmath::ivec2& coords, const int neighbor_idx) {
+	assert(0 <= neighbor_idx && neighbor_idx < 4 && "invalid neighbor");
+
+	const auto search = pending.find(coords);
+	if (search == pending.end()) {
+		return false;
+	}
+
+	search->second.present |= 1 << neighbor_idx;
+	if (search->second.present == 0xF) {
+		pending.erase(search);
+		return true;
+	}
+
+	return false;
+}
+
+bool MeshReadiness::is_waiting(const vmath::ivec2& coords) const {
+	return pending.contains(coords);
+}
+
+void MeshReadiness::remove(const vmath::ivec2& coords) {
+	pending.erase(coords);
+}
+
+// stop tracking chunks added at or before `tick`, and return them
+std::vector<vmath::ivec2> MeshReadiness::pop_added_before(const int tick) {
+	std::vector<vmath::ivec2> result;
+
+	while (!by_tick.empty() && by_tick.front().first <= tick) {
+		const auto [added_tick, coords] = by_tick.front();
+		by_tick.pop_front();
+
+		// skip it if it stopped waiting (or stopped, then started waiting again later)
+		const auto search = pending.find(coords);
+		if (search != pending.end() && search->second.since_tick == added_tick) {
+			pending.erase(search);
+			result.push_back(coords);
+		}
+	}
+
+	return result;
+}
+
+size_t MeshReadiness::size() const {
+	return pending.size();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "util.h"
+
+#include "vmath.h"
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// a chunk's 4 horizontal neighbors, in the order MeshReadiness's bitmasks use
+// opposite of neighbor i is neighbor (i ^ 1)
+static constexpr vmath::ivec2 CHUNK_NEIGHBORS[4] = {
+	vmath::ivec2(1, 0),
+	vmath::ivec2(-1, 0),
+	vmath::ivec2(0, 1),
+	vmath::ivec2(0, -1),
+};
+
+// Tracks loaded chunks that aren't meshed yet because they're waiting on their neighbors
+// Meshing a chunk before its 4 horizontal neighbors exist means meshing it again once they arrive, so we hold off until they
+// all have (or until a timeout, in case one never does).
+class MeshReadiness
+{
+private:
+	struct Pending {
+		int since_tick;
+		uint8_t present; // bit i => neighbor i (see CHUNK_NEIGHBORS) is here (or isn't coming)
+	};
+
+	std::unordered_map<vmath::ivec2, Pending, vecN_hash> pending;
+
+	// (tick, coords) in the order chunks were added, for finding ones that timed out
+	// entries for chunks that stopped waiting are skipped
+	std::deque<std::pair<int, vmath::ivec2>> by_tick;
+
+public:
+	// chunk at `coords` loaded at `tick`, with neighbors `present` already here
+	// returns whether it's ready to mesh (if not, it's tracked until it is)
+	bool add(const vmath::ivec2& coords, const uint8_t present, const int tick);
+
+	// neighbor `neighbor_idx` of waiting chunk at `coords` arrived
+	// returns whether that made it ready to mesh (if so, it's not tracked anymore)
+	bool neighbor_loaded(const vmath::ivec2& coords, const int neighbor_idx);
+
+	// whether chunk at `coords` is waiting
+	bool is_waiting(const vmath::ivec2& coords) const;
+
+	// stop tracking chunk at `coords` (e.g. it was unloaded)
+	void remove(const vmath::ivec2& coords);
+
+	// stop tracking chunks added at or before `tick`, and return them
+	std::vector<vmath::ivec2> pop_added_before(const int tick);
+
+	// number of waiting chunks
+	size_t size() const;
+};
@@ -1,9 +1,9 @@
 #include "mesher.h"
 
+#include "settings.h"
 #include "world_meshing.h"
 
-#include "zmq_addon.hpp"
-
+#include <algorithm>
 #include <cassert>
 
 
@@ -11,23 +11,15 @@ using namespace vmath;
 using namespace std;
 
 
-void MeshingThread2(std::shared_ptr<zmq::context_t> ctx, msg::on_ready_fn on_ready)
+void MeshingThread2(msg::on_ready_fn on_ready)
 {
-	Mesher m(ctx);
+	Mesher m(get_settings().num_mesh_gen_threads);
 	m.run(on_ready);
 }
 
-Mesher::Mesher(std::shared_ptr<zmq::context_t> ctx_) : ctx(ctx_), bus(ctx_), player_coords({ 0, 0 })
+Mesher::Mesher(const int num_workers_) : mailbox(msg::get_mailboxes().mesher), num_workers(num_workers_), player_coords({ 0, 0 })
 {
-#ifdef _DEBUG
-	bus.out.setsockopt(ZMQ_SUBSCRIBE, "", 0);
-#else
-	for (const auto& m : msg::meshing_thread_incoming)
-	{
-		// TODO: Upgrade cppzmq and replace this with .set()
-		bus.out.setsockopt(ZMQ_SUBSCRIBE, m.c_str(), m.size());
-	}
-#endif // _DEBUG
+	assert(num_workers > 0 && "need at least one mesh gen worker");
 }
 
 // thread for generating new chunk meshes
@@ -35,23 +27,40 @@ void Mesher::run(msg::on_ready_fn on_ready) {
 	// Prove you're connected
 	on_ready();
 
-	// Run thread until stopped
+	// Start workers
+	for (int i = 0; i < num_workers; i++)
+	{
+		workers.emplace_back(&Mesher::run_worker, this);
+	}
+
+	// Feed them requests until stopped
 	bool stop = false;
 	while (!stop)
 	{
-		// If no queued requests, wait for a message to come in
-		bool wait_for_first = pq.size() == 0;
-		handle_all_messages(wait_for_first, stop);
-		if (stop) break;
+		handle_all_messages(true, stop);
+	}
 
-		// Handle a queued request if exists
-		handle_queued_request();
+	// Stop workers (anything still queued is dropped)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stopping = true;
+	}
+	cv.notify_all();
+	for (auto& worker : workers)
+	{
+		worker.join();
 	}
 }
 
+void Mesher::run_worker()
+{
+	WorkerBatch batch;
+	while (handle_queued_request(batch));
+}
+
 void Mesher::handle_all_messages(bool wait_for_first, bool& stop)
 {
-	std::vector<zmq::message_t> msg;
+	msg::MesherMessage msg;
 	bool wait = wait_for_first;
 	while (read_msg(wait, msg))
 	{
@@ -61,98 +70,295 @@ void Mesher::handle_all_messages(bool wait_for_first, bool& stop)
 	}
 }
 
-void Mesher::on_msg(const std::vector<zmq::message_t>& msg, bool& stop)
+void Mesher::on_msg(msg::MesherMessage& msg, bool& stop)
 {
-	if (msg[0].to_string_view() == msg::EXIT)
+	if (std::holds_alternative<msg::Exit>(msg))
 	{
 		stop = true;
 	}
-	else if (msg[0].to_string_view() == msg::MESH_GEN_REQUEST)
+	else if (auto envelope = std::get_if<Envelope<MeshGenRequest>>(&msg))
 	{
 		// Enqueue any meshing requests
-		// TODO: Just enqueue coords, then later deal them to workers
-
-		MeshGenRequest* req_ = *(msg[1].data<MeshGenRequest*>());
-		assert(req_);
-		std::shared_ptr<MeshGenRequest> req(req_);
-		on_mesh_gen_request(req);
+		assert(*envelope);
+		on_mesh_gen_request(envelope->open());
 	}
-	else if (msg[0].to_string_view() == msg::EVENT_PLAYER_MOVED_CHUNKS)
+	else if (auto reqs = std::get_if<msg::MeshGenRequests>(&msg))
 	{
-		vmath::ivec2 new_coords = *(msg[1].data<vmath::ivec2>());
-		update_player_coords(new_coords);
+		on_mesh_gen_requests(*reqs);
 	}
-	else
+	else if (auto event = std::get_if<PlayerMovedChunksEvent>(&msg))
 	{
-#ifndef _DEBUG
-		WindowsException("unknown message");
-#endif // _DEBUG
+		update_player_coords(event->coords, event->render_distance);
 	}
 }
 
-bool Mesher::read_msg(bool wait, std::vector<zmq::message_t>& msg)
+bool Mesher::read_msg(bool wait, msg::MesherMessage& msg)
 {
-	msg.clear();
-	auto flags = wait ? zmq::recv_flags::none : zmq::recv_flags::dontwait;
-	auto ret = zmq::recv_multipart(bus.out, std::back_inserter(msg), flags);
-	return ret > 0;
+	if (wait)
+	{
+		mailbox.wait();
+	}
+	return mailbox.try_pop(msg);
 }
 
-bool Mesher::handle_queued_request()
+// wait for a queued request and handle it, adding its result to `batch` (and sending that once it's due)
+// returns false once we're stopping
+bool Mesher::handle_queued_request(WorkerBatch& batch)
 {
-	if (pq.size())
+	std::shared_ptr<MeshGenRequest> req;
+
+	// claim the next request
 	{
-		// handle one
-		vmath::ivec3 coords = pq.top().coords;
-		pq.pop();
-		auto search = reqs.find(coords);
-		assert(search != reqs.end());
-		std::shared_ptr<MeshGenRequest> req = search->second;
-		reqs.erase(search);
+		std::unique_lock<std::mutex> lock(mtx);
+		while (!stopping && (all_queues_empty() || !pop_request(req))) // (everything left might've been cancelled)
+		{
+			// out of work => send what we have before sleeping, so it doesn't sit here until more work shows up
+			if (!batch.results.empty())
+			{
+				lock.unlock();
+				send_results(batch);
+				lock.lock();
+				continue;
+			}
+
+			cv.wait(lock, [&] { return stopping || !all_queues_empty(); });
+		}
 
-		// generate a mesh if possible
-		MeshGenResult* mesh = gen_minichunk_mesh_from_req(req);
-		if (mesh != nullptr)
+		if (stopping)
 		{
-			// send it
-			std::vector<zmq::const_buffer> result({
-				zmq::buffer(msg::MESH_GEN_RESPONSE),
-				zmq::buffer(&mesh, sizeof(mesh))
-				});
-			auto ret = zmq::send_multipart(bus.in, result, zmq::send_flags::dontwait);
-			assert(ret);
+			return false;
 		}
+	}
+	const vmath::ivec3 coords = req->coords;
+
+	// generate a mesh if possible
+	MeshGenResult* mesh = gen_minichunk_mesh_from_req(req);
+	req = nullptr;
+	get_mesh_work_counters().completed++;
 
+	// nothing to send => done with coords
+	if (mesh == nullptr)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		release_coords(coords);
 		return true;
 	}
 
-	return false;
+	// add it to the batch
+	// coords stay in flight until it's sent, so no newer result for them can reach the render thread before ours
+	if (batch.results.empty())
+	{
+		batch.started = std::chrono::steady_clock::now();
+	}
+	const bool interactive = mesh->request_class == RequestClass::Interactive;
+	batch.results.emplace_back(std::unique_ptr<MeshGenResult>(mesh));
+	batch.coords.push_back(coords);
+
+	// newer requests for coords we're holding on to => don't keep them waiting
+	bool holding_up = false;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		holding_up = std::any_of(batch.coords.begin(), batch.coords.end(), [this](const vmath::ivec3& c) { return waiting_for_worker.contains(c); });
+	}
+
+	// send batch if it's due
+	if (batch.results.size() >= MESH_RESULT_BATCH_SIZE || interactive || holding_up || std::chrono::steady_clock::now() - batch.started >= MESH_RESULT_BATCH_MAX_WAIT)
+	{
+		send_results(batch);
+	}
+
+	return true;
+}
+
+// send a worker's batch of results to the render thread, then release their coords
+void Mesher::send_results(WorkerBatch& batch)
+{
+	if (batch.results.empty())
+	{
+		return;
+	}
+
+	// (not holding mtx, since this waits if the render thread's mailbox is full)
+	msg::get_mailboxes().render.push(std::move(batch.results));
+	batch.results = msg::MeshGenResults();
+	batch.results.reserve(MESH_RESULT_BATCH_SIZE);
+
+	// only now can the next request for any of them be meshed
+	std::lock_guard<std::mutex> lock(mtx);
+	for (const vmath::ivec3& coords : batch.coords)
+	{
+		release_coords(coords);
+	}
+	batch.coords.clear();
+}
+
+// done with coords: queue any request for them that came in while they were in flight (must hold mtx)
+void Mesher::release_coords(const vmath::ivec3& coords)
+{
+	in_flight.erase(coords);
+
+	auto search = waiting_for_worker.find(coords);
+	if (search != waiting_for_worker.end())
+	{
+		queues[static_cast<int>(search->second->request_class)].push(coords, priority(coords), search->second);
+		waiting_for_worker.erase(search);
+		cv.notify_one();
+	}
+}
+
+bool Mesher::all_queues_empty() const
+{
+	return std::all_of(std::begin(queues), std::end(queues), [](const auto& queue) { return queue.empty(); });
+}
+
+// take the next request off the queues and mark its coords in flight (must hold mtx)
+// returns false if there are none (left)
+bool Mesher::pop_request(std::shared_ptr<MeshGenRequest>& result)
+{
+	while (true)
+	{
+		bool waiting[NUM_REQUEST_CLASSES];
+		for (int i = 0; i < NUM_REQUEST_CLASSES; i++)
+		{
+			waiting[i] = !queues[i].empty();
+		}
+
+		const int request_class = pick_request_class(waiting, passed_over);
+		if (request_class < 0)
+		{
+			return false;
+		}
+
+		// front one might've been queued before the player moved, so drop it if it's too far now, and make sure its priority's up to date
+		auto& queue = queues[request_class];
+		while (!queue.empty())
+		{
+			const auto& top = queue.top();
+			if (too_far(top.key))
+			{
+				queue.pop();
+				get_mesh_work_counters().cancelled++;
+				continue;
+			}
+
+			const int new_priority = priority(top.key);
+			if (new_priority <= top.priority)
+			{
+				break;
+			}
+			queue.update(top.key, new_priority);
+		}
+
+		// all cancelled => pick again
+		if (queue.empty())
+		{
+			continue;
+		}
+
+		auto entry = queue.pop();
+		result = std::move(entry.value);
+		in_flight.insert(entry.key);
+		return true;
+	}
 }
 
 void Mesher::on_mesh_gen_request(std::shared_ptr<MeshGenRequest> req)
 {
-	vmath::ivec2 chunk_coords = { req->coords[0], req->coords[2] };
-	float priority = vmath::distance(chunk_coords, player_coords);
-	auto search = reqs.find(req->coords);
-	if (search != reqs.end())
+	std::lock_guard<std::mutex> lock(mtx);
+	queue_request(std::move(req));
+	cv.notify_one();
+}
+
+void Mesher::on_mesh_gen_requests(msg::MeshGenRequests& reqs)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	for (auto& envelope : reqs)
+	{
+		assert(envelope);
+		queue_request(envelope.open());
+	}
+	cv.notify_all();
+}
+
+void Mesher::queue_request(std::shared_ptr<MeshGenRequest> req)
+{
+	// find request already queued (or waiting on a worker) for these coords
+	std::shared_ptr<MeshGenRequest> old;
+	auto search = waiting_for_worker.find(req->coords);
+	if (search != waiting_for_worker.end())
 	{
-		search->second = req;
+		old = search->second;
+		waiting_for_worker.erase(search);
 	}
 	else
 	{
-		pq.emplace(priority, req->coords);
-		reqs[req->coords] = req;
+		for (auto& queue : queues)
+		{
+			if (queue.erase(req->coords, &old))
+			{
+				break;
+			}
+		}
+	}
+
+	// just mesh the newer one instead
+	// (its snapshot is newer, so it can remesh the older one's layers as well)
+	if (old)
+	{
+		req->layers |= old->layers;
+		req->request_class = std::min(req->request_class, old->request_class);
+		req->requested_at = std::min(req->requested_at, old->requested_at);
+	}
+
+	// if a worker's meshing these coords right now, it'll queue this when it's done
+	if (in_flight.contains(req->coords))
+	{
+		waiting_for_worker[req->coords] = req;
+	}
+	else
+	{
+		queues[static_cast<int>(req->request_class)].push(req->coords, priority(req->coords), req);
 	}
 }
 
-void Mesher::update_player_coords(const vmath::ivec2& new_coords)
+void Mesher::update_player_coords(const vmath::ivec2& new_coords, const int render_distance)
 {
-	if (new_coords != player_coords)
+	std::lock_guard<std::mutex> lock(mtx);
+	if (new_coords != player_coords || render_distance != this->render_distance)
 	{
+		// (+ 1, since priorities are rounded down)
+		priority_drift += static_cast<int>(vmath::distance(new_coords, player_coords)) + 1;
+
+		// first time we know render distance, or it shrunk => might be lots to drop right away
+		const bool fewer_wanted = this->render_distance < 0 || render_distance < this->render_distance;
 		player_coords = new_coords;
+		this->render_distance = render_distance;
 
-		// Adjust priority queue priorities:
-		std::function<void(pq_entry&)> adjust = [&](pq_entry& e) { e.priority = vmath::distance(vmath::ivec2(e.coords[0], e.coords[2]), player_coords); };
-		update_pq_priorities(pq, adjust);
+		// until they've drifted too far, queued priorities get fixed (and far ones dropped) as they reach the front (see pop_request)
+		if (priority_drift > MAX_QUEUE_PRIORITY_DRIFT || fewer_wanted)
+		{
+			priority_drift = 0;
+
+			// drop whatever's too far now
+			int num_cancelled = 0;
+			for (auto& queue : queues)
+			{
+				num_cancelled += queue.erase_if([&](const auto& entry) { return too_far(entry.key); });
+				queue.reprioritize([&](const vmath::ivec3& coords) { return priority(coords); });
+			}
+			num_cancelled += std::erase_if(waiting_for_worker, [&](const auto& kv) { return too_far(kv.first); });
+			get_mesh_work_counters().cancelled += num_cancelled;
+		}
 	}
 }
+
+int Mesher::priority(const vmath::ivec3& coords) const
+{
+	return static_cast<int>(vmath::distance(vmath::ivec2(coords[0], coords[2]), player_coords));
+}
+
+bool Mesher::too_far(const vmath::ivec3& coords) const
+{
+	// same test the world uses to drop the result (see WorldRenderPart::handle_messages)
+	return render_distance >= 0 && should_unload_chunk({ coords[0], coords[2] }, player_coords, render_distance);
+}
@@ -1,62 +1,106 @@
 #pragma once
 
+#include "indexed_heap.h"
 #include "messaging.h"
 #include "world_utils.h"
 
 #include "vmath.h"
-#include "zmq.hpp"
 
+#include <chrono>
+#include <condition_variable>
 #include <memory>
-#include <queue>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
-void MeshingThread2(std::shared_ptr<zmq::context_t> ctx, msg::on_ready_fn on_ready);
+// mesh gen results a worker collects before sending them off in one message
+// a batch is sent early if it's been waiting this long, if it has an interactive result, if a newer request for one of its
+// coords is waiting, or before the worker sleeps for lack of work
+constexpr int MESH_RESULT_BATCH_SIZE = 32;
+constexpr auto MESH_RESULT_BATCH_MAX_WAIT = std::chrono::milliseconds(4);
 
-struct pq_entry
-{
-	pq_entry(int priority_, const vmath::ivec3& coords_) : priority(priority_), coords(coords_)
-	{
-	}
-
-	friend bool operator<(const pq_entry& lhs, const pq_entry& rhs)
-	{
-		return lhs.priority < rhs.priority;
-	}
-
-	friend bool operator>(const pq_entry& lhs, const pq_entry& rhs)
-	{
-		return lhs.priority > rhs.priority;
-	}
-
-	int priority;
-	vmath::ivec3 coords;
-};
+void MeshingThread2(msg::on_ready_fn on_ready);
 
+// Mesh generation
+// One thread reads requests out of its mailbox into a shared pool, and num_workers worker threads mesh them.
+// Requests are served by class (see pick_request_class), and within a class closest to the player first.
+// Results are sent to the render thread in batches (see MESH_RESULT_BATCH_SIZE).
 class Mesher
 {
 public:
-	Mesher(std::shared_ptr<zmq::context_t> ctx_);
+	Mesher(const int num_workers_);
 	~Mesher() = default;
 	
 	void run(msg::on_ready_fn on_ready);
 
 private:
-	bool read_msg(bool wait, std::vector<zmq::message_t>& msg);
+	// results a worker hasn't sent yet, and their coords (which stay in flight until they're sent)
+	struct WorkerBatch {
+		msg::MeshGenResults results;
+		std::vector<vmath::ivec3> coords;
+		std::chrono::steady_clock::time_point started;
+	};
+
+	bool read_msg(bool wait, msg::MesherMessage& msg);
 	void handle_all_messages(bool wait_for_first, bool& stop);
-	void on_msg(const std::vector<zmq::message_t>& msg, bool& stop);
-	bool handle_queued_request();
+	void on_msg(msg::MesherMessage& msg, bool& stop);
+	void run_worker();
+	bool handle_queued_request(WorkerBatch& batch);
+	bool pop_request(std::shared_ptr<MeshGenRequest>& result);
 	void on_mesh_gen_request(std::shared_ptr<MeshGenRequest> req);
-	void update_player_coords(const vmath::ivec2& new_cords);
+	void on_mesh_gen_requests(msg::MeshGenRequests& reqs);
+
+	// queue request, replacing any older one for the same coords (must hold mtx)
+	void queue_request(std::shared_ptr<MeshGenRequest> req);
+
+	// whether there's nothing queued (must hold mtx)
+	bool all_queues_empty() const;
+
+	// send a worker's batch of results to the render thread, then release their coords (must not hold mtx)
+	void send_results(WorkerBatch& batch);
+
+	// done with coords: queue any request for them that came in while they were in flight (must hold mtx)
+	void release_coords(const vmath::ivec3& coords);
+	void update_player_coords(const vmath::ivec2& new_cords, const int render_distance);
+
+	// distance from player (must hold mtx)
+	int priority(const vmath::ivec3& coords) const;
+
+	// whether player's too far from coords to bother meshing them (must hold mtx)
+	bool too_far(const vmath::ivec3& coords) const;
 
 private:
-	std::shared_ptr<zmq::context_t> ctx;
-	BusNode bus;
+	Mailbox<msg::MesherMessage>& mailbox;
+
+	const int num_workers;
+	std::vector<std::thread> workers;
+
+	// everything below is shared with workers -- only touch while holding mtx
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool stopping = false;
 
 	// Player's last-known coords (so we always generate meshes closest to here)
 	vmath::ivec2 player_coords;
+	int render_distance = -1; // -1 = unknown
+
+	// how far the player's moved since queued priorities were last all recomputed (see MAX_QUEUE_PRIORITY_DRIFT)
+	int priority_drift = 0;
+
+	// Keep queue of incoming requests per class (based on distance to player)
+	// each coords is queued at most once, in its request's class
+	IndexedHeap<vmath::ivec3, std::shared_ptr<MeshGenRequest>, vecN_hash> queues[NUM_REQUEST_CLASSES];
+
+	// requests for coords that are in_flight, waiting for that worker to finish
+	std::unordered_map<vmath::ivec3, std::shared_ptr<MeshGenRequest>, vecN_hash> waiting_for_worker;
+
+	// how many times in a row each class was passed over (see pick_request_class)
+	int passed_over[NUM_REQUEST_CLASSES] = {};
 
-	// Keep queue of incoming requests (based on distance to player)
-	std::priority_queue<pq_entry, std::vector<pq_entry>, std::greater<pq_entry>> pq;
-	std::unordered_map<vmath::ivec3, std::shared_ptr<MeshGenRequest>, vecN_hash> reqs;
+	// coords a worker is meshing, or has a result for that it hasn't sent yet
+	// a new request for these waits in waiting_for_worker until that worker's sent it, so no two workers ever mesh the same coords,
+	// and results for the same coords reach the render thread in the order they were meshed
+	std::unordered_set<vmath::ivec3, vecN_hash> in_flight;
 };
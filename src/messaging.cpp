@@ -1,7 +1,5 @@
 #include "messaging.h"
 
-#include "zmq_addon.hpp"
-
 #include <future>
 #include <sstream>
 #include <string>
@@ -9,50 +7,79 @@
 
 namespace msg
 {
-	std::string gen_unique_addr()
+	Mailboxes& get_mailboxes()
+	{
+		static Mailboxes mailboxes;
+		return mailboxes;
+	}
+
+	void send_exit()
+	{
+		get_mailboxes().mesher.push(Exit());
+		get_mailboxes().chunker.push(Exit());
+	}
+
+	void send_player_moved(const PlayerMovedChunksEvent& event)
+	{
+		get_mailboxes().mesher.push(event);
+		get_mailboxes().chunker.push(event);
+		get_mailboxes().render.push(event);
+	}
+
+	// pop and drop everything in a mailbox
+	template <typename T>
+	void drain(Mailbox<T>& mailbox)
 	{
-		// Not actually that random!
-		static std::atomic_uint64_t extra(0);
-		std::string suffix = std::to_string(extra.fetch_add(1)); // TODO: better memory order
-		std::ostringstream out;
-		out << "inproc://unique-" << suffix;
-		return out.str();
+		T message;
+		while (mailbox.try_pop(message));
+		message = T();
 	}
 
-	std::future<void> launch_thread_wait_until_ready(std::shared_ptr<zmq::context_t> ctx, notifier_thread thread)
+#ifdef _DEBUG
+	template <typename T>
+	void warn_if_alive(const char* name)
 	{
-		// Listen to bus start
-		std::string unique_addr = gen_unique_addr();
-		zmq::socket_t pull(*ctx, zmq::socket_type::pull);
-		pull.bind(unique_addr);
-
-		on_ready_fn on_complete = [&]() {
-			zmq::socket_t push(*ctx, zmq::socket_type::push);
-			push.connect(unique_addr);
-			push.send(zmq::buffer(msg::READY));
+		const PayloadCounters& counters = get_payload_counters<T>();
+		if (counters.live > 0)
+		{
+			std::ostringstream out;
+			out << "Warn: " << counters.live << " " << name << "(s) still alive at shutdown (" << counters.dropped << " dropped undelivered).\n";
+			OutputDebugString(out.str().c_str());
+		}
+	}
+#endif // _DEBUG
+
+	void drain_mailboxes()
+	{
+		drain(get_mailboxes().mesher);
+		drain(get_mailboxes().chunker);
+		drain(get_mailboxes().world);
+		drain(get_mailboxes().render);
+
+#ifdef _DEBUG
+		warn_if_alive<MeshGenRequest>("MeshGenRequest");
+		warn_if_alive<MeshGenResult>("MeshGenResult");
+		warn_if_alive<ChunkGenRequest>("ChunkGenRequest");
+		warn_if_alive<ChunkGenResponse>("ChunkGenResponse");
+#endif // _DEBUG
+	}
+
+	std::future<void> launch_thread_wait_until_ready(notifier_thread thread)
+	{
+		// Listen for thread start
+		std::promise<void> ready;
+		std::future<void> ready_future = ready.get_future();
+		on_ready_fn on_ready = [&ready]() {
+			ready.set_value();
 		};
 
 		// Launch
-		std::future<void> result = std::async(std::launch::async, thread, ctx, on_complete);
+		std::future<void> result = std::async(std::launch::async, thread, on_ready);
 
-		// Wait for response
-		std::vector<zmq::message_t> recv_msgs;
-		auto ret = zmq::recv_multipart(pull, std::back_inserter(recv_msgs));
-		assert(ret);
-		assert(recv_msgs[0].to_string_view() == msg::READY);
+		// Wait for it
+		ready_future.wait();
 
 		// Done
 		return result;
 	}
 }
-
-// TODO: Add operator>> and operator<< ? Or maybe add them to zmq.hpp (and submit a PR)?
-BusNode::BusNode(std::shared_ptr<zmq::context_t> ctx_) : ctx(ctx_), in(*ctx_, zmq::socket_type::pub), out(*ctx_, zmq::socket_type::sub) {
-	in.connect(addr::MSG_BUS_IN);
-	out.connect(addr::MSG_BUS_OUT);
-
-#ifdef HUGE_BUS_NODES
-	bus_in.setsockopt(ZMQ_SNDHWM, 1000 * 1000);
-	bus_out.setsockopt(ZMQ_RCVHWM, 1000 * 1000);
-#endif // HUGE_BUS_NODES
-}
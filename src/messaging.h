@@ -1,91 +1,59 @@
 #pragma once
 
-#include "zmq.hpp"
+#include "envelope.h"
+#include "mailbox.h"
+#include "world_utils.h"
 
 #include <functional>
 #include <future>
+#include <memory>
 #include <string>
+#include <variant>
+#include <vector>
 
 
-namespace addr
-{
-	static const std::string MSG_BUS_IN = "inproc://bus-in";
-	static const std::string MSG_BUS_OUT = "inproc://bus-out";
-	static const std::string MSG_BUS_CONTROL = "inproc://bus-control";
-}
-
 namespace msg
 {
 	using on_ready_fn = std::function<void()>;
-	using notifier_thread = std::function<void(std::shared_ptr<zmq::context_t>, on_ready_fn)>;
-
-	// TODO: Shorten all messages since ZMQ uses prefix matching? Or even just use ints!
-#ifdef _DEBUG
-	static const std::string TEST = "TEST";
-#endif
-
-	// Connection messages - no data
-	static const std::string READY = "READY";
-	static const std::string EXIT = "EXIT";
-	static const std::string BUS_CREATED = "BUS_CREATED";
-	static const std::string CONNECTED_TO_BUS = "CONNECTED_TO_BUS";
-	static const std::string START = "START";
-
-	// Messages with exactly one receiver (usually comes with some heap data)
-	static const std::string MESH_GEN_REQUEST = "MESH_GEN_REQUEST";
-	static const std::string MESH_GEN_RESPONSE = "MESH_GEN_RESPONSE";
-	static const std::string CHUNK_GEN_REQUEST = "CHUNK_GEN_REQUEST";
-	static const std::string CHUNK_GEN_RESPONSE = "CHUNK_GEN_RESPONSE";
-	static const std::string MINI_GET_REQUEST = "MINI_GET_REQUEST";
-	static const std::string MINI_GET_RESPONSE = "MINI_GET_RESPONSE";
-
-	// Messages with multiple receivers (every recipent gets a copy of the data)
-	static const std::string EVENT_PLAYER_MOVED_CHUNKS = "EVENT_PLAYER_MOVED_CHUNKS";
-
-
-	const std::vector<std::string> meshing_thread_incoming = {
-		msg::EXIT,
-		msg::MESH_GEN_REQUEST,
-		msg::MINI_GET_RESPONSE,
-		EVENT_PLAYER_MOVED_CHUNKS
+	using notifier_thread = std::function<void(on_ready_fn)>;
+
+	// How many messages each thread's mailbox holds before senders have to wait
+	constexpr size_t MAILBOX_CAPACITY = 1 << 16;
+
+	// Messages between threads
+	// Each receiving thread has its own mailbox, which only takes the messages it handles.
+	// Messages with exactly one receiver own their heap data (in an Envelope, opened by the receiver), and events are copied to
+	// every receiver.
+	// Requests/results that come in bursts (e.g. when render distance goes up) are sent in batches, to keep the message count down.
+	struct Exit {};
+	using MeshGenRequests = std::vector<Envelope<MeshGenRequest>>;
+	using MeshGenResults = std::vector<Envelope<MeshGenResult>>;
+	using ChunkGenRequests = std::vector<ChunkGenRequest>;
+
+	using MesherMessage = std::variant<Exit, Envelope<MeshGenRequest>, MeshGenRequests, PlayerMovedChunksEvent>;
+	using ChunkerMessage = std::variant<Exit, ChunkGenRequests, PlayerMovedChunksEvent>;
+	using WorldMessage = std::variant<std::monostate, Envelope<ChunkGenResponse>, MeshesDroppedEvent>;
+	using RenderMessage = std::variant<std::monostate, MeshGenResults, PlayerMovedChunksEvent>;
+
+	struct Mailboxes {
+		Mailbox<MesherMessage> mesher{ MAILBOX_CAPACITY };
+		Mailbox<ChunkerMessage> chunker{ MAILBOX_CAPACITY };
+		Mailbox<WorldMessage> world{ MAILBOX_CAPACITY };
+		Mailbox<RenderMessage> render{ MAILBOX_CAPACITY };
 	};
 
-	const std::vector<std::string> chunk_gen_thread_incoming = {
-		msg::EXIT,
-		msg::CHUNK_GEN_REQUEST,
-		EVENT_PLAYER_MOVED_CHUNKS
-	};
-
-	const std::vector<std::string> world_thread_incoming = {
-		msg::EXIT,
-		msg::MINI_GET_REQUEST,
-		msg::CHUNK_GEN_RESPONSE
-	};
+	Mailboxes& get_mailboxes();
 
-	const std::vector<std::string> render_thread_incoming = {
-		msg::EXIT,
-		msg::MESH_GEN_RESPONSE
-	};
+	// tell every thread that waits on its mailbox to stop
+	void send_exit();
 
+	// send event to everyone who handles it
+	void send_player_moved(const PlayerMovedChunksEvent& event);
 
-	// zmq_proxy_steerable messages BEGIN
-	static const std::string PAUSE = "PAUSE";
-	static const std::string RESUME = "RESUME";
-	static const std::string TERMINATE = "TERMINATE";
-	// zmq_proxy_steerable messages END
+	// free whatever's left in the mailboxes (call once every thread's stopped)
+	// in debug builds, also warns about any payloads still alive afterwards, i.e. leaks
+	void drain_mailboxes();
 
-	std::string gen_unique_addr();
-	std::future<void> launch_thread_wait_until_ready(std::shared_ptr<zmq::context_t> ctx, notifier_thread thread);
+	// run `thread` on a new thread, and wait until it calls its on_ready
+	std::future<void> launch_thread_wait_until_ready(notifier_thread thread);
 }
-
-class BusNode
-{
-public:
-	BusNode(std::shared_ptr<zmq::context_t> ctx_);
-
-	zmq::socket_t in;
-	zmq::socket_t out;
-
-private:
-	std::shared_ptr<zmq::context_t> ctx;
-};
@@ -0,0 +1,191 @@
+#include "mini_culler.h"
+
+#include "chunk.h"
+#include "minichunk.h"
+
+#include "vmath.h"
+
+#include <emmintrin.h>
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <vector>
+
+static_assert(MINIS_PER_CHUNK == 16 && MINICHUNK_HEIGHT == 16, "mini culling tests a column's 16 minis 8 at a time");
+
+
+// start culling mini
+void MiniCuller::add(const vmath::ivec3& coords, MiniRender* mini) {
+	assert(coords[1] >= 0 && coords[1] < CHUNK_HEIGHT && "mini out of bounds");
+
+	const vmath::ivec2 chunk_coords = { coords[0], coords[2] };
+	auto search = column_idxs.find(chunk_coords);
+
+	// new column
+	if (search == column_idxs.end()) {
+		const int column = static_cast<int>(column_coords.size());
+		search = column_idxs.insert({ chunk_coords, column }).first;
+		column_coords.push_back(chunk_coords);
+		column_sizes.push_back(0);
+		minis.resize(minis.size() + MINIS_PER_CHUNK, nullptr);
+		visible.resize(visible.size() + MINIS_PER_CHUNK, 0);
+		pad_columns();
+		column_xs[column] = static_cast<float>(chunk_coords[0] * CHUNK_WIDTH);
+		column_zs[column] = static_cast<float>(chunk_coords[1] * CHUNK_DEPTH);
+	}
+
+	const int slot = search->second * MINIS_PER_CHUNK + coords[1] / MINICHUNK_HEIGHT;
+	if (minis[slot] == nullptr) {
+		column_sizes[search->second]++;
+		total_minis++;
+	}
+	minis[slot] = mini;
+	visible[slot] = 0;
+}
+
+// stop culling mini
+void MiniCuller::remove(const vmath::ivec3& coords) {
+	const int slot = get_slot(coords);
+	if (slot < 0 || minis[slot] == nullptr) {
+		return;
+	}
+
+	minis[slot] = nullptr;
+	visible[slot] = 0;
+	total_minis--;
+
+	const int column = slot / MINIS_PER_CHUNK;
+	if (--column_sizes[column] > 0) {
+		return;
+	}
+
+	// column's empty => move last column into its place, to keep them dense
+	const int last = static_cast<int>(column_coords.size()) - 1;
+	column_idxs.erase(column_coords[column]);
+	if (column != last) {
+		column_coords[column] = column_coords[last];
+		column_sizes[column] = column_sizes[last];
+		column_xs[column] = column_xs[last];
+		column_zs[column] = column_zs[last];
+		std::copy_n(minis.begin() + last * MINIS_PER_CHUNK, MINIS_PER_CHUNK, minis.begin() + column * MINIS_PER_CHUNK);
+		std::copy_n(visible.begin() + last * MINIS_PER_CHUNK, MINIS_PER_CHUNK, visible.begin() + column * MINIS_PER_CHUNK);
+		column_idxs[column_coords[column]] = column;
+	}
+
+	column_coords.pop_back();
+	column_sizes.pop_back();
+	minis.resize(minis.size() - MINIS_PER_CHUNK);
+	visible.resize(visible.size() - MINIS_PER_CHUNK);
+	pad_columns();
+}
+
+// collect every mini whose box is in the frustum
+// A box is outside if it's entirely behind one of the planes, i.e. even its corner furthest along the plane's normal is.
+// Per plane, that corner is a constant offset from the box's min corner, so each test is a couple of multiply-adds.
+void MiniCuller::cull(const vmath::vec4(&planes)[6], std::vector<MiniRender*>& result) {
+	result.clear();
+	std::fill(visible.begin(), visible.end(), 0);
+	visible_columns = 0;
+
+	// per plane: normal, and distance from plane of the furthest corner of a column / mini with its min corner at the origin
+	__m128 nx[6], ny[6], nz[6], column_d[6], mini_d[6];
+	for (int i = 0; i < 6; i++) {
+		const vmath::vec4& p = planes[i];
+		nx[i] = _mm_set1_ps(p[0]);
+		ny[i] = _mm_set1_ps(p[1]);
+		nz[i] = _mm_set1_ps(p[2]);
+
+		const float xz_d = (p[0] > 0 ? p[0] * CHUNK_WIDTH : 0) + (p[2] > 0 ? p[2] * CHUNK_DEPTH : 0) + p[3];
+		column_d[i] = _mm_set1_ps(xz_d + (p[1] > 0 ? p[1] * CHUNK_HEIGHT : 0));
+		mini_d[i] = _mm_set1_ps(xz_d + (p[1] > 0 ? p[1] * MINICHUNK_HEIGHT : 0));
+	}
+
+	// y of each mini in a column (min corner)
+	const __m128 mini_ys[4] = {
+		_mm_setr_ps(0, 16, 32, 48), _mm_setr_ps(64, 80, 96, 112), _mm_setr_ps(128, 144, 160, 176), _mm_setr_ps(192, 208, 224, 240)
+	};
+
+	const __m128 zero = _mm_setzero_ps();
+	const int num_columns = static_cast<int>(column_coords.size());
+
+	for (int i = 0; i < num_columns; i += 8) {
+		// test 8 columns
+		const __m128 xs[2] = { _mm_loadu_ps(&column_xs[i]), _mm_loadu_ps(&column_xs[i + 4]) };
+		const __m128 zs[2] = { _mm_loadu_ps(&column_zs[i]), _mm_loadu_ps(&column_zs[i + 4]) };
+		__m128 inside[2] = { _mm_cmpeq_ps(zero, zero), _mm_cmpeq_ps(zero, zero) };
+
+		for (int p = 0; p < 6; p++) {
+			for (int h = 0; h < 2; h++) {
+				const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], xs[h]), _mm_mul_ps(nz[p], zs[h])), column_d[p]);
+				inside[h] = _mm_and_ps(inside[h], _mm_cmpge_ps(d, zero));
+			}
+		}
+
+		unsigned columns_mask = _mm_movemask_ps(inside[0]) | (_mm_movemask_ps(inside[1]) << 4);
+		if (num_columns - i < 8) {
+			columns_mask &= (1u << (num_columns - i)) - 1; // padding
+		}
+
+		// test minis in columns that are in view, 8 at a time too
+		while (columns_mask != 0) {
+			const int column = i + std::countr_zero(columns_mask);
+			columns_mask &= columns_mask - 1;
+			visible_columns++;
+
+			const __m128 x = _mm_set1_ps(column_xs[column]);
+			const __m128 z = _mm_set1_ps(column_zs[column]);
+			unsigned minis_mask = 0;
+
+			for (int half = 0; half < 2; half++) {
+				__m128 mini_inside[2] = { _mm_cmpeq_ps(zero, zero), _mm_cmpeq_ps(zero, zero) };
+
+				for (int p = 0; p < 6; p++) {
+					const __m128 xz_d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(nz[p], z)), mini_d[p]);
+					for (int h = 0; h < 2; h++) {
+						const __m128 d = _mm_add_ps(_mm_mul_ps(ny[p], mini_ys[half * 2 + h]), xz_d);
+						mini_inside[h] = _mm_and_ps(mini_inside[h], _mm_cmpge_ps(d, zero));
+					}
+				}
+
+				minis_mask |= (_mm_movemask_ps(mini_inside[0]) | (_mm_movemask_ps(mini_inside[1]) << 4)) << (half * 8);
+			}
+
+			while (minis_mask != 0) {
+				const int slot = column * MINIS_PER_CHUNK + std::countr_zero(minis_mask);
+				minis_mask &= minis_mask - 1;
+
+				if (minis[slot] != nullptr) {
+					visible[slot] = 1;
+					result.push_back(minis[slot]);
+				}
+			}
+		}
+	}
+}
+
+// whether mini was in the frustum as of the last cull()
+bool MiniCuller::in_frustum(const vmath::ivec3& coords) const {
+	const int slot = get_slot(coords);
+	return slot >= 0 && visible[slot];
+}
+
+// slot of mini, or -1 if its column isn't loaded
+int MiniCuller::get_slot(const vmath::ivec3& coords) const {
+	if (coords[1] < 0 || coords[1] >= CHUNK_HEIGHT) {
+		return -1;
+	}
+
+	const auto search = column_idxs.find({ coords[0], coords[2] });
+	if (search == column_idxs.end()) {
+		return -1;
+	}
+
+	return search->second * MINIS_PER_CHUNK + coords[1] / MINICHUNK_HEIGHT;
+}
+
+// resize column x/z arrays to a multiple of 8
+void MiniCuller::pad_columns() {
+	const size_t padded = (column_coords.size() + 7) / 8 * 8;
+	column_xs.resize(padded, 0.0f);
+	column_zs.resize(padded, 0.0f);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "minichunk.h"
+#include "util.h"
+
+#include "vmath.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Frustum culling for every loaded mini, 8 boxes at a time with SSE
+// Minis are kept by chunk column: column i's minis are in slots [i * MINIS_PER_CHUNK, (i + 1) * MINIS_PER_CHUNK), bottom to
+// top, so a mini's box follows from its column's x/z and its slot. So all we store is column x/z arrays (kept dense, for
+// SIMD), a MiniRender* per slot, and per-slot visibility flags.
+// cull() tests whole columns first, and only tests minis in columns that are at least partly in view.
+class MiniCuller
+{
+public:
+	// start culling mini at `coords` (mini coords)
+	void add(const vmath::ivec3& coords, MiniRender* mini);
+
+	// stop culling mini at `coords`
+	void remove(const vmath::ivec3& coords);
+
+	// replace `result` with every mini whose bounding box is at least partly inside the frustum
+	void cull(const vmath::vec4(&planes)[6], std::vector<MiniRender*>& result);
+
+	// whether mini at `coords` was in the frustum as of the last cull()
+	bool in_frustum(const vmath::ivec3& coords) const;
+
+	inline size_t num_minis() const {
+		return total_minis;
+	}
+
+	inline size_t num_columns() const {
+		return column_coords.size();
+	}
+
+	// how many columns were at least partly in view in the last cull()
+	inline size_t num_visible_columns() const {
+		return visible_columns;
+	}
+
+private:
+	// (chunk coords) -> column index
+	std::unordered_map<vmath::ivec2, int, vecN_hash> column_idxs;
+	std::vector<vmath::ivec2> column_coords;
+	std::vector<int> column_sizes; // number of minis in each column
+
+	// column min corners in real coords, padded with junk to a multiple of 8 so cull() can always load 8
+	std::vector<float> column_xs;
+	std::vector<float> column_zs;
+
+	std::vector<MiniRender*> minis; // by slot (nullptr if none)
+	std::vector<uint8_t> visible; // by slot, as of the last cull()
+
+	size_t total_minis = 0;
+	size_t visible_columns = 0;
+
+	// slot of mini at `coords`, or -1 if its column isn't loaded
+	int get_slot(const vmath::ivec3& coords) const;
+
+	// resize column_xs/column_zs for num_columns() columns
+	void pad_columns();
+};
@@ -80,13 +80,40 @@ std::vector<vmath::ivec3> MiniCoords::all_neighbors() {
 
 /* MiniRender */
 
+// quad buffer capacity for `size` quads, leaving room for edits to add a few
+static GLuint with_slack(const size_t size) {
+	return static_cast<GLuint>(size + size / 4 + 4);
+}
+
+// upload quads at indices `changed` (sorted, maybe with duplicates), one run of consecutive ones at a time
+// quads are at `offset` in `handle`'s range, and indices past the end of `quads` (i.e. removed ones) are skipped
+static void upload_quad_runs(MeshArena& arena, const MeshArena::Handle handle, const GLuint offset, const std::vector<PackedQuad>& quads, std::vector<int>& changed) {
+	std::sort(changed.begin(), changed.end());
+	changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+	for (size_t i = 0; i < changed.size();) {
+		size_t j = i + 1;
+		while (j < changed.size() && changed[j] == changed[j - 1] + 1) {
+			j++;
+		}
+
+		const int start = changed[i];
+		const int end = std::min(changed[j - 1] + 1, (int)quads.size());
+		if (start < end) {
+			arena.upload(handle, offset + start, end - start, &quads[start]);
+		}
+		i = j;
+	}
+}
+
 
 MiniRender::MiniRender()
 	: MiniCoords(),
 	mesh(nullptr), water_mesh(nullptr), meshes_updated(false),
-	quad_data_buf(0), base_coords_buf(0),
+	arena_handle(MeshArena::NO_HANDLE),
 	num_nonwater_quads(0), num_water_quads(0),
-	vao(0), invisible(false)
+	nonwater_capacity(0), water_capacity(0),
+	invisible(false)
 {
 }
 
@@ -96,30 +123,45 @@ MiniRender::MiniRender(const MiniRender& other)
 	mesh(other.mesh != nullptr ? std::make_unique<MiniChunkMesh>(*other.mesh) : nullptr),
 	water_mesh(other.water_mesh != nullptr ? std::make_unique<MiniChunkMesh>(*other.water_mesh) : nullptr),
 	meshes_updated(other.meshes_updated),
-	quad_data_buf(other.quad_data_buf), base_coords_buf(other.base_coords_buf),
+	changed_quads(other.changed_quads), changed_water_quads(other.changed_water_quads),
+	arena_handle(other.arena_handle),
 	num_nonwater_quads(other.num_nonwater_quads), num_water_quads(other.num_water_quads),
-	vao(other.vao), invisible(other.invisible)
+	nonwater_capacity(other.nonwater_capacity), water_capacity(other.water_capacity),
+	invisible(other.invisible)
 {
 }
 
-void MiniRender::set_coords(const vmath::ivec3& coords_)
-{
-	MiniCoords::set_coords(coords_);
-
-	// update coords buf
-	glDeleteBuffers(1, &base_coords_buf);
-	glCreateBuffers(1, &base_coords_buf);
-	glNamedBufferStorage(base_coords_buf, sizeof(get_coords()), get_coords(), NULL);
-}
-
 void MiniRender::set_mesh(std::unique_ptr<MiniChunkMesh> mesh_) {
 	std::swap(this->mesh, mesh_);
 	meshes_updated = true;
+	invisible = false; // until update_quads_buf finds out otherwise
 }
 
 void MiniRender::set_water_mesh(std::unique_ptr<MiniChunkMesh> water_mesh_) {
 	std::swap(this->water_mesh, water_mesh_);
 	meshes_updated = true;
+	invisible = false;
+}
+
+// replace just `layers` of our meshes with these
+void MiniRender::set_mesh_layers(const MiniChunkMesh& mesh_, const MiniChunkMesh& water_mesh_, const MeshLayers& layers) {
+	// nothing there yet => nothing to keep (it was empty, or it was invisible -- and an edit only uncovers quads in `layers`)
+	if (mesh == nullptr) {
+		mesh = std::make_unique<MiniChunkMesh>();
+	}
+	if (water_mesh == nullptr) {
+		water_mesh = std::make_unique<MiniChunkMesh>();
+	}
+
+	const std::vector<int> changed = mesh->replace_layers(mesh_, layers);
+	const std::vector<int> changed_water = water_mesh->replace_layers(water_mesh_, layers);
+
+	// whole thing's getting uploaded anyway
+	if (!meshes_updated) {
+		changed_quads.insert(changed_quads.end(), changed.begin(), changed.end());
+		changed_water_quads.insert(changed_water_quads.end(), changed_water.begin(), changed_water.end());
+	}
+	invisible = false;
 }
 
 bool MiniRender::get_invisible() const {
@@ -129,59 +171,37 @@ bool MiniRender::get_invisible() const {
 void MiniRender::set_invisible(const bool invisible) {
 	this->invisible = invisible;
 
-	// TODO: if set to invisible, also mark buffers/vao for deletion?
+	// TODO: if set to invisible, also give back our room in the arena?
 }
 
-// render this minichunk's texture meshes
-void MiniRender::render_meshes(const OpenGLInfo* glInfo) {
-	// don't draw if covered in all sides
+// upload our meshes if they changed
+void MiniRender::prepare_render(MeshArena& arena) {
+	// don't bother if covered in all sides
 	if (invisible || mesh == nullptr) {
 		return;
 	}
 
-	// update quads if needed
-	if (meshes_updated) {
-		meshes_updated = false;
-		update_quads_buf(glInfo);
+	if (meshes_updated || !changed_quads.empty() || !changed_water_quads.empty()) {
+		update_quads_buf(arena);
 	}
-
-	if (num_nonwater_quads == 0) {
-		return;
-	}
-
-	// quad VAO
-	glBindVertexArray(vao);
-
-	// DRAW!
-	glDrawArrays(GL_POINTS, 0, num_nonwater_quads);
 }
 
-// render this minichunk's water meshes
-void MiniRender::render_water_meshes(const OpenGLInfo* glInfo) {
-	// don't draw if covered in all sides
-	if (invisible || water_mesh == nullptr) {
+// add draws of our meshes
+void MiniRender::add_draws(const MeshArena& arena, DrawCommandList& terrain, DrawCommandList& water) const {
+	if (invisible || arena_handle == MeshArena::NO_HANDLE) {
 		return;
 	}
 
-	// update quads if needed
-	if (meshes_updated) {
-		meshes_updated = false;
-		update_quads_buf(glInfo);
+	if (mesh != nullptr) {
+		arena.add_draw(terrain, arena_handle, 0, num_nonwater_quads);
 	}
-
-	if (num_water_quads == 0) {
-		return;
+	if (water_mesh != nullptr) {
+		arena.add_draw(water, arena_handle, nonwater_capacity, num_water_quads);
 	}
-
-	// quad VAO
-	glBindVertexArray(vao);
-
-	// DRAW!
-	glDrawArrays(GL_POINTS, num_nonwater_quads, num_water_quads);
 }
 
 // assumes mesh lock
-void MiniRender::update_quads_buf(const OpenGLInfo* glInfo) {
+void MiniRender::update_quads_buf(MeshArena& arena) {
 	if (mesh == nullptr || water_mesh == nullptr) {
 		throw "bad";
 	}
@@ -189,39 +209,45 @@ void MiniRender::update_quads_buf(const OpenGLInfo* glInfo) {
 	auto& quads = mesh->get_quads();
 	auto& water_quads = water_mesh->get_quads();
 
-	// if no quads, we done
+	bool upload_all = meshes_updated;
+	meshes_updated = false;
+
+	// if no quads, we done (and don't need our room in the arena)
 	if (quads.size() + water_quads.size() == 0) {
 		invisible = true;
+		release_gl(arena);
+		changed_quads.clear();
+		changed_water_quads.clear();
 		return;
 	}
 
-	recreate_vao(glInfo, quads.size() + water_quads.size());
+	// doesn't fit => start over with more room
+	if (quads.size() > nonwater_capacity || water_quads.size() > water_capacity) {
+		allocate_quads_buf(arena, with_slack(quads.size()), with_slack(water_quads.size()));
+		upload_all = true;
+	}
+
+	if (upload_all) {
+		arena.upload(arena_handle, 0, quads.size(), quads.data());
+		arena.upload(arena_handle, nonwater_capacity, water_quads.size(), water_quads.data());
+	}
+	else {
+		upload_quad_runs(arena, arena_handle, 0, quads, changed_quads);
+		upload_quad_runs(arena, arena_handle, nonwater_capacity, water_quads, changed_water_quads);
+	}
+	changed_quads.clear();
+	changed_water_quads.clear();
 
 	num_nonwater_quads = quads.size();
 	num_water_quads = water_quads.size();
 
-	// map
-	Quad3D* gpu_quads = (Quad3D*)glMapNamedBufferRange(quad_data_buf, 0, sizeof(Quad3D) * (quads.size() + water_quads.size()), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
-
-	// update quads
-	std::copy(quads.begin(), quads.end(), gpu_quads);
-
-	// update water quads
-	std::copy(water_quads.begin(), water_quads.end(), gpu_quads + quads.size());
-
-	// flush
-	glFlushMappedNamedBufferRange(quad_data_buf, 0, sizeof(Quad3D) * (quads.size() + water_quads.size()));
-
-	// unmap
-	glUnmapNamedBuffer(quad_data_buf);
-
 #ifdef _DEBUG
 
 	// quads error check
 	for (int i = 0; i < quads.size(); i++) {
 		// error check:
 		// make sure at least one dimension is killed - i.e. it's a flat quad ( todo. make sure other 2 dimensions are >= 1 size.)
-		vmath::ivec3 diffs = quads[i].corner2 - quads[i].corner1;
+		vmath::ivec3 diffs = quads[i].corner2() - quads[i].corner1();
 
 		int num_diffs_0 = 0;
 		int zero_idx = 0;
@@ -242,7 +268,7 @@ void MiniRender::update_quads_buf(const OpenGLInfo* glInfo) {
 	for (int i = 0; i < water_quads.size(); i++) {
 		// error check:
 		// make sure at least one dimension is killed - i.e. it's a flat quad ( todo. make sure other 2 dimensions are >= 1 size.)
-		vmath::ivec3 diffs = water_quads[i].corner2 - water_quads[i].corner1;
+		vmath::ivec3 diffs = water_quads[i].corner2() - water_quads[i].corner1();
 
 		int num_diffs_0 = 0;
 		int zero_idx = 0;
@@ -261,62 +287,30 @@ void MiniRender::update_quads_buf(const OpenGLInfo* glInfo) {
 #endif
 }
 
-// TODO: remove this from render.cpp?
-void MiniRender::recreate_vao(const OpenGLInfo* glInfo, const GLuint size) {
-	// delete
-	glDeleteBuffers(1, &quad_data_buf);
-	glDeleteVertexArrays(1, &vao);
-
-	// create
-	glCreateBuffers(1, &quad_data_buf);
-	glCreateVertexArrays(1, &vao);
-
-	// allocate
-	glNamedBufferStorage(quad_data_buf, sizeof(Quad3D) * size, NULL, GL_MAP_WRITE_BIT);
+// replace our room in the arena with empty room for this many quads
+void MiniRender::allocate_quads_buf(MeshArena& arena, const GLuint nonwater_capacity, const GLuint water_capacity) {
+	arena.release(arena_handle);
+	arena_handle = arena.allocate(nonwater_capacity + water_capacity, get_coords());
 
-	// vao: create VAO for Quads, so we can tell OpenGL how to use it when it's bound
-
-	// vao: enable all Quad's attributes, 1 at a time
-	glEnableVertexArrayAttrib(vao, glInfo->q_block_type_attr_idx);
-	glEnableVertexArrayAttrib(vao, glInfo->q_corner1_attr_idx);
-	glEnableVertexArrayAttrib(vao, glInfo->q_corner2_attr_idx);
-	glEnableVertexArrayAttrib(vao, glInfo->q_face_attr_idx);
-	glEnableVertexArrayAttrib(vao, glInfo->q_base_coords_attr_idx);
-	glEnableVertexArrayAttrib(vao, glInfo->q_lighting_attr_idx);
-	glEnableVertexArrayAttrib(vao, glInfo->q_metadata_attr_idx);
-
-	// vao: set up formats for Quad's attributes, 1 at a time
-	glVertexArrayAttribIFormat(vao, glInfo->q_block_type_attr_idx, 1, GL_UNSIGNED_BYTE, offsetof(Quad3D, block));
-	glVertexArrayAttribIFormat(vao, glInfo->q_corner1_attr_idx, 3, GL_INT, offsetof(Quad3D, corner1));
-	glVertexArrayAttribIFormat(vao, glInfo->q_corner2_attr_idx, 3, GL_INT, offsetof(Quad3D, corner2));
-	glVertexArrayAttribIFormat(vao, glInfo->q_face_attr_idx, 3, GL_INT, offsetof(Quad3D, face));
-	glVertexArrayAttribIFormat(vao, glInfo->q_lighting_attr_idx, 1, GL_UNSIGNED_BYTE, offsetof(Quad3D, lighting));
-	glVertexArrayAttribIFormat(vao, glInfo->q_metadata_attr_idx, 1, GL_UNSIGNED_BYTE, offsetof(Quad3D, metadata));
-
-	glVertexArrayAttribIFormat(vao, glInfo->q_base_coords_attr_idx, 3, GL_INT, 0);
-
-	// vao: match attributes to binding indices
-	glVertexArrayAttribBinding(vao, glInfo->q_block_type_attr_idx, glInfo->quad_data_bidx);
-	glVertexArrayAttribBinding(vao, glInfo->q_corner1_attr_idx, glInfo->quad_data_bidx);
-	glVertexArrayAttribBinding(vao, glInfo->q_corner2_attr_idx, glInfo->quad_data_bidx);
-	glVertexArrayAttribBinding(vao, glInfo->q_face_attr_idx, glInfo->quad_data_bidx);
-	glVertexArrayAttribBinding(vao, glInfo->q_lighting_attr_idx, glInfo->quad_data_bidx);
-	glVertexArrayAttribBinding(vao, glInfo->q_metadata_attr_idx, glInfo->quad_data_bidx);
-
-	glVertexArrayAttribBinding(vao, glInfo->q_base_coords_attr_idx, glInfo->q_base_coords_bidx);
-
-	// vao: match attributes to buffers
-	glVertexArrayVertexBuffer(vao, glInfo->quad_data_bidx, quad_data_buf, 0, sizeof(Quad3D));
-
-	glVertexArrayVertexBuffer(vao, glInfo->q_base_coords_bidx, base_coords_buf, 0, sizeof(vmath::ivec3));
-
-	// vao: extra properties
-	glBindVertexArray(vao);
+	this->nonwater_capacity = nonwater_capacity;
+	this->water_capacity = water_capacity;
+}
 
-	// instance attribute
-	glVertexAttribDivisor(glInfo->q_base_coords_attr_idx, 1);
+// give our room in the arena back
+void MiniRender::release_gl(MeshArena& arena)
+{
+	arena.release(arena_handle);
+	num_nonwater_quads = 0;
+	num_water_quads = 0;
+	nonwater_capacity = 0;
+	water_capacity = 0;
+}
 
-	glBindVertexArray(0);
+// memory used by our meshes, counting both the CPU copy and our room in the arena (bytes)
+size_t MiniRender::memory_usage() const
+{
+	const size_t num_quads = (mesh ? mesh->size() : 0) + (water_mesh ? water_mesh->size() : 0);
+	return sizeof(*this) + (num_quads + nonwater_capacity + water_capacity) * sizeof(PackedQuad);
 }
 
 
@@ -365,3 +359,4 @@ char* MiniChunk::print_layer(int face, int layer) {
 
 	return result;
 }
+
@@ -1,6 +1,8 @@
 #pragma once
 
 // Renderer part
+#include "draw_commands.h"
+#include "mesh_arena.h"
 #include "minichunkmesh.h"
 
 // Data part
@@ -57,18 +59,23 @@ class MiniRender : public MiniCoords
 private:
 	std::unique_ptr<MiniChunkMesh> mesh;
 	std::unique_ptr<MiniChunkMesh> water_mesh;
-	bool meshes_updated;
+	bool meshes_updated; // whole meshes need uploading
 
-	// TODO: When someone else sets invisibility, we want to delete bufs as well.
-	GLuint quad_data_buf;
-	GLuint base_coords_buf;
+	// quads that changed since they were last uploaded (only if !meshes_updated), as indices into mesh/water_mesh
+	std::vector<int> changed_quads;
+	std::vector<int> changed_water_quads;
+
+	// our room in the mesh arena
+	MeshArena::Handle arena_handle;
 
 	// number of quads inside the buffer, as reading from mesh is not always reliable
 	GLuint num_nonwater_quads;
 	GLuint num_water_quads;
 
-	// vao
-	GLuint vao;
+	// room in the buffer -- non-water quads go at the start, water quads at nonwater_capacity
+	// has some slack, so edits can usually update it in place
+	GLuint nonwater_capacity;
+	GLuint water_capacity;
 
 	bool invisible;
 
@@ -78,27 +85,38 @@ public:
 	// Hack for now, will prob remove
 	MiniRender(const MiniRender& other);
 
-	virtual  void set_coords(const vmath::ivec3& coords_);
-
 	void set_mesh(std::unique_ptr<MiniChunkMesh> mesh_);
 
 	void set_water_mesh(std::unique_ptr<MiniChunkMesh> water_mesh_);
 
+	// replace just `layers` of our meshes with these (see MeshGenResult::layers)
+	// only the quads that changed get uploaded
+	void set_mesh_layers(const MiniChunkMesh& mesh_, const MiniChunkMesh& water_mesh_, const MeshLayers& layers);
+
 	bool get_invisible() const;
 
 	void set_invisible(const bool invisible);
 
-	// render this minichunk's texture meshes
-	void render_meshes(const OpenGLInfo* glInfo);
+	// upload our meshes if they changed since last time
+	// do this for every mini before add_draws(), since uploading can move things around in the arena
+	void prepare_render(MeshArena& arena);
 
-	// render this minichunk's water meshes
-	void render_water_meshes(const OpenGLInfo* glInfo);
+	// add draws of our texture meshes to `terrain`, and our water meshes to `water`
+	void add_draws(const MeshArena& arena, DrawCommandList& terrain, DrawCommandList& water) const;
 
+	// upload whatever changed in our meshes (everything if meshes_updated)
 	// assumes mesh lock
-	void update_quads_buf(const OpenGLInfo* glInfo);
+	void update_quads_buf(MeshArena& arena);
+
+	// replace our room in the arena with empty room for this many quads
+	void allocate_quads_buf(MeshArena& arena, const GLuint nonwater_capacity, const GLuint water_capacity);
+
+	// give our room in the arena back
+	// call right before dropping us (on the GL thread) -- copies share it, so we can't do it in a destructor
+	void release_gl(MeshArena& arena);
 
-	// TODO: remove this from render.cpp?
-	void recreate_vao(const OpenGLInfo* glInfo, const GLuint size);
+	// memory used by our meshes, counting both the CPU copy and our room in the arena (bytes)
+	size_t memory_usage() const;
 };
 
 class MiniChunk : public MiniCoords, public ChunkData
@@ -1,17 +1,135 @@
 #include "minichunkmesh.h"
 
+#include <algorithm>
+#include <cassert>
+
 // A mesh of a minichunk, consisting of a bunch of quads & minichunk coordinates
 int MiniChunkMesh::size() const
 {
-	return quads3d.size();
+	return quads.size();
+}
+
+const std::vector<PackedQuad>& MiniChunkMesh::get_quads() const
+{
+	return quads;
+}
+
+void MiniChunkMesh::add_quad(const PackedQuad& quad)
+{
+	quads.push_back(quad);
+}
+
+// replace our quads in `layers` with `other`'s, filling the gaps in place
+std::vector<int> MiniChunkMesh::replace_layers(const MiniChunkMesh& other, const MeshLayers& layers)
+{
+	const int num_quads = static_cast<int>(quads.size());
+	std::vector<int> holes;
+	for (int i = 0; i < num_quads; i++) {
+		if (layers.contains(quads[i])) {
+			holes.push_back(i);
+		}
+	}
+
+	std::vector<int> changed;
+	const std::vector<PackedQuad>& new_quads = other.quads;
+	const int num_new = static_cast<int>(new_quads.size());
+	const int num_holes = static_cast<int>(holes.size());
+	int n = 0;
+
+	// new quads go in the holes first, then at the end
+	for (; n < num_new; n++) {
+		assert(layers.contains(new_quads[n]) && "replacement quad outside of its layers");
+		if (n < num_holes) {
+			quads[holes[n]] = new_quads[n];
+			changed.push_back(holes[n]);
+		}
+		else {
+			changed.push_back(static_cast<int>(quads.size()));
+			quads.push_back(new_quads[n]);
+		}
+	}
+
+	// fill any holes left over with quads from the end
+	int live_end = static_cast<int>(quads.size());
+	int back = num_holes;
+	for (int front = n; front < back; front++) {
+		// holes at the very end just get cut off
+		while (back > front && holes[back - 1] == live_end - 1) {
+			back--;
+			live_end--;
+		}
+		if (front >= back) {
+			break;
+		}
+
+		live_end--;
+		quads[holes[front]] = quads[live_end];
+		changed.push_back(holes[front]);
+	}
+	quads.resize(live_end);
+
+	std::sort(changed.begin(), changed.end());
+	return changed;
+}
+
+
+/* MeshLayers */
+
+MeshLayers MeshLayers::all()
+{
+	return { { 0xFFFF, 0xFFFF, 0xFFFF } };
+}
+
+// layers whose quads can change when the block at `rel` changes
+MeshLayers MeshLayers::around_block(const vmath::ivec3& rel)
+{
+	MeshLayers result = { { 0, 0, 0 } };
+
+	for (int axis = 0; axis < 3; axis++) {
+		const int other_1 = (axis + 1) % 3, other_2 = (axis + 2) % 3;
+		if (rel[other_1] < 0 || rel[other_1] > 15 || rel[other_2] < 0 || rel[other_2] > 15) {
+			continue;
+		}
+
+		for (int layer_no = rel[axis] - 1; layer_no <= rel[axis] + 1; layer_no++) {
+			if (0 <= layer_no && layer_no <= 15) {
+				result.masks[axis] |= 1 << layer_no;
+			}
+		}
+	}
+
+	return result;
 }
 
-const std::vector<Quad3D>& MiniChunkMesh::get_quads() const
+MeshLayers MeshLayers::single(const int layers_idx, const int layer_no)
 {
-	return quads3d;
+	assert(0 <= layers_idx && layers_idx < 3 && 0 <= layer_no && layer_no < 16 && "invalid layer");
+
+	MeshLayers result = { { 0, 0, 0 } };
+	result.masks[layers_idx] = 1 << layer_no;
+	return result;
+}
+
+bool MeshLayers::is_all() const
+{
+	return masks[0] == 0xFFFF && masks[1] == 0xFFFF && masks[2] == 0xFFFF;
+}
+
+// whether quad lies in one of our layers
+bool MeshLayers::contains(const PackedQuad& quad) const
+{
+	const int layers_idx = quad.face_idx() >> 1;
+	const bool backface = quad.face_idx() & 1;
+
+	// front faces were moved 1 forwards, out of their layer (see add_layer_quads)
+	const int layer_no = quad.corner1()[layers_idx] - (backface ? 0 : 1);
+	return contains(layers_idx, layer_no);
 }
 
-void MiniChunkMesh::add_quad(const Quad3D& quad)
+MeshLayers& MeshLayers::operator|=(const MeshLayers& other)
 {
-	quads3d.push_back(quad);
+	for (int i = 0; i < 3; i++) {
+		masks[i] |= other.masks[i];
+	}
+	return *this;
 }
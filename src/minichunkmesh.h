@@ -4,15 +4,48 @@
 
 #include "vmath.h"
 
+#include <cstdint>
 #include <vector>
 
+// a set of layers of a mini, for remeshing only part of it
+// bit l of masks[axis] => layer l perpendicular to axis (0 = x, 1 = y, 2 = z), which holds that axis' -/+ faces of the blocks in it
+struct MeshLayers {
+	uint16_t masks[3];
+
+	// every layer, i.e. the whole mesh
+	static MeshLayers all();
+
+	// layers whose quads can change when the block at `rel` (relative to the mini, can be just outside it) changes:
+	// along each axis, the block's own layer and the layers on either side, if the block's inside the mini across that axis
+	static MeshLayers around_block(const vmath::ivec3& rel);
+
+	// just layer `layer_no` perpendicular to `layers_idx`
+	static MeshLayers single(const int layers_idx, const int layer_no);
+
+	bool is_all() const;
+
+	inline bool contains(const int layers_idx, const int layer_no) const {
+		return (masks[layers_idx] >> layer_no) & 1;
+	}
+
+	// whether quad lies in one of our layers
+	bool contains(const PackedQuad& quad) const;
+
+	MeshLayers& operator|=(const MeshLayers& other);
+};
+
 // A mesh of a minichunk, consisting of a bunch of quads & minichunk coordinates
 class MiniChunkMesh {
 public:
 	int size() const;
-	const std::vector<Quad3D>& get_quads() const;
-	void add_quad(const Quad3D& quad);
+	const std::vector<PackedQuad>& get_quads() const;
+	void add_quad(const PackedQuad& quad);
+
+	// replace our quads in `layers` with `other`'s (which must all be in `layers`)
+	// fills the gaps left behind in place, so the other quads mostly stay put
+	// returns (sorted) indices of quads that changed -- any others past the end were removed
+	std::vector<int> replace_layers(const MiniChunkMesh& other, const MeshLayers& layers);
 
 private:
-	std::vector<Quad3D> quads3d;
+	std::vector<PackedQuad> quads;
 };
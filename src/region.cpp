@@ -0,0 +1,539 @@
+#include "region.h"
+
+#include "settings.h"
+
+#include <windows.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <shared_mutex>
+#include <string>
+
+namespace fs = std::filesystem;
+
+constexpr char REGION_MAGIC[4] = { 'M', 'C', '2', 'R' };
+constexpr int REGION_NUM_CHUNKS = REGION_SIZE * REGION_SIZE;
+
+// where a chunk is in its region file
+// read/written as-is, so this relies on running on a little-endian machine
+struct RegionEntry {
+	uint32_t offset;
+	uint32_t size;
+};
+static_assert(sizeof(RegionEntry) == 8, "RegionEntry must match the file format");
+
+// one of the two copies of the chunk table
+struct RegionTable {
+	uint32_t generation;
+	uint32_t checksum;
+	RegionEntry entries[REGION_NUM_CHUNKS];
+};
+static_assert(sizeof(RegionTable) == 8 + REGION_NUM_CHUNKS * sizeof(RegionEntry), "RegionTable must match the file format");
+
+constexpr size_t REGION_TABLES_OFFSET = 8;
+constexpr size_t REGION_HEADER_SIZE = REGION_TABLES_OFFSET + 2 * sizeof(RegionTable);
+
+// FNV-1a of table's generation and entries
+static uint32_t table_checksum(const RegionTable& table) {
+	uint32_t hash = 2166136261u;
+	auto add = [&hash](const void* data, const size_t size) {
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 16777619u;
+		}
+	};
+
+	add(&table.generation, sizeof(table.generation));
+	add(table.entries, sizeof(table.entries));
+	return hash;
+}
+
+// write `size` bytes at `offset` in `file`
+static bool write_at(HANDLE file, const uint64_t offset, const void* data, const size_t size) {
+	OVERLAPPED at = {};
+	at.Offset = static_cast<DWORD>(offset);
+	at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+	DWORD written = 0;
+	return WriteFile(file, data, static_cast<DWORD>(size), &written, &at) && written == size;
+}
+
+
+// a file mapped read-only into memory
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// map file at `path`
+	// returns false if it doesn't exist (or can't be mapped)
+	bool open(const std::string& path);
+
+	void close();
+
+	inline const uint8_t* data() const { return ptr; }
+	inline size_t size() const { return len; }
+
+private:
+	const uint8_t* ptr = nullptr;
+	size_t len = 0;
+
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+};
+
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		return false;
+	}
+
+	ptr = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (ptr == nullptr) {
+		close();
+		return false;
+	}
+
+	len = static_cast<size_t>(file_size.QuadPart);
+	return true;
+}
+
+void MappedFile::close() {
+	if (ptr != nullptr) {
+		UnmapViewOfFile(ptr);
+	}
+	if (mapping != nullptr) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+	if (file != INVALID_HANDLE_VALUE) {
+		CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+	}
+
+	ptr = nullptr;
+	len = 0;
+}
+
+
+// one region file
+// stays mapped while nobody's writing to it, so loading a chunk is just reading from memory
+class RegionFile
+{
+public:
+	// held shared while reading, exclusively while writing
+	std::shared_mutex mtx;
+
+	RegionFile(const std::string& path_);
+
+	// find saved chunk `idx` (must hold mtx)
+	// returns false if it isn't saved
+	bool find(const int idx, const uint8_t*& data, uint32_t& size) const;
+
+	// write chunks, given as (idx, data) (must hold mtx exclusively)
+	// returns false if they couldn't all be written
+	bool write(const std::vector<std::pair<int, const std::vector<uint8_t>*>>& chunks);
+
+private:
+	// (re-)map the file, if it exists and is valid
+	void remap();
+
+	// write chunks, then the table pointing at them, to open file
+	bool write_chunks(HANDLE file, const std::vector<std::pair<int, const std::vector<uint8_t>*>>& chunks);
+
+private:
+	std::string path;
+	MappedFile view;
+
+	// current table, and which of the file's two it is (-1 => file doesn't exist yet)
+	RegionTable table;
+	int table_slot = -1;
+
+	// file exists, but isn't a valid region file (or is from another REGION_VERSION)
+	bool broken = false;
+};
+
+RegionFile::RegionFile(const std::string& path_) : path(path_) {
+	remap();
+}
+
+void RegionFile::remap() {
+	table = {};
+	table_slot = -1;
+	broken = false;
+
+	if (!view.open(path)) {
+		// (empty counts as broken too)
+		std::error_code err;
+		broken = fs::exists(path, err);
+		return;
+	}
+
+	uint32_t version = 0;
+	if (view.size() >= REGION_HEADER_SIZE) {
+		memcpy(&version, view.data() + sizeof(REGION_MAGIC), sizeof(version));
+	}
+
+	// newest table that was completely written
+	if (view.size() >= REGION_HEADER_SIZE && memcmp(view.data(), REGION_MAGIC, sizeof(REGION_MAGIC)) == 0 && version == REGION_VERSION) {
+		for (int slot = 0; slot < 2; slot++) {
+			RegionTable candidate;
+			memcpy(&candidate, view.data() + REGION_TABLES_OFFSET + slot * sizeof(RegionTable), sizeof(candidate));
+			if (candidate.checksum == table_checksum(candidate) && (table_slot < 0 || candidate.generation > table.generation)) {
+				table = candidate;
+				table_slot = slot;
+			}
+		}
+	}
+
+	if (table_slot < 0) {
+		OutputDebugString("Warn: Ignoring invalid region file.\n");
+		table = {};
+		broken = true;
+		view.close();
+	}
+}
+
+bool RegionFile::find(const int idx, const uint8_t*& data, uint32_t& size) const {
+	assert(0 <= idx && idx < REGION_NUM_CHUNKS && "invalid chunk idx");
+
+	if (view.data() == nullptr) {
+		return false;
+	}
+
+	const RegionEntry& entry = table.entries[idx];
+	if (entry.offset == 0 || static_cast<size_t>(entry.offset) + entry.size > view.size()) {
+		return false;
+	}
+
+	data = view.data() + entry.offset;
+	size = entry.size;
+	return true;
+}
+
+// rename broken region file at `path` to the first free <path>.bad, <path>.bad1, ...
+// returns false if it couldn't be moved
+static bool move_aside(const std::string& path) {
+	std::string bad_path = path + ".bad";
+	for (int i = 1; fs::exists(bad_path); i++) {
+		bad_path = path + ".bad" + std::to_string(i);
+	}
+
+	std::error_code err;
+	fs::rename(path, bad_path, err);
+	if (err) {
+		OutputDebugString("Warn: Couldn't move invalid region file aside, not saving to it.\n");
+		return false;
+	}
+
+	const std::string msg = "Warn: Moved invalid region file to " + bad_path + ".\n";
+	OutputDebugString(msg.c_str());
+	return true;
+}
+
+bool RegionFile::write(const std::vector<std::pair<int, const std::vector<uint8_t>*>>& chunks) {
+	// can't write to it while it's mapped
+	view.close();
+
+	// broken (or newer) file, so move it out of the way rather than losing what's in it
+	if (broken && !move_aside(path)) {
+		remap();
+		return false;
+	}
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		remap();
+		return false;
+	}
+
+	const bool ok = write_chunks(file, chunks);
+	CloseHandle(file);
+
+	remap();
+	return ok;
+}
+
+// never overwrites anything the current table points at, so a crash at any point leaves a table pointing at whole chunks
+bool RegionFile::write_chunks(HANDLE file, const std::vector<std::pair<int, const std::vector<uint8_t>*>>& chunks) {
+	// new file, so start with an empty table (in slot 0, so the first save goes in slot 1)
+	if (table_slot < 0) {
+		std::vector<uint8_t> header(REGION_HEADER_SIZE, 0);
+		table = {};
+		table.checksum = table_checksum(table);
+		memcpy(header.data(), REGION_MAGIC, sizeof(REGION_MAGIC));
+		memcpy(header.data() + sizeof(REGION_MAGIC), &REGION_VERSION, sizeof(REGION_VERSION));
+		memcpy(header.data() + REGION_TABLES_OFFSET, &table, sizeof(table));
+		if (!write_at(file, 0, header.data(), header.size()) || !FlushFileBuffers(file)) {
+			return false;
+		}
+		table_slot = 0;
+	}
+
+	// free space is whatever the current table doesn't point at (the other table is about to be overwritten)
+	std::vector<RegionEntry> used;
+	for (const RegionEntry& entry : table.entries) {
+		if (entry.offset != 0) {
+			used.push_back(entry);
+		}
+	}
+	std::sort(used.begin(), used.end(), [](const RegionEntry& a, const RegionEntry& b) { return a.offset < b.offset; });
+
+	// (offset, size) of gaps between saved chunks, and where the space after the last one starts
+	std::vector<std::pair<uint64_t, uint64_t>> gaps;
+	uint64_t file_end = REGION_HEADER_SIZE;
+	for (const RegionEntry& entry : used) {
+		if (entry.offset > file_end) {
+			gaps.push_back({ file_end, entry.offset - file_end });
+		}
+		file_end = std::max(file_end, static_cast<uint64_t>(entry.offset) + entry.size);
+	}
+
+	// write chunks into gaps (first fit), or after the end
+	RegionTable next = table;
+	bool ok = true;
+	for (const auto& [idx, data] : chunks) {
+		assert(0 <= idx && idx < REGION_NUM_CHUNKS && "invalid chunk idx");
+		const uint64_t size = data->size();
+
+		auto gap = std::find_if(gaps.begin(), gaps.end(), [size](const std::pair<uint64_t, uint64_t>& g) { return g.second >= size; });
+		uint64_t offset;
+		if (gap != gaps.end()) {
+			offset = gap->first;
+			gap->first += size;
+			gap->second -= size;
+		} else if (file_end + size <= std::numeric_limits<uint32_t>::max()) {
+			offset = file_end;
+			file_end += size;
+		} else {
+			OutputDebugString("Warn: Region file is full.\n");
+			ok = false;
+			continue;
+		}
+
+		// a failed write leaves the file as it was, since the table isn't touched
+		if (!write_at(file, offset, data->data(), data->size())) {
+			return false;
+		}
+		next.entries[idx] = { static_cast<uint32_t>(offset), static_cast<uint32_t>(size) };
+	}
+
+	// chunks have to be on disk before the table pointing at them
+	if (!FlushFileBuffers(file)) {
+		return false;
+	}
+
+	// then overwrite the older table
+	// if that's cut off, its checksum won't match, so the current one is still used
+	next.generation = table.generation + 1;
+	next.checksum = table_checksum(next);
+	const int next_slot = 1 - table_slot;
+	if (!write_at(file, REGION_TABLES_OFFSET + next_slot * sizeof(RegionTable), &next, sizeof(next)) || !FlushFileBuffers(file)) {
+		return false;
+	}
+
+	return ok;
+}
+
+// get coords of region containing chunk at `coords`
+static vmath::ivec2 get_region_coords(const vmath::ivec2& coords) {
+	return {
+		static_cast<int>(floorf(static_cast<float>(coords[0]) / REGION_SIZE)),
+		static_cast<int>(floorf(static_cast<float>(coords[1]) / REGION_SIZE)),
+	};
+}
+
+// get idx of chunk at `coords` within its region
+static int get_region_chunk_idx(const vmath::ivec2& coords) {
+	const vmath::ivec2 region_coords = get_region_coords(coords);
+	const int x = coords[0] - region_coords[0] * REGION_SIZE;
+	const int z = coords[1] - region_coords[1] * REGION_SIZE;
+	return x + z * REGION_SIZE;
+}
+
+RegionStore::RegionStore(const std::string& dir_) : dir(dir_) {
+	std::error_code err;
+	fs::create_directories(dir, err);
+	if (err) {
+		OutputDebugString("Warn: Couldn't create world directory, chunks won't be saved.\n");
+	}
+
+	saver = std::thread(&RegionStore::run_saver, this);
+}
+
+RegionStore::~RegionStore() {
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx);
+		stopping = true;
+	}
+	pending_cv.notify_all();
+	saver.join();
+
+	if (!flush()) {
+		OutputDebugString("Warn: Couldn't save chunks, their changes are lost.\n");
+	}
+}
+
+std::shared_ptr<RegionFile> RegionStore::get_region(const vmath::ivec2& region_coords) {
+	std::lock_guard<std::mutex> lock(regions_mtx);
+
+	auto search = regions.find(region_coords);
+	if (search != regions.end()) {
+		return search->second;
+	}
+
+	const std::string fname = "r." + std::to_string(region_coords[0]) + "." + std::to_string(region_coords[1]) + ".mc2r";
+	std::shared_ptr<RegionFile> region = std::make_shared<RegionFile>((fs::path(dir) / fname).string());
+	regions[region_coords] = region;
+	return region;
+}
+
+// load chunk at `coords` into `chunk`, if it's been saved
+bool RegionStore::load(const vmath::ivec2& coords, Chunk& chunk) {
+	// not written yet
+	ChunkBytes queued;
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx);
+		const auto search = pending.find(coords);
+		if (search != pending.end()) {
+			queued = search->second;
+		}
+	}
+	if (queued) {
+		if (!chunk.deserialize(queued->data(), queued->size())) {
+			OutputDebugString("Warn: Couldn't read saved chunk, generating it instead.\n");
+			return false;
+		}
+		return true;
+	}
+
+	std::shared_ptr<RegionFile> region = get_region(get_region_coords(coords));
+	std::shared_lock<std::shared_mutex> lock(region->mtx);
+
+	const uint8_t* data;
+	uint32_t size;
+	if (!region->find(get_region_chunk_idx(coords), data, size)) {
+		return false;
+	}
+
+	if (!chunk.deserialize(data, size)) {
+		OutputDebugString("Warn: Couldn't read saved chunk, generating it instead.\n");
+		return false;
+	}
+
+	return true;
+}
+
+// queue chunks for the saver thread
+void RegionStore::save(std::vector<std::pair<vmath::ivec2, std::vector<uint8_t>>>&& chunks) {
+	if (chunks.empty()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx);
+		for (auto& [coords, data] : chunks) {
+			pending[coords] = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+		}
+	}
+	pending_cv.notify_one();
+}
+
+// write everything queued so far
+bool RegionStore::flush() {
+	return write_pending();
+}
+
+// write chunks to their region files
+bool RegionStore::write(const std::vector<std::pair<vmath::ivec2, ChunkBytes>>& chunks) {
+	// group by region, so each file is only opened once
+	std::unordered_map<vmath::ivec2, std::vector<std::pair<int, const std::vector<uint8_t>*>>, vecN_hash> region_chunks;
+	for (const auto& [coords, data] : chunks) {
+		region_chunks[get_region_coords(coords)].push_back({ get_region_chunk_idx(coords), data.get() });
+	}
+
+	bool ok = true;
+	for (const auto& [region_coords, to_write] : region_chunks) {
+		std::shared_ptr<RegionFile> region = get_region(region_coords);
+		std::unique_lock<std::shared_mutex> lock(region->mtx);
+		ok = region->write(to_write) && ok;
+	}
+
+	return ok;
+}
+
+// write pending chunks, then forget the ones that haven't been re-saved since
+bool RegionStore::write_pending() {
+	std::lock_guard<std::mutex> write_lock(write_mtx);
+
+	std::vector<std::pair<vmath::ivec2, ChunkBytes>> to_write;
+	{
+		std::lock_guard<std::mutex> lock(pending_mtx);
+		to_write.assign(pending.begin(), pending.end());
+	}
+
+	if (to_write.empty()) {
+		return true;
+	}
+
+	// if it failed, keep them all (rewriting ones that did make it is harmless)
+	if (!write(to_write)) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(pending_mtx);
+	for (const auto& [coords, data] : to_write) {
+		const auto search = pending.find(coords);
+		if (search != pending.end() && search->second == data) {
+			pending.erase(search);
+		}
+	}
+
+	return true;
+}
+
+// saver thread
+void RegionStore::run_saver() {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(pending_mtx);
+			pending_cv.wait(lock, [this] { return stopping || !pending.empty(); });
+			if (stopping) {
+				return;
+			}
+		}
+
+		if (!write_pending()) {
+			OutputDebugString("Warn: Couldn't save chunks, trying again later.\n");
+
+			std::unique_lock<std::mutex> lock(pending_mtx);
+			pending_cv.wait_for(lock, SAVE_RETRY_DELAY, [this] { return stopping; });
+		}
+	}
+}
+
+RegionStore& get_region_store() {
+	static RegionStore store(get_settings().world_dir);
+	return store;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "chunk.h"
+#include "world_utils.h"
+
+#include "vmath.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+*
+* REGION FILE FORMAT
+*	- chunks are saved in region files of REGION_SIZE x REGION_SIZE chunks, at <world dir>/r.<region x>.<region z>.mc2r
+*	- everything is little-endian
+*
+*	header:
+*		- char[4] magic ("MC2R")
+*		- uint32 version (REGION_VERSION)
+*		- 2 tables, each:
+*			- uint32 generation
+*			- uint32 checksum (FNV-1a of generation and entries)
+*			- REGION_SIZE^2 entries of { uint32 offset, uint32 size }, one per chunk (x + z * REGION_SIZE, relative to region)
+*			  offset = 0 => chunk isn't saved
+*		  the current table is the one with the highest generation whose checksum matches
+*
+*	chunk (at offset, `size` bytes long):
+*		- for each mini, bottom to top:
+*			- blocks, metadata, lighting, each as:
+*				- uint16 num_runs
+*				- num_runs * { uint16 start idx, uint8 value }
+*
+*	saving never overwrites anything the current table points at: chunks are written to space it doesn't use (or appended),
+*	flushed to disk, and only then is a new table written over the other one, and flushed.
+*	so a crash mid-save leaves the file with either the old table or the new one, and both point at whole chunks.
+*
+*	a file with a bad header (or no valid table) is renamed to <file>.bad (.bad1, ...) before anything's saved to that region.
+*
+*/
+constexpr int REGION_SIZE = 32;
+constexpr uint32_t REGION_VERSION = 2;
+
+// how long to wait before trying again when writing saved chunks fails
+constexpr auto SAVE_RETRY_DELAY = std::chrono::seconds(5);
+
+class RegionFile;
+
+// every region file in a world directory
+// thread-safe: chunk gen workers load from it while the world thread saves to it
+// saved chunks are written to disk on a background thread, so saving never blocks the world thread on file IO
+class RegionStore
+{
+public:
+	RegionStore(const std::string& dir_);
+
+	// writes anything still waiting to be written
+	~RegionStore();
+
+	// load chunk at `coords` into `chunk`, if it's been saved (including if it's still waiting to be written)
+	// returns false if it hasn't (or couldn't be read)
+	bool load(const vmath::ivec2& coords, Chunk& chunk);
+
+	// queue chunks to be written, given as (coords, Chunk::serialize() result)
+	// if writing them fails, it's retried every SAVE_RETRY_DELAY, and loads keep seeing them meanwhile
+	void save(std::vector<std::pair<vmath::ivec2, std::vector<uint8_t>>>&& chunks);
+
+	// write everything queued so far, on this thread
+	// returns false if any of it couldn't be written
+	bool flush();
+
+private:
+	using ChunkBytes = std::shared_ptr<const std::vector<uint8_t>>;
+
+	// get region file containing chunk at `coords`
+	std::shared_ptr<RegionFile> get_region(const vmath::ivec2& coords);
+
+	// write chunks to their region files
+	// returns false if any couldn't be written
+	bool write(const std::vector<std::pair<vmath::ivec2, ChunkBytes>>& chunks);
+
+	// write whatever's in `pending`, and forget whatever was written (unless it was re-saved meanwhile)
+	bool write_pending();
+
+	// saver thread: write pending chunks as they come in
+	void run_saver();
+
+private:
+	std::string dir;
+
+	// (region coords) -> region file
+	std::mutex regions_mtx;
+	std::unordered_map<vmath::ivec2, std::shared_ptr<RegionFile>, vecN_hash> regions;
+
+	// (chunk coords) -> latest saved data not written yet
+	std::mutex pending_mtx;
+	std::condition_variable pending_cv;
+	std::unordered_map<vmath::ivec2, ChunkBytes, vecN_hash> pending;
+	bool stopping = false;
+
+	// held for the whole of write_pending(), so older data can never be written after newer data
+	std::mutex write_mtx;
+
+	std::thread saver;
+};
+
+// get the world's region files (see Settings::world_dir)
+RegionStore& get_region_store();
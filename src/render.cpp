@@ -130,31 +130,16 @@ namespace {
 		glCreateVertexArrays(1, &glInfo->vao_quad);
 
 		// vao: enable all Quad's attributes, 1 at a time
-		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_block_type_attr_idx);
-		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_corner1_attr_idx);
-		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_corner2_attr_idx);
-		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_face_attr_idx);
+		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_packed_attr_idx);
 		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_base_coords_attr_idx);
-		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_lighting_attr_idx);
-		glEnableVertexArrayAttrib(glInfo->vao_quad, glInfo->q_metadata_attr_idx);
 
-		// vao: set up formats for Quad's attributes, 1 at a time
-		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_block_type_attr_idx, 1, GL_UNSIGNED_BYTE, offsetof(Quad3D, block));
-		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_corner1_attr_idx, 3, GL_INT, offsetof(Quad3D, corner1));
-		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_corner2_attr_idx, 3, GL_INT, offsetof(Quad3D, corner2));
-		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_face_attr_idx, 3, GL_INT, offsetof(Quad3D, face));
-		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_lighting_attr_idx, 1, GL_UNSIGNED_BYTE, offsetof(Quad3D, lighting));
-		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_metadata_attr_idx, 1, GL_UNSIGNED_BYTE, offsetof(Quad3D, metadata));
+		// vao: set up formats for Quad's attributes (PackedQuad is read as a uvec2, and decoded in render_quads.vs.glsl)
+		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_packed_attr_idx, 2, GL_UNSIGNED_INT, 0);
 
 		glVertexArrayAttribIFormat(glInfo->vao_quad, glInfo->q_base_coords_attr_idx, 3, GL_INT, 0);
 
 		// vao: match attributes to binding indices
-		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_block_type_attr_idx, glInfo->quad_data_bidx);
-		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_corner1_attr_idx, glInfo->quad_data_bidx);
-		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_corner2_attr_idx, glInfo->quad_data_bidx);
-		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_face_attr_idx, glInfo->quad_data_bidx);
-		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_lighting_attr_idx, glInfo->quad_data_bidx);
-		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_metadata_attr_idx, glInfo->quad_data_bidx);
+		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_packed_attr_idx, glInfo->quad_data_bidx);
 
 		glVertexArrayAttribBinding(glInfo->vao_quad, glInfo->q_base_coords_attr_idx, glInfo->q_base_coords_bidx);
 
@@ -6,6 +6,7 @@
 #include "glfw/glfw3.h"
 #include "vmath.h"
 
+#include <cassert>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -99,13 +100,8 @@ struct OpenGLInfo {
 	const GLuint position_attr_idx = 0; // index of 'position' attribute
 	const GLuint chunk_types_attr_idx = 1; // index of 'block_type' attribute
 
-	const GLuint q_block_type_attr_idx = 2;
-	const GLuint q_corner1_attr_idx = 3;
-	const GLuint q_corner2_attr_idx = 4;
-	const GLuint q_face_attr_idx = 5;
+	const GLuint q_packed_attr_idx = 2; // PackedQuad, as a uvec2
 	const GLuint q_base_coords_attr_idx = 6;
-	const GLuint q_lighting_attr_idx = 7;
-	const GLuint q_metadata_attr_idx = 8;
 };
 
 // packed so that quads match quads on GPU
@@ -120,6 +116,70 @@ struct Quad3D {
 };
 #pragma pack(pop)
 
+// index of each face direction in a PackedQuad: (axis * 2) + (1 if it points backwards)
+// i.e. +x, -x, +y, -y, +z, -z
+inline int face_to_idx(const vmath::ivec3& face) {
+	const int axis = face[0] != 0 ? 0 : face[1] != 0 ? 1 : 2;
+	return axis * 2 + (face[axis] < 0 ? 1 : 0);
+}
+
+inline vmath::ivec3 idx_to_face(const int face_idx) {
+	vmath::ivec3 result = { 0, 0, 0 };
+	result[face_idx >> 1] = (face_idx & 1) ? -1 : 1;
+	return result;
+}
+
+// Quad3D in 8 bytes, which is how quads are stored in meshes and sent to the GPU
+// (render_quads.vs.glsl decodes it -- keep the two in sync)
+// corners are mini-relative, so each coordinate fits in 5 bits (0-16)
+//   corners: corner1.xyz (bits 0-14), corner2.xyz (bits 15-29)
+//   attrs:   face idx (bits 0-2, see face_to_idx), block (3-10), lighting (11-18), metadata (19-22)
+struct PackedQuad {
+	uint32_t corners;
+	uint32_t attrs;
+
+	static inline PackedQuad encode(const Quad3D& quad) {
+		PackedQuad result;
+		result.corners = 0;
+		for (int i = 0; i < 3; i++) {
+			assert(0 <= quad.corner1[i] && quad.corner1[i] <= 16 && 0 <= quad.corner2[i] && quad.corner2[i] <= 16 && "quad corner outside of mini");
+			result.corners |= quad.corner1[i] << (5 * i);
+			result.corners |= quad.corner2[i] << (5 * i + 15);
+		}
+		assert(quad.metadata < 16 && "metadata doesn't fit in 4 bits");
+		result.attrs = face_to_idx(quad.face) | (quad.block << 3) | (quad.lighting << 11) | ((quad.metadata & 0xF) << 19);
+		return result;
+	}
+
+	inline Quad3D decode() const {
+		Quad3D result;
+		result.block = block();
+		result.corner1 = corner1();
+		result.corner2 = corner2();
+		result.face = idx_to_face(face_idx());
+		result.lighting = (attrs >> 11) & 0xFF;
+		result.metadata = (attrs >> 19) & 0xF;
+		return result;
+	}
+
+	inline vmath::ivec3 corner1() const {
+		return { int(corners & 0x1F), int((corners >> 5) & 0x1F), int((corners >> 10) & 0x1F) };
+	}
+
+	inline vmath::ivec3 corner2() const {
+		return { int((corners >> 15) & 0x1F), int((corners >> 20) & 0x1F), int((corners >> 25) & 0x1F) };
+	}
+
+	inline int face_idx() const {
+		return attrs & 0x7;
+	}
+
+	inline uint8_t block() const {
+		return (attrs >> 3) & 0xFF;
+	}
+};
+static_assert(sizeof(PackedQuad) == 8, "PackedQuad should be 8 bytes");
+
 void setup_glfw(GlfwInfo*, GLFWwindow**);
 void setup_opengl(GlfwInfo*, OpenGLInfo*);
 void fix_tjunctions(OpenGLInfo* glInfo, GlfwInfo *windowInfo, GLuint fbo_out, FBO& fbo_in);
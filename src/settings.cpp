@@ -0,0 +1,56 @@
+#include "settings.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+
+// read a positive int from an environment variable, or use default_value if it isn't set/valid
+static int env_int(const char* name, const int default_value) {
+	const char* value = std::getenv(name);
+	if (value == nullptr) {
+		return default_value;
+	}
+
+	const int result = std::atoi(value);
+	return result > 0 ? result : default_value;
+}
+
+// read a flag (0 = off, anything else = on) from an environment variable, or use default_value if it isn't set
+static bool env_bool(const char* name, const bool default_value) {
+	const char* value = std::getenv(name);
+	if (value == nullptr || value[0] == '\0') {
+		return default_value;
+	}
+
+	return std::atoi(value) != 0;
+}
+
+// read a non-empty string from an environment variable, or use default_value if it isn't set
+static std::string env_string(const char* name, const std::string& default_value) {
+	const char* value = std::getenv(name);
+	if (value == nullptr || value[0] == '\0') {
+		return default_value;
+	}
+
+	return value;
+}
+
+static Settings load_settings() {
+	// hardware_concurrency() is allowed to return 0 if it doesn't know
+	const int num_cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	Settings settings;
+	settings.num_chunk_gen_threads = env_int("MC2_CHUNK_GEN_THREADS", std::max(1, (num_cores - 1) / 3));
+	settings.num_mesh_gen_threads = env_int("MC2_MESH_GEN_THREADS", std::max(1, num_cores - 1 - settings.num_chunk_gen_threads));
+	settings.chunk_memory_budget_mb = env_int("MC2_CHUNK_MEMORY_MB", 512);
+	settings.mesh_memory_budget_mb = env_int("MC2_MESH_MEMORY_MB", 512);
+	settings.world_dir = env_string("MC2_WORLD_DIR", "world");
+	settings.cave_culling = env_bool("MC2_CAVE_CULLING", true);
+	return settings;
+}
+
+const Settings& get_settings() {
+	static const Settings settings = load_settings();
+	return settings;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+// Runtime settings
+// Loaded once on first use. Each one can be overridden with an environment variable (e.g. MC2_MESH_GEN_THREADS=4).
+struct Settings {
+	// number of chunk gen worker threads (MC2_CHUNK_GEN_THREADS)
+	// defaults to a third of the cores not used by the render thread
+	int num_chunk_gen_threads;
+
+	// number of mesh gen worker threads (MC2_MESH_GEN_THREADS)
+	// defaults to the rest of the cores not used by the render thread
+	int num_mesh_gen_threads;
+
+	// memory budget for loaded chunks, in MB (MC2_CHUNK_MEMORY_MB)
+	// past this, chunks outside render distance are unloaded least-recently-nearby first
+	int chunk_memory_budget_mb;
+
+	// memory budget for chunk meshes, in MB (MC2_MESH_MEMORY_MB)
+	// past this, meshes outside render distance are unloaded least-recently-nearby first
+	int mesh_memory_budget_mb;
+
+	// directory to save the world's region files in, relative to the working directory (MC2_WORLD_DIR)
+	std::string world_dir;
+
+	// whether to skip drawing minis that can't be seen through the minis in between, e.g. caves behind solid rock
+	// (MC2_CAVE_CULLING, 0 to turn off)
+	bool cave_culling;
+};
+
+// get the current settings
+const Settings& get_settings();
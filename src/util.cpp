@@ -142,6 +142,23 @@ bool sphere_in_frustum(const vmath::vec3& pos, const float radius, const vmath::
 	return res;
 }
 
+// check if axis-aligned box is at least partly inside frustum planes
+// (it's outside if even its corner furthest along a plane's normal is behind that plane)
+bool box_in_frustum(const vmath::vec3& min, const vmath::vec3& max, const vmath::vec4(&frustum_planes)[6])
+{
+	for (auto& plane : frustum_planes) {
+		float dist = plane[3];
+		for (int i = 0; i < 3; i++) {
+			dist += plane[i] * (plane[i] > 0 ? max[i] : min[i]);
+		}
+		if (dist < 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 void WindowsException(const char* description)
 {
 	MessageBox(NULL, description, "Thrown exception", MB_OK);
@@ -5,6 +5,7 @@
 #include "imgui.h"
 #include "vmath.h"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
@@ -14,7 +15,6 @@
 #include <map>
 #include <memory>
 #include <numeric>
-#include <queue>
 #include <random>
 #include <string>
 #include <tuple>
@@ -66,6 +66,9 @@ void extract_planes_from_projmat(const vmath::mat4& proj_mat, const vmath::mat4&
 // check if sphere is inside frustum planes
 bool sphere_in_frustum(const vmath::vec3& pos, const float radius, const vmath::vec4(&frustum_planes)[6]);
 
+// check if axis-aligned box is at least partly inside frustum planes
+bool box_in_frustum(const vmath::vec3& min, const vmath::vec3& max, const vmath::vec4(&frustum_planes)[6]);
+
 void WindowsException(const char* description);
 
 // generate all points in a circle a center
@@ -396,45 +399,140 @@ public:
 	}
 };
 
-template<
-	class T,
-	class Container = std::vector<T>,
-	class Compare = std::less<typename Container::value_type>
->
-class priority_queue_hacker : public std::priority_queue<T, Container, Compare>
+// Same interface as IntervalMap, but runs are stored as (start, value) pairs in one sorted, contiguous array.
+// Lookups are a branchless binary search over a few cache lines, and edits splice the array in-place,
+// so there's no pointer-chasing and no per-interval allocations.
+template <typename K, typename V>
+class FlatIntervalMap
 {
+private:
+	using run_type = std::pair<K, V>;
+	std::vector<run_type> runs;
+
+	// index of the run containing key `k`
+	// runs[0].first is always the lowest K, so there's always one
+	// O(log N), branchless
+	inline size_t find_run(const K& k) const {
+		const run_type* base = runs.data();
+		size_t n = runs.size();
+
+		while (n > 1) {
+			const size_t half = n / 2;
+			base = (base[half].first <= k) ? base + half : base;
+			n -= half;
+		}
+
+		return base - runs.data();
+	}
+
 public:
-	Container& get_c()
-	{
-		return this->c;
+	inline FlatIntervalMap() : FlatIntervalMap(0) {}
+
+	// create interval map with default v
+	inline FlatIntervalMap(const V& v) {
+		clear(v);
 	}
 
-	Compare& get_comp()
-	{
-		return this->comp;
+	// map [begin, end) -> v
+	// O(log N) search + O(N) memmove in the worst case
+	void set_interval(const K& begin, const K& end, const V& v) {
+		if (begin >= end) return;
+
+		// runs containing begin and end
+		const size_t begin_idx = find_run(begin);
+		const size_t end_idx = find_run(end);
+
+		// value that must continue from `end` onwards
+		const V end_v = runs[end_idx].second;
+
+		// every run starting inside [begin, end] gets replaced
+		const size_t del_start = runs[begin_idx].first < begin ? begin_idx + 1 : begin_idx;
+		const size_t del_end = end_idx + 1;
+
+		// figure out what replaces them (at most 2 runs)
+		run_type replacement[2];
+		size_t num_replacement = 0;
+
+		// start a new run at `begin`, unless previous run already has value `v`
+		if (del_start == 0 || runs[del_start - 1].second != v) {
+			replacement[num_replacement++] = { begin, v };
+		}
+
+		// restart the old value at `end`, unless it's the same as `v`
+		if (end_v != v) {
+			replacement[num_replacement++] = { end, end_v };
+		}
+
+		// splice them in, moving the tail at most once
+		const size_t num_deleted = del_end - del_start;
+		if (num_replacement <= num_deleted) {
+			std::copy(replacement, replacement + num_replacement, runs.begin() + del_start);
+			runs.erase(runs.begin() + del_start + num_replacement, runs.begin() + del_end);
+		}
+		else {
+			std::copy(replacement, replacement + num_deleted, runs.begin() + del_start);
+			runs.insert(runs.begin() + del_end, replacement + num_deleted, replacement + num_replacement);
+		}
 	}
-};
 
-template<class T, class Container, class Compare>
-void update_pq_priorities(std::priority_queue<T, Container, Compare>& pq, std::function<void(T&)>& update)
-{
-	// Get container
-	priority_queue_hacker<T, Container, Compare> hacker;
-	hacker.swap(pq);
-	Container& c = hacker.get_c();
+	// iterator which traverses elements in sorted order (smallest to largest)
+	// O(1)
+	inline auto begin() {
+		return runs.begin();
+	}
 
-	// Update priorities
-	for (auto& entry : c)
-	{
-		update(entry);
+	inline auto begin() const {
+		return runs.begin();
 	}
 
-	// Fix heap
-	std::make_heap(c.begin(), c.end(), hacker.get_comp());
+	// end of elements
+	// O(1)
+	inline auto end() {
+		return runs.end();
+	}
 
-	// Stick it back in
-	pq.swap(hacker);
-}
+	inline auto end() const {
+		return runs.end();
+	}
+
+	// get iterator containing key `k`
+	// O(log N)
+	inline auto get_interval(K const& k) {
+		return runs.begin() + find_run(k);
+	}
+
+	inline auto get_interval(K const& k) const {
+		return runs.begin() + find_run(k);
+	}
+
+	// get value at key `k`
+	// O(log N)
+	const inline V& operator[](K const& k) const {
+		return runs[find_run(k)].second;
+	}
+
+	// clear
+	inline void clear(V const& v) {
+		runs.clear();
+		runs.push_back({ std::numeric_limits<K>::lowest(), v });
+	}
+
+	// get num intervals overall
+	// always at least 1
+	inline auto num_intervals() const {
+		return runs.size();
+	}
+
+	// get number of intervals in a range
+	inline auto num_intervals(const K& start, const K& end) const {
+		return find_run(end) - find_run(start);
+	}
+
+	// heap memory used (bytes)
+	inline size_t memory_usage() const {
+		return runs.capacity() * sizeof(run_type);
+	}
+};
 
 // Destructor for GLFWwindow, allows you to use GLFWwindow* with a smart pointer.
 // TODO: Just write an object-oriented wrapper class for GLFWwindow that handles this.
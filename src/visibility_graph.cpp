@@ -0,0 +1,94 @@
+#include "visibility_graph.h"
+
+#include "chunk.h"
+#include "minichunk.h"
+#include "render.h"
+#include "util.h"
+#include "world_utils.h"
+
+#include "vmath.h"
+
+#include <algorithm>
+#include <vector>
+
+
+// set which faces of a mini connect through it
+void VisibilityGraph::set_connections(const vmath::ivec3& coords, const FaceConnections& connections) {
+	this->connections[coords] = connections;
+}
+
+// forget minis too far from the player
+void VisibilityGraph::unload(const vmath::ivec2& player_chunk_coords, const int render_distance) {
+	for (auto iter = connections.begin(); iter != connections.end();) {
+		if (should_unload_chunk({ iter->first[0], iter->first[2] }, player_chunk_coords, render_distance)) {
+			iter = connections.erase(iter);
+		}
+		else {
+			++iter;
+		}
+	}
+}
+
+// BFS out from the camera's mini
+void VisibilityGraph::update(const vmath::vec3& camera_pos, const vmath::vec4(&planes)[6], const int render_distance) {
+	visible.clear();
+	queue.clear();
+
+	const vmath::ivec2 camera_chunk = get_chunk_coords(camera_pos[0], camera_pos[2]);
+
+	// start in camera's mini (or, above/below the world, the closest one, as if we came in through its top/bottom)
+	vmath::ivec3 start = { camera_chunk[0], static_cast<int>(floorf(camera_pos[1] / MINICHUNK_HEIGHT)) * MINICHUNK_HEIGHT, camera_chunk[1] };
+	int entered_through = -1;
+	if (start[1] >= CHUNK_HEIGHT) {
+		start[1] = CHUNK_HEIGHT - MINICHUNK_HEIGHT;
+		entered_through = face_to_idx({ 0, 1, 0 });
+	}
+	else if (start[1] < 0) {
+		start[1] = 0;
+		entered_through = face_to_idx({ 0, -1, 0 });
+	}
+
+	visible.insert(start);
+	queue.push_back({ start, entered_through, 0 });
+
+	for (size_t i = 0; i < queue.size(); i++) {
+		const Step step = queue[i];
+
+		const auto search = connections.find(step.coords);
+		const FaceConnections conns = search == connections.end() ? FaceConnections::all() : search->second;
+
+		for (int face = 0; face < 6; face++) {
+			// never head back towards the camera
+			if (step.directions & (1 << opposite_face(face))) {
+				continue;
+			}
+
+			// can't see from where we came in to this face
+			if (step.entered_through >= 0 && !conns.connected(step.entered_through, face)) {
+				continue;
+			}
+
+			// neighbor through this face
+			const vmath::ivec3 dir = idx_to_face(face);
+			const vmath::ivec3 next = step.coords + vmath::ivec3(dir[0], dir[1] * MINICHUNK_HEIGHT, dir[2]);
+			if (next[1] < 0 || next[1] >= CHUNK_HEIGHT) {
+				continue;
+			}
+			if (vmath::distance(vmath::ivec2(next[0], next[2]), camera_chunk) > render_distance) {
+				continue;
+			}
+			if (visible.contains(next)) {
+				continue;
+			}
+
+			const vmath::vec3 min = { static_cast<float>(next[0] * CHUNK_WIDTH), static_cast<float>(next[1]), static_cast<float>(next[2] * CHUNK_DEPTH) };
+			const vmath::vec3 max = min + vmath::vec3(CHUNK_WIDTH, MINICHUNK_HEIGHT, CHUNK_DEPTH);
+			if (!box_in_frustum(min, max, planes)) {
+				continue;
+			}
+
+			visible.insert(next);
+			queue.push_back({ next, opposite_face(face), static_cast<uint8_t>(step.directions | (1 << face)) });
+		}
+	}
+}
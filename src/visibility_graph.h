@@ -0,0 +1,51 @@
+#pragma once
+
+#include "face_connections.h"
+#include "util.h"
+
+#include "vmath.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Cave culling: which minis might be visible from the camera, going by which of their faces connect through them
+// BFS out from the camera's mini, where a step from a mini out through one of its faces is only allowed if:
+//   - that face connects to the face we came in through (see FaceConnections)
+//   - it isn't back towards the camera (i.e. opposite to a step already taken on the way here)
+//   - the mini it leads to is in the frustum, and within render distance
+// Minis we haven't heard about yet (e.g. not meshed) count as see-through, so we never hide something that might be visible.
+class VisibilityGraph
+{
+public:
+	// set which faces of mini at `coords` connect through it
+	void set_connections(const vmath::ivec3& coords, const FaceConnections& connections);
+
+	// forget minis too far from the player (see should_unload_chunk)
+	void unload(const vmath::ivec2& player_chunk_coords, const int render_distance);
+
+	// work out which minis might be visible from `camera_pos` (real coords)
+	void update(const vmath::vec3& camera_pos, const vmath::vec4(&planes)[6], const int render_distance);
+
+	// whether mini at `coords` might be visible, as of the last update()
+	inline bool is_visible(const vmath::ivec3& coords) const {
+		return visible.contains(coords);
+	}
+
+	inline size_t num_visible() const {
+		return visible.size();
+	}
+
+private:
+	// BFS step: mini, which of its faces we came in through (-1 = camera's in it), and which directions we've stepped in so far
+	struct Step {
+		vmath::ivec3 coords;
+		int entered_through;
+		uint8_t directions;
+	};
+
+	std::unordered_map<vmath::ivec3, FaceConnections, vecN_hash> connections;
+	std::unordered_set<vmath::ivec3, vecN_hash> visible;
+	std::vector<Step> queue; // kept around to reuse the memory
+};
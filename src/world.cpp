@@ -1,17 +1,22 @@
 #include "world.h"
 
+#include "block_accessor.h"
 #include "contiguous_hashmap.h"
 #include "chunk.h"
 #include "chunkdata.h"
 #include "messaging.h"
 #include "minichunkmesh.h"
+#include "region.h"
 #include "render.h"
+#include "settings.h"
 #include "shapes.h"
 #include "util.h"
+#include "world_meshing.h"
 
 #include "vmath.h"
-#include "zmq_addon.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
@@ -30,17 +35,16 @@
 // radius from center of minichunk that must be included in view frustum
 constexpr float FRUSTUM_MINI_RADIUS_ALLOWANCE = 28.0f;
 
-WorldDataPart::WorldDataPart(std::shared_ptr<zmq::context_t> ctx_) : bus(ctx_)
+WorldDataPart::WorldDataPart() : mailbox(msg::get_mailboxes().world)
 {
-#ifdef _DEBUG
-	bus.out.setsockopt(ZMQ_SUBSCRIBE, "", 0);
-#else
-	for (const auto& m : msg::world_thread_incoming)
-	{
-		// TODO: Upgrade zmq and replace this with .set()
-		bus.out.setsockopt(ZMQ_SUBSCRIBE, m.c_str(), m.size());
+}
+
+WorldDataPart::~WorldDataPart()
+{
+	save_chunks();
+	if (!get_region_store().flush()) {
+		OutputDebugString("Warn: Couldn't save chunks.\n");
 	}
-#endif // _DEBUG
 }
 
 // update tick to *new_tick*
@@ -66,41 +70,222 @@ void WorldDataPart::update_tick(const int new_tick) {
 		water_propagation_queue.pop();
 		propagate_water(xyz[0], xyz[1], xyz[2]);
 	}
+
+	// stop waiting on neighbors that haven't shown up
+	for (const auto& coords : mesh_readiness.pop_added_before(current_tick - MESH_NEIGHBOR_TIMEOUT_TICKS)) {
+		enqueue_chunk_mesh_gen(coords);
+	}
+
+	// save every now and then
+	if (current_tick - last_save_tick >= SAVE_INTERVAL_TICKS) {
+		save_chunks();
+	}
+}
+
+// queue every chunk that changed since it was last saved to be written to disk
+void WorldDataPart::save_chunks() {
+	last_save_tick = current_tick;
+	if (unsaved_chunks.empty()) {
+		return;
+	}
+
+	std::vector<std::pair<vmath::ivec2, std::vector<uint8_t>>> to_save;
+	to_save.reserve(unsaved_chunks.size());
+	for (const auto& coords : unsaved_chunks) {
+		std::shared_ptr<Chunk> chunk = get_chunk(coords);
+		if (chunk) {
+			to_save.push_back({ coords, chunk->serialize() });
+		}
+	}
+
+	// written on the region store's saver thread (which retries if it fails)
+	get_region_store().save(std::move(to_save));
+	unsaved_chunks.clear();
+}
+
+// unload chunks too far from the player, then least-recently-nearby ones until we're within the memory budget
+void WorldDataPart::unload_chunks(const vmath::ivec2& player_chunk_coords, const int render_distance) {
+	this->player_chunk_coords = player_chunk_coords;
+	this->render_distance = render_distance;
+
+	const size_t budget = static_cast<size_t>(get_settings().chunk_memory_budget_mb) * 1024 * 1024;
+	size_t memory_usage = 0;
+
+	// (last used, coords) of chunks we can unload if we're over budget
+	std::vector<std::pair<int, vmath::ivec2>> candidates;
+	std::vector<vmath::ivec2> to_unload;
+
+	for (const auto& [coords, chunk] : chunk_map) {
+		if (should_unload_chunk(coords, player_chunk_coords, render_distance)) {
+			to_unload.push_back(coords);
+			continue;
+		}
+
+		memory_usage += chunk->memory_usage();
+		if (vmath::distance(coords, player_chunk_coords) <= render_distance) {
+			chunk_last_used[coords] = current_tick;
+		}
+		else {
+			candidates.push_back({ chunk_last_used[coords], coords });
+		}
+	}
+
+	// over budget, so unload least recently used first
+	if (memory_usage > budget) {
+		std::sort(candidates.begin(), candidates.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+		for (const auto& [last_used, coords] : candidates) {
+			if (memory_usage <= budget) {
+				break;
+			}
+
+			memory_usage -= chunk_map[coords]->memory_usage();
+			to_unload.push_back(coords);
+		}
+	}
+
+	if (to_unload.empty()) {
+		recenter_chunk_ring();
+		return;
+	}
+
+	// save unsaved chunks before they're gone
+	// (until they're written, the region store loads them from memory, so they can't come back stale)
+	std::vector<std::pair<vmath::ivec2, std::vector<uint8_t>>> to_save;
+	for (const auto& coords : to_unload) {
+		if (unsaved_chunks.erase(coords)) {
+			to_save.push_back({ coords, chunk_map[coords]->serialize() });
+		}
+	}
+	get_region_store().save(std::move(to_save));
+
+	// drop them
+	for (const auto& coords : to_unload) {
+		chunk_ring.set(coords, nullptr);
+		chunk_map.erase(coords);
+		chunk_last_used.erase(coords);
+		mesh_readiness.remove(coords);
+		dropped_meshes.erase(coords);
+	}
+
+	recenter_chunk_ring();
+}
+
+// center chunk ring on player, adding whichever loaded chunks came into it
+void WorldDataPart::recenter_chunk_ring() {
+	chunk_ring.recenter(player_chunk_coords, render_distance + UNLOAD_DISTANCE_MARGIN, [this](const vmath::ivec2& coords) -> std::shared_ptr<Chunk> {
+		const auto search = chunk_map.find(coords);
+		return search == chunk_map.end() ? nullptr : search->second;
+	});
 }
 
 // enqueue mesh generation of this mini
 // expects mesh lock
-void WorldDataPart::enqueue_mesh_gen(std::shared_ptr<MiniChunk> mini, const bool front_of_queue) {
+void WorldDataPart::enqueue_mesh_gen(std::shared_ptr<MiniChunk> mini, const RequestClass request_class, const MeshLayers& layers) {
 	assert(mini != nullptr && "seriously?");
+	msg::get_mailboxes().mesher.push(Envelope(make_mesh_gen_request(*mini, request_class, layers)));
+}
 
-	// check if mini in set
-	MeshGenRequest* req = new MeshGenRequest();
-	req->coords = mini->get_coords();
-	req->data = std::make_shared<MeshGenRequestData>();
-	req->data->self = mini;
-
-#define ADD(ATTR, DIRECTION)\
-		{\
-			std::shared_ptr<MiniChunk> minip_ = get_mini(mini->get_coords() + DIRECTION);\
-			req->data->ATTR = minip_;\
-		}
-
-	ADD(up, IUP * 16);
-	ADD(down, IDOWN * 16);
-	ADD(east, IEAST);
-	ADD(west, IWEST);
-	ADD(north, INORTH);
-	ADD(south, ISOUTH);
-#undef ADD
-
-	// TODO: Figure out how to do zero-copy messaging since we don't need to copy msg::MESH_GEN_REQ (it's static const)
-	std::vector<zmq::const_buffer> message({
-		zmq::buffer(msg::MESH_GEN_REQUEST),
-		zmq::buffer(&req, sizeof(req))
-		});
+// snapshot mini and its neighbors into a mesh gen request
+std::unique_ptr<MeshGenRequest> WorldDataPart::make_mesh_gen_request(const MiniChunk& mini, const RequestClass request_class, const MeshLayers& layers) {
+	// snapshot it and its neighbors, so the mesher never touches the world
+	// (neighbors are only borrowed for the duration of this call)
+	const vmath::ivec3 coords = mini.get_coords();
+	std::unique_ptr<MeshGenRequest> req(gen_mesh_gen_request(mini, get_mini(coords + IUP * 16).get(), get_mini(coords + IDOWN * 16).get(),
+		get_mini(coords + INORTH).get(), get_mini(coords + ISOUTH).get(), get_mini(coords + IEAST).get(), get_mini(coords + IWEST).get(), layers));
+	req->request_class = request_class;
+	return req;
+}
+
+// mesh chunk that was just loaded, and/or neighbors that were waiting on it
+// a chunk is meshed once all 4 of its neighbors are here (or aren't coming), so its walls are right the first time
+void WorldDataPart::on_chunk_loaded(const vmath::ivec2& coords) {
+	uint8_t present = 0;
+
+	for (int i = 0; i < 4; i++) {
+		const vmath::ivec2 neighbor_coords = coords + CHUNK_NEIGHBORS[i];
+		if (!find_chunk(neighbor_coords)) {
+			// not coming => don't wait for it (if it does come, it'll remesh our wall facing it)
+			if (!in_generation_range(neighbor_coords)) {
+				present |= 1 << i;
+			}
+			continue;
+		}
+		present |= 1 << i;
+
+		// we're neighbor (i ^ 1) of it
+		const int opposite = i ^ 1;
+		if (mesh_readiness.is_waiting(neighbor_coords)) {
+			if (mesh_readiness.neighbor_loaded(neighbor_coords, opposite)) {
+				enqueue_chunk_mesh_gen(neighbor_coords);
+			}
+		}
+		// already meshed without us => only its wall facing us changed
+		else {
+			const int layers_idx = opposite < 2 ? 0 : 2;
+			const int layer_no = opposite & 1 ? 0 : MINICHUNK_WIDTH - 1;
+			enqueue_chunk_mesh_gen(neighbor_coords, MeshLayers::single(layers_idx, layer_no));
+		}
+	}
+
+	if (mesh_readiness.add(coords, present, current_tick)) {
+		enqueue_chunk_mesh_gen(coords);
+	}
+}
+
+// enqueue mesh generation of every mini in chunk at `coords` (if it's loaded)
+void WorldDataPart::enqueue_chunk_mesh_gen(const vmath::ivec2& coords, const MeshLayers& layers, const uint16_t minis) {
+	Chunk* chunk = find_chunk(coords);
+	if (!chunk || !minis) {
+		return;
+	}
+
+	// send them all in one message
+	msg::MeshGenRequests reqs;
+	reqs.reserve(std::popcount(minis));
+	for (int i = 0; i < MINIS_PER_CHUNK; i++) {
+		if (minis & (1 << i)) {
+			reqs.emplace_back(make_mesh_gen_request(*chunk->minis[i], RequestClass::Background, layers));
+		}
+	}
+	msg::get_mailboxes().mesher.push(std::move(reqs));
+}
+
+// remember to remesh minis the renderer dropped the meshes of, or remesh them now if they're in range
+void WorldDataPart::on_meshes_dropped(const std::vector<vmath::ivec3>& coords) {
+	std::unordered_map<vmath::ivec2, uint16_t, vecN_hash> remesh_now;
+
+	for (const auto& mini_coords : coords) {
+		const vmath::ivec2 chunk_coords = { mini_coords[0], mini_coords[2] };
+
+		// unloaded => it'll be meshed when it's loaded again anyway
+		if (!find_chunk(chunk_coords)) {
+			continue;
+		}
+
+		const uint16_t mini_bit = 1 << (mini_coords[1] / MINICHUNK_HEIGHT);
+		if (in_generation_range(chunk_coords)) {
+			remesh_now[chunk_coords] |= mini_bit;
+		}
+		else {
+			dropped_meshes[chunk_coords] |= mini_bit;
+		}
+	}
+
+	for (const auto& [chunk_coords, minis] : remesh_now) {
+		enqueue_chunk_mesh_gen(chunk_coords, MeshLayers::all(), minis);
+	}
+}
+
+// whether chunk at `coords` is within the distance we generate chunks at (see gen_nearby_chunks)
+bool WorldDataPart::in_generation_range(const vmath::ivec2& coords) const {
+	// don't know yet => assume it is
+	if (render_distance < 0) {
+		return true;
+	}
 
-	auto ret = zmq::send_multipart(bus.in, message, zmq::send_flags::dontwait);
-	assert(ret);
+	// same test as gen_circle, without the sqrt
+	const vmath::ivec2 diff = coords - player_chunk_coords;
+	return diff[0] * diff[0] + diff[1] * diff[1] <= render_distance * render_distance;
 }
 
 // add chunk to chunk coords (x, z)
@@ -118,6 +303,8 @@ void WorldDataPart::add_chunk(const int x, const int z, std::shared_ptr<Chunk> c
 		throw "Wew";
 	}
 	chunk_map[coords] = chunk;
+	chunk_ring.set(coords, chunk);
+	chunk_last_used[coords] = current_tick;
 }
 
 // generate chunks if they don't exist yet
@@ -132,6 +319,14 @@ void WorldDataPart::gen_chunks_if_required(const vector<vmath::ivec2>& chunk_coo
 		if (search == chunk_map.end()) {
 			to_generate.insert(coords);
 		}
+		// if renderer dropped some of its meshes while it was out of range, need to remesh them
+		else if (!dropped_meshes.empty()) {
+			const auto dropped = dropped_meshes.find(coords);
+			if (dropped != dropped_meshes.end()) {
+				enqueue_chunk_mesh_gen(coords, MeshLayers::all(), dropped->second);
+				dropped_meshes.erase(dropped);
+			}
+		}
 	}
 
 	if (to_generate.size() > 0) {
@@ -141,26 +336,27 @@ void WorldDataPart::gen_chunks_if_required(const vector<vmath::ivec2>& chunk_coo
 
 // generate multiple chunks
 void WorldDataPart::gen_chunks(const std::unordered_set<vmath::ivec2, vecN_hash>& to_generate) {
-	// Instead of generating chunks ourselves, we request the ChunkGenThread to do it for us.
-	// TODO: Send one request with a vector of coords?
+	// Instead of generating chunks ourselves, we request the ChunkGenThread to do it for us (all in one message).
+	msg::ChunkGenRequests reqs;
+	reqs.reserve(to_generate.size());
 	for (const vmath::ivec2& coords : to_generate)
 	{
-		ChunkGenRequest* req = new ChunkGenRequest;
-		req->coords = coords;
-		std::vector<zmq::const_buffer> message({
-			zmq::buffer(msg::CHUNK_GEN_REQUEST),
-			zmq::buffer(&req, sizeof(req))
-			});
+		ChunkGenRequest& req = reqs.emplace_back();
+		req.coords = coords;
 
-		auto ret = zmq::send_multipart(bus.in, message, zmq::send_flags::dontwait);
-		assert(ret);
+		// player might be standing in it
+		req.request_class = vmath::distance(coords, player_chunk_coords) <= 1 ? RequestClass::Interactive : RequestClass::Background;
 	}
 
-	return;
+	msg::get_mailboxes().chunker.push(std::move(reqs));
 }
 
 // get chunk or nullptr (using cache) (TODO: LRU?)
 std::shared_ptr<Chunk> WorldDataPart::get_chunk(const int x, const int z) {
+	if (chunk_ring.in_window({ x, z })) {
+		return chunk_ring.get_shared({ x, z });
+	}
+
 	const auto search = chunk_map.find({ x, z });
 
 	// if doesn't exist, return null
@@ -173,16 +369,30 @@ std::shared_ptr<Chunk> WorldDataPart::get_chunk(const int x, const int z) {
 
 std::shared_ptr<Chunk> WorldDataPart::get_chunk(const vmath::ivec2& xz) { return get_chunk(xz[0], xz[1]); }
 
+// remember chunk at `coords` changed, so it gets saved
+void WorldDataPart::mark_unsaved(const vmath::ivec2& coords) {
+	unsaved_chunks.insert(coords);
+}
+
+// get chunk or nullptr, without sharing ownership
+Chunk* WorldDataPart::find_chunk(const vmath::ivec2& xz) const {
+	if (chunk_ring.in_window(xz)) {
+		return chunk_ring.get(xz);
+	}
+
+	const auto search = chunk_map.find(xz);
+	return search == chunk_map.end() ? nullptr : search->second.get();
+}
+
 // get mini or nullptr
 std::shared_ptr<MiniChunk> WorldDataPart::get_mini(const int x, const int y, const int z) {
-	const auto search = chunk_map.find({ x, z });
+	Chunk* chunk = find_chunk({ x, z });
 
 	// if chunk doesn't exist, return null
-	if (search == chunk_map.end()) {
+	if (chunk == nullptr) {
 		return nullptr;
 	}
 
-	std::shared_ptr<Chunk> chunk = search->second;
 	return chunk->get_mini_with_y_level((y / 16) * 16); // TODO: Just y % 16?
 }
 
@@ -244,7 +454,7 @@ std::vector<std::shared_ptr<MiniChunk>> WorldDataPart::get_minis_touching_block(
 // get a block's type
 // inefficient when called repeatedly - if you need multiple blocks from one mini/chunk, use get_mini (or get_chunk) and mini.get_block.
 BlockType WorldDataPart::get_type(const int x, const int y, const int z) {
-	std::shared_ptr<Chunk> chunk = get_chunk_containing_block(x, z);
+	Chunk* chunk = find_chunk({ x >> 4, z >> 4 });
 
 	if (!chunk) {
 		return BlockType::Air;
@@ -258,6 +468,30 @@ BlockType WorldDataPart::get_type(const int x, const int y, const int z) {
 BlockType WorldDataPart::get_type(const vmath::ivec3& xyz) { return get_type(xyz[0], xyz[1], xyz[2]); }
 BlockType WorldDataPart::get_type(const vmath::ivec4& xyz_) { return get_type(xyz_[0], xyz_[1], xyz_[2]); }
 
+// check if a block is solid, using its mini's solidity bitmask
+// unloaded/out-of-range blocks are non-solid
+bool WorldDataPart::is_solid(const int x, const int y, const int z) {
+	if (y < BLOCK_MIN_HEIGHT || y > BLOCK_MAX_HEIGHT) {
+		return false;
+	}
+
+	Chunk* chunk = find_chunk({ x >> 4, z >> 4 });
+	if (!chunk) {
+		return false;
+	}
+
+	// no need to share ownership just to read one bit
+	const MiniChunk* mini = chunk->minis[y / MINICHUNK_HEIGHT].get();
+	if (!mini) {
+		return false;
+	}
+
+	return mini->is_solid(get_mini_relative_coords(x, y, z));
+}
+
+bool WorldDataPart::is_solid(const vmath::ivec3& xyz) { return is_solid(xyz[0], xyz[1], xyz[2]); }
+bool WorldDataPart::is_solid(const vmath::ivec4& xyz_) { return is_solid(xyz_[0], xyz_[1], xyz_[2]); }
+
 // set a block's type
 // inefficient when called repeatedly
 void WorldDataPart::set_type(const int x, const int y, const int z, const BlockType& val) {
@@ -269,16 +503,130 @@ void WorldDataPart::set_type(const int x, const int y, const int z, const BlockT
 
 	const vmath::ivec3 chunk_coords = get_chunk_relative_coordinates(x, y, z);
 	chunk->set_block(chunk_coords, val);
+	unsaved_chunks.insert(chunk->coords);
 }
 
 void WorldDataPart::set_type(const vmath::ivec3& xyz, const BlockType& val) { return set_type(xyz[0], xyz[1], xyz[2], val); }
 void WorldDataPart::set_type(const vmath::ivec4& xyz_, const BlockType& val) { return set_type(xyz_[0], xyz_[1], xyz_[2], val); }
 
+void WorldDataPart::fill_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& val) {
+	edit_box(min_xyz, max_xyz, [&val](Chunk& chunk, const vmath::ivec3& chunk_min, const vmath::ivec3& chunk_max) {
+		return chunk.fill_box(chunk_min, chunk_max, val);
+	});
+}
+
+void WorldDataPart::replace_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& from, const BlockType& to) {
+	edit_box(min_xyz, max_xyz, [&from, &to](Chunk& chunk, const vmath::ivec3& chunk_min, const vmath::ivec3& chunk_max) {
+		return chunk.replace_in_box(chunk_min, chunk_max, from, to);
+	});
+}
+
+void WorldDataPart::paste(const Schematic& schematic, const vmath::ivec3& origin) {
+	edit_box(origin, origin + schematic.size - vmath::ivec3(1, 1, 1), [&schematic, &origin](Chunk& chunk, const vmath::ivec3&, const vmath::ivec3&) {
+		const vmath::ivec3 chunk_base = { chunk.coords[0] * CHUNK_WIDTH, 0, chunk.coords[1] * CHUNK_DEPTH };
+		return chunk.paste(schematic, origin - chunk_base);
+	});
+}
+
+// run `edit` on every loaded chunk overlapping [min_xyz, max_xyz], then remesh and schedule water once for the whole box
+// edit: (chunk, chunk-relative min, chunk-relative max) -> mask of modified minis
+void WorldDataPart::edit_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const std::function<uint16_t(Chunk&, const vmath::ivec3&, const vmath::ivec3&)>& edit) {
+	assert(min_xyz[0] <= max_xyz[0] && min_xyz[1] <= max_xyz[1] && min_xyz[2] <= max_xyz[2] && "invalid box");
+
+	const int min_y = std::max(min_xyz[1], BLOCK_MIN_HEIGHT);
+	const int max_y = std::min(max_xyz[1], BLOCK_MAX_HEIGHT);
+	if (min_y > max_y) {
+		return;
+	}
+
+	// minis to remesh
+	std::unordered_set<vmath::ivec3, vecN_hash> to_remesh;
+
+	const vmath::ivec2 min_chunk = get_chunk_coords(min_xyz[0], min_xyz[2]);
+	const vmath::ivec2 max_chunk = get_chunk_coords(max_xyz[0], max_xyz[2]);
+
+	for (int chunk_x = min_chunk[0]; chunk_x <= max_chunk[0]; chunk_x++) {
+		for (int chunk_z = min_chunk[1]; chunk_z <= max_chunk[1]; chunk_z++) {
+			std::shared_ptr<Chunk> chunk = get_chunk(chunk_x, chunk_z);
+
+			// for now, don't care if something was done in an unloaded chunk
+			if (!chunk) {
+				continue;
+			}
+
+			// clip box to chunk
+			const vmath::ivec3 chunk_base = { chunk_x * CHUNK_WIDTH, 0, chunk_z * CHUNK_DEPTH };
+			const vmath::ivec3 chunk_min = {
+				std::max(min_xyz[0] - chunk_base[0], 0),
+				min_y,
+				std::max(min_xyz[2] - chunk_base[2], 0),
+			};
+			const vmath::ivec3 chunk_max = {
+				std::min(max_xyz[0] - chunk_base[0], CHUNK_WIDTH - 1),
+				max_y,
+				std::min(max_xyz[2] - chunk_base[2], CHUNK_DEPTH - 1),
+			};
+
+			const uint16_t modified = edit(*chunk, chunk_min, chunk_max);
+			if (modified) {
+				unsaved_chunks.insert(chunk->coords);
+			}
+
+			// remesh modified minis, plus neighbors whose shared face is inside the box
+			for (int i = 0; i < MINIS_PER_CHUNK; i++) {
+				if (!(modified & (1 << i))) {
+					continue;
+				}
+
+				const vmath::ivec3 mini_coords = { chunk_x, i * MINICHUNK_HEIGHT, chunk_z };
+				const int mini_min_y = std::max(min_y - i * MINICHUNK_HEIGHT, 0);
+				const int mini_max_y = std::min(max_y - i * MINICHUNK_HEIGHT, MINICHUNK_HEIGHT - 1);
+
+				to_remesh.insert(mini_coords);
+				if (chunk_min[0] == 0) to_remesh.insert(mini_coords + IWEST);
+				if (chunk_max[0] == CHUNK_WIDTH - 1) to_remesh.insert(mini_coords + IEAST);
+				if (mini_min_y == 0 && i > 0) to_remesh.insert(mini_coords + IDOWN * MINICHUNK_HEIGHT);
+				if (mini_max_y == MINICHUNK_HEIGHT - 1 && i < MINIS_PER_CHUNK - 1) to_remesh.insert(mini_coords + IUP * MINICHUNK_HEIGHT);
+				if (chunk_min[2] == 0) to_remesh.insert(mini_coords + INORTH);
+				if (chunk_max[2] == CHUNK_DEPTH - 1) to_remesh.insert(mini_coords + ISOUTH);
+			}
+		}
+	}
+
+	// nothing changed
+	if (to_remesh.empty()) {
+		return;
+	}
+
+	for (const auto& mini_coords : to_remesh) {
+		std::shared_ptr<MiniChunk> mini = get_mini(mini_coords);
+		if (mini != nullptr) {
+			enqueue_mesh_gen(mini, RequestClass::Interactive);
+		}
+	}
+
+	// water only needs to react at the box's shell (its outer layer, plus neighbors on the sides/below)
+	for (int y = min_y - 1; y <= max_y; y++) {
+		for (int z = min_xyz[2] - 1; z <= max_xyz[2] + 1; z++) {
+			for (int x = min_xyz[0] - 1; x <= max_xyz[0] + 1; x++) {
+				const bool inside =
+					min_xyz[0] < x && x < max_xyz[0] &&
+					min_y < y && y < max_y &&
+					min_xyz[2] < z && z < max_xyz[2];
+
+				if (!inside) {
+					schedule_water_propagation({ x, y, z });
+				}
+			}
+		}
+	}
+}
+
 // when a mini updates, update its and its neighbors' meshes, if required.
 // mini: the mini that changed
-// block: the mini-coordinates of the block that was added/deleted
-// TODO: Use block.
-void WorldDataPart::on_mini_update(std::shared_ptr<MiniChunk> mini, const vmath::ivec3& block) {
+// block: the coordinates of the block that was added/deleted
+// only the layers around the block get remeshed (see MeshLayers::around_block)
+void WorldDataPart::on_mini_update(std::shared_ptr<MiniChunk> mini, const vmath::ivec3& block, const RequestClass request_class) {
 	// for now, don't care if something was done in an unloaded mini
 	if (mini == nullptr) {
 		return;
@@ -288,12 +636,12 @@ void WorldDataPart::on_mini_update(std::shared_ptr<MiniChunk> mini, const vmath:
 	const auto neighbors = get_minis_touching_block(block[0], block[1], block[2]);
 	for (auto& neighbor : neighbors) {
 		if (neighbor != mini) {
-			enqueue_mesh_gen(neighbor, true);
+			enqueue_mesh_gen(neighbor, request_class, MeshLayers::around_block(block - neighbor->real_coords()));
 		}
 	}
 
 	// regenerate own meshes
-	enqueue_mesh_gen(mini, true);
+	enqueue_mesh_gen(mini, request_class, MeshLayers::around_block(block - mini->real_coords()));
 
 	// finally, add nearby waters to propagation queue
 	// TODO: do this smarter?
@@ -302,10 +650,10 @@ void WorldDataPart::on_mini_update(std::shared_ptr<MiniChunk> mini, const vmath:
 }
 
 // update meshes
-void WorldDataPart::on_block_update(const vmath::ivec3& block) {
+void WorldDataPart::on_block_update(const vmath::ivec3& block, const RequestClass request_class) {
 	std::shared_ptr<MiniChunk> mini = get_mini_containing_block(block[0], block[1], block[2]);
 	vmath::ivec3 mini_coords = get_mini_relative_coords(block[0], block[1], block[2]);
-	on_mini_update(mini, block);
+	on_mini_update(mini, block, request_class);
 }
 
 void WorldDataPart::destroy_block(const int x, const int y, const int z) {
@@ -313,6 +661,7 @@ void WorldDataPart::destroy_block(const int x, const int y, const int z) {
 	std::shared_ptr<MiniChunk> mini = get_mini_containing_block(x, y, z);
 	const vmath::ivec3 mini_coords = get_mini_relative_coords(x, y, z);
 	mini->set_block(mini_coords, BlockType::Air);
+	unsaved_chunks.insert({ mini->get_coords()[0], mini->get_coords()[2] });
 
 	// regenerate textures for all neighboring minis (TODO: This should be a maximum of 3 neighbors, since >=3 sides of the destroyed block are facing its own mini.)
 	on_mini_update(mini, { x, y, z });
@@ -325,6 +674,7 @@ void WorldDataPart::add_block(const int x, const int y, const int z, const Block
 	std::shared_ptr<MiniChunk> mini = get_mini_containing_block(x, y, z);
 	const vmath::ivec3& mini_coords = get_mini_relative_coords(x, y, z);
 	mini->set_block(mini_coords, block);
+	unsaved_chunks.insert({ mini->get_coords()[0], mini->get_coords()[2] });
 
 	// regenerate textures for all neighboring minis (TODO: This should be a maximum of 3 neighbors, since the block always has at least 3 sides inside its mini.)
 	on_mini_update(mini, { x, y, z });
@@ -334,7 +684,7 @@ void WorldDataPart::add_block(const vmath::ivec3& xyz, const BlockType& block) {
 
 // TODO
 Metadata WorldDataPart::get_metadata(const int x, const int y, const int z) {
-	std::shared_ptr<Chunk> chunk = get_chunk_containing_block(x, z);
+	Chunk* chunk = find_chunk({ x >> 4, z >> 4 });
 
 	if (!chunk) {
 		return 0;
@@ -358,6 +708,7 @@ void WorldDataPart::set_metadata(const int x, const int y, const int z, const Me
 
 	vmath::ivec3 chunk_coords = get_chunk_relative_coordinates(x, y, z);
 	chunk->set_metadata(chunk_coords, val);
+	unsaved_chunks.insert(chunk->coords);
 }
 
 void WorldDataPart::set_metadata(const vmath::ivec3& xyz, const Metadata& val) { return set_metadata(xyz[0], xyz[1], xyz[2], val); }
@@ -380,14 +731,17 @@ void WorldDataPart::schedule_water_propagation_neighbors(const vmath::ivec3& xyz
 void WorldDataPart::propagate_water(int x, int y, int z) {
 	vmath::ivec3 coords = { x, y, z };
 
-	// get chunk which block is in, and if it's unloaded, don't both propagating
-	auto chunk = get_chunk_containing_block(x, z);
-	if (chunk == nullptr) {
+	// get mini which block is in, and if it's unloaded, don't both propagating
+	BlockAccessor center(*this, coords);
+	if (!center.loaded()) {
 		return;
 	}
 
+	// everything we look at is right next to us, so resolve those minis once
+	const BlockNeighborhood around = center.gather();
+
 	// get block at propagation location
-	auto block = get_type(x, y, z);
+	auto block = around.get_type({ 0, 0, 0 });
 
 	// if we're air or flowing water, adjust height
 	if (block == BlockType::Air || block == BlockType::FlowingWater) {
@@ -397,19 +751,19 @@ void WorldDataPart::propagate_water(int x, int y, int z) {
 		OutputDebugString(buf);
 #endif // _DEBUG
 
-		uint8_t water_level = block == BlockType::FlowingWater ? get_metadata(x, y, z).get_liquid_level() : block == BlockType::StillWater ? 7 : 0;
+		uint8_t water_level = block == BlockType::FlowingWater ? around.get_metadata({ 0, 0, 0 }).get_liquid_level() : block == BlockType::StillWater ? 7 : 0;
 		uint8_t new_water_level = water_level;
 
 		// if water on top, max height
-		auto top_block = get_type(coords + IUP);
+		auto top_block = around.get_type(IUP);
 		if (top_block == BlockType::StillWater || top_block == BlockType::FlowingWater) {
 			// update water level if needed
 			new_water_level = 7; // max
 			if (new_water_level != water_level) {
-				set_type(x, y, z, BlockType::FlowingWater);
-				set_metadata(x, y, z, new_water_level);
+				center.set_type(BlockType::FlowingWater);
+				center.set_metadata(new_water_level);
 				schedule_water_propagation_neighbors(coords);
-				on_block_update(coords);
+				on_block_update(coords, RequestClass::Water);
 			}
 			return;
 		}
@@ -421,12 +775,12 @@ void WorldDataPart::propagate_water(int x, int y, int z) {
 		auto directions = { INORTH, ISOUTH, IEAST, IWEST };
 		for (auto& ddir : directions) {
 			// BEAUTIFUL - don't inherit height from nearby water UNLESS it's ON A SOLID BLOCK!
-			BlockType under_side_block = get_type(coords + ddir + IDOWN);
+			BlockType under_side_block = around.get_type(ddir + IDOWN);
 			if (under_side_block.is_nonsolid()) {
 				continue;
 			}
 
-			BlockType side_block = get_type(coords + ddir);
+			BlockType side_block = around.get_type(ddir);
 
 			// if side block is still, its level is max
 			if (side_block == BlockType::StillWater) {
@@ -436,7 +790,7 @@ void WorldDataPart::propagate_water(int x, int y, int z) {
 
 			// if side block is flowing, update highest side water
 			else if (side_block == BlockType::FlowingWater) {
-				auto side_water_level = get_metadata(coords + ddir).get_liquid_level();
+				auto side_water_level = around.get_metadata(ddir).get_liquid_level();
 				if (side_water_level > highest_side_water) {
 					highest_side_water = side_water_level;
 					if (side_water_level == 7) {
@@ -453,16 +807,16 @@ void WorldDataPart::propagate_water(int x, int y, int z) {
 		if (new_water_level != water_level) {
 			// if water level in range, set it
 			if (0 <= new_water_level && new_water_level <= 7) {
-				set_type(x, y, z, BlockType::FlowingWater);
-				set_metadata(x, y, z, new_water_level);
+				center.set_type(BlockType::FlowingWater);
+				center.set_metadata(new_water_level);
 				schedule_water_propagation_neighbors(coords);
-				on_block_update(coords);
+				on_block_update(coords, RequestClass::Water);
 			}
 			// otherwise destroy water
 			else if (block == BlockType::FlowingWater) {
-				set_type(x, y, z, BlockType::Air);
+				center.set_type(BlockType::Air);
 				schedule_water_propagation_neighbors(coords);
-				on_block_update(coords);
+				on_block_update(coords, RequestClass::Water);
 			}
 		}
 	}
@@ -483,21 +837,24 @@ std::unordered_set<vmath::ivec3, vecN_hash> WorldDataPart::find_shortest_water_p
 	constexpr unsigned goal = 2;
 
 	static_assert(radius > 0);
-	uint8_t extracted[radius * 2 - 1][radius * 2 - 1];
+	uint8_t extracted[radius * 2 + 1][radius * 2 + 1];
 	memset(extracted, invalid_path, sizeof(extracted));
 
 	// for every block in radius
-	for (int dx = -radius; dx <= radius; dx++) {
-		for (int dz = -radius; dz <= radius; dz++) {
+	// walk it with one accessor, so we only look up the (at most 4) chunks it spans once each
+	BlockAccessor block(*this, coords);
+	for (int dx = -(int)radius; dx <= (int)radius; dx++) {
+		for (int dz = -(int)radius; dz <= (int)radius; dz++) {
 			// if the block is empty
-			if (get_type(x + dx, y, z + dz) == BlockType::Air) {
+			block.move_to({ x + dx, y, z + dz });
+			if (block.get_type() == BlockType::Air) {
 				// if the block below it is solid, it's a valid path to take
-				if (get_type(x + dx, y - 1, z + dz).is_solid()) {
-					extracted[x + dx][z + dz] = valid_path;
+				if (block.down().get_type().is_solid()) {
+					extracted[dx + radius][dz + radius] = valid_path;
 				}
 				// if the block below it is non-solid, it's a goal
 				else {
-					extracted[x + dx][z + dz] = goal;
+					extracted[dx + radius][dz + radius] = goal;
 				}
 			}
 		}
@@ -607,13 +964,14 @@ float WorldDataPart::get_water_height(const vmath::ivec3& corner) {
 	vector<float> water_height_factors;
 	water_height_factors.reserve(4);
 
+	BlockAccessor accessor(*this, corner);
 	for (int i = 0; i < 4; i++) {
 		const int dx = (i % 1 == 0) ? 0 : -1; //  0, -1,  0, -1
 		const int dz = (i / 2 == 0) ? 0 : -1; //  0,  0, -1, -1
 
-		const vmath::ivec3 block_coords = corner + vmath::ivec3(dx, 0, dz);
-		const BlockType block = get_type(block_coords);
-		const Metadata metadata = get_metadata(block_coords);
+		accessor.move_to(corner + vmath::ivec3(dx, 0, dz));
+		const BlockType block = accessor.get_type();
+		const Metadata metadata = accessor.get_metadata();
 
 		switch ((BlockType::Value)block) {
 		case BlockType::Air:
@@ -646,63 +1004,44 @@ float WorldDataPart::get_water_height(const vmath::ivec3& corner) {
 void WorldDataPart::handle_messages()
 {
 	// Receive all messages
-	std::vector<zmq::message_t> message;
-	auto ret = zmq::recv_multipart(bus.out, std::back_inserter(message), zmq::recv_flags::dontwait);
-	while (ret)
+	msg::WorldMessage message;
+	while (mailbox.try_pop(message))
 	{
 		// Get chunk gen response
-		if (message[0].to_string_view() == msg::CHUNK_GEN_RESPONSE)
+		if (auto envelope = std::get_if<Envelope<ChunkGenResponse>>(&message))
 		{
 			// Extract result
-			ChunkGenResponse* response_ = *message[1].data<ChunkGenResponse*>();
-			std::unique_ptr<ChunkGenResponse> response(response_);
+			std::unique_ptr<ChunkGenResponse> response = envelope->open();
 
 			// Get the chunk
 			std::shared_ptr<Chunk> chunk = std::move(response->chunk);
 			assert(chunk);
+			chunk_latency[static_cast<int>(response->request_class)].add(response->requested_at);
 
-			// make sure it's not a duplicate
-			if (get_chunk(chunk->coords))
-			{
-				OutputDebugStringA("Warn: Duplicate chunk generated.\n");
-			}
-			else
-			{
-				add_chunk(response->coords[0], response->coords[1], chunk);
-			}
-
-			// Now we must enqueue all minis and neighboring minis for meshing
-			for (int i = 0; i < MINIS_PER_CHUNK; i++)
+			// drop it if the player moved away while it was being generated
+			const bool too_far = render_distance >= 0 && should_unload_chunk(chunk->coords, player_chunk_coords, render_distance);
+			if (!too_far)
 			{
-				enqueue_mesh_gen(chunk->minis[i]);
-			}
+				// make sure it's not a duplicate
+				if (get_chunk(chunk->coords))
+				{
+					OutputDebugStringA("Warn: Duplicate chunk generated.\n");
+				}
+				else
+				{
+					// (not saved until it's edited, since it'd just be generated the same way again)
+					add_chunk(response->coords[0], response->coords[1], chunk);
 
-			std::shared_ptr<Chunk> c;
-#define ENQUEUE(chunk_ivec2)\
-			c = get_chunk(chunk_ivec2);\
-			if (c)\
-			{\
-				for (int i = 0; i < MINIS_PER_CHUNK; i++)\
-				{\
-					enqueue_mesh_gen(c->minis[i]);\
-				}\
+					// mesh it (and neighbors waiting on it) once they're all here
+					on_chunk_loaded(chunk->coords);
+				}
 			}
-
-			ENQUEUE(chunk->coords + vmath::ivec2(1, 0));
-			ENQUEUE(chunk->coords + vmath::ivec2(-1, 0));
-			ENQUEUE(chunk->coords + vmath::ivec2(0, 1));
-			ENQUEUE(chunk->coords + vmath::ivec2(0, -1));
-#undef ENQUEUE
 		}
-		else
+		// renderer dropped meshes of chunks we still have
+		else if (auto event = std::get_if<MeshesDroppedEvent>(&message))
 		{
-#ifndef _DEBUG
-			WindowsException("unknown message");
-#endif // _DEBUG
+			on_meshes_dropped(event->coords);
 		}
-
-		message.clear();
-		ret = zmq::recv_multipart(bus.out, std::back_inserter(message), zmq::recv_flags::dontwait);
 	}
 }
 
@@ -770,18 +1109,8 @@ constexpr  float liquid_level_to_height(int liquid_level) {
 }
 */
 
-World::World(std::shared_ptr<zmq::context_t> ctx_) : data(ctx_), last_update_time(0), bus(ctx_)
+World::World() : last_update_time(0)
 {
-	// TODO: Move bus out of WorldDataPart
-#ifdef _DEBUG
-	bus.out.setsockopt(ZMQ_SUBSCRIBE, "", 0);
-#else
-	for (const auto& m : msg::world_thread_incoming)
-	{
-		// TODO: Upgrade zmq and replace this with .set()
-		bus.out.setsockopt(ZMQ_SUBSCRIBE, m.c_str(), m.size());
-	}
-#endif // _DEBUG
 }
 
 void World::update_world(float time) {
@@ -804,18 +1133,15 @@ void World::update_world(float time) {
 
 	// update last chunk coords
 	const auto chunk_coords = get_chunk_coords((int)floorf(player.coords[0]), (int)floorf(player.coords[2]));
-	if (chunk_coords != player.chunk_coords) {
+	if (chunk_coords != player.chunk_coords || player.render_distance != last_render_distance) {
 		player.chunk_coords = chunk_coords;
+		last_render_distance = player.render_distance;
 
 		// Notify listeners that last chunk coords have changed
-		std::vector<zmq::const_buffer> result({
-			zmq::buffer(msg::EVENT_PLAYER_MOVED_CHUNKS),
-			zmq::buffer(&player.chunk_coords, sizeof(player.chunk_coords))
-			});
-		auto ret = zmq::send_multipart(bus.in, result, zmq::send_flags::dontwait);
-		assert(ret);
-
-		// Remember to generate nearby chunks
+		msg::send_player_moved({ player.chunk_coords, player.render_distance });
+
+		// Unload far away chunks, and remember to generate nearby ones
+		data.unload_chunks(player.chunk_coords, player.render_distance);
 		player.should_check_for_nearby_chunks = true;
 	}
 
@@ -828,8 +1154,7 @@ void World::update_world(float time) {
 	// update block that player is staring at
 	const auto direction = player.staring_direction();
 	raycast(player.coords + vmath::vec4(0, CAMERA_HEIGHT, 0, 0), direction, 40, &player.staring_at, &player.staring_at_face, [this](const vmath::ivec3& coords, const vmath::ivec3& face) {
-		const auto block = this->data.get_type(coords);
-		return block.is_solid();
+		return this->data.is_solid(coords);
 		});
 
 	// make sure rendering didn't take too long
@@ -950,11 +1275,19 @@ void World::update_player_movement(const float dt) {
 vmath::vec4 World::prevent_collisions(const vmath::vec4& position_change) {
 	// TODO: prioritize removing velocity that won't change our position when snapping.
 
+	// the blocks we check are all right next to the player, so walk them with one accessor
+	const vmath::ivec4 ipos = vec2ivec(player.coords);
+	BlockAccessor accessor(data, vmath::ivec3(ipos[0], ipos[1], ipos[2]));
+	const auto nonsolid = [&accessor](const vmath::ivec4& block_coords) {
+		accessor.move_to(block_coords);
+		return !accessor.is_solid();
+	};
+
 	// Get all blocks we might be intersecting with
 	auto blocks = get_player_intersecting_blocks(player.coords + position_change);
 
 	// if all blocks are non-solid, we done
-	if (all_of(begin(blocks), end(blocks), [this](const auto& block_coords) { auto block = data.get_type(block_coords); return block.is_nonsolid(); })) {
+	if (all_of(begin(blocks), end(blocks), nonsolid)) {
 		return position_change;
 	}
 
@@ -973,7 +1306,7 @@ vmath::vec4 World::prevent_collisions(const vmath::vec4& position_change) {
 		blocks = get_player_intersecting_blocks(player.coords + position_change_fixed);
 
 		// if all blocks are non-solid, we done
-		if (all_of(begin(blocks), end(blocks), [this](const auto& block_coords) { auto block = data.get_type(block_coords); return block.is_nonsolid(); })) {
+		if (all_of(begin(blocks), end(blocks), nonsolid)) {
 			return position_change_fixed;
 		}
 	}
@@ -998,7 +1331,7 @@ vmath::vec4 World::prevent_collisions(const vmath::vec4& position_change) {
 		blocks = get_player_intersecting_blocks(player.coords + position_change_fixed);
 
 		// if all blocks are air, we done
-		if (all_of(begin(blocks), end(blocks), [this](const auto& block_coords) { auto block = data.get_type(block_coords); return block.is_nonsolid(); })) {
+		if (all_of(begin(blocks), end(blocks), nonsolid)) {
 			return position_change_fixed;
 		}
 	}
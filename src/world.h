@@ -1,12 +1,13 @@
 #pragma once
 
 #include "chunk.h"
+#include "chunk_ring.h"
+#include "mesh_readiness.h"
 #include "player.h"
 #include "world_utils.h"
 
 #include "messaging.h"
 #include "vmath.h"
-#include "zmq.hpp"
 
 #include <memory>
 #include <queue>
@@ -20,10 +21,19 @@
 
 using namespace std;
 
+// how often unsaved chunks get written to disk
+constexpr int SAVE_INTERVAL_TICKS = 20 * 30;
+
+// how long a loaded chunk waits for its neighbors before it's meshed anyway
+constexpr int MESH_NEIGHBOR_TIMEOUT_TICKS = 20;
+
 class WorldDataPart
 {
 public:
-	WorldDataPart(std::shared_ptr<zmq::context_t> ctx_);
+	WorldDataPart();
+
+	// saves any unsaved chunks, and waits until they're written
+	~WorldDataPart();
 
 	// map of (chunk coordinate) -> chunk
 	std::unordered_map<vmath::ivec2, std::shared_ptr<Chunk>, vecN_hash> chunk_map;
@@ -41,9 +51,21 @@ public:
 	// update tick to *new_tick*
 	void update_tick(const int new_tick);
 
+	// queue every chunk that changed since it was last saved to be written to disk (see RegionStore::save)
+	void save_chunks();
+
+	// unload chunks too far from the player (see should_unload_chunk), then, if we're over the memory budget,
+	// chunks outside render distance that were least recently within it
+	// unsaved chunks are saved first
+	void unload_chunks(const vmath::ivec2& player_chunk_coords, const int render_distance);
+
 	// enqueue mesh generation of this mini
+	// layers: which layers to remesh (e.g. just the ones around an edited block)
 	// expects mesh lock
-	void enqueue_mesh_gen(std::shared_ptr<MiniChunk> mini, const bool front_of_queue = false);
+	void enqueue_mesh_gen(std::shared_ptr<MiniChunk> mini, const RequestClass request_class = RequestClass::Background, const MeshLayers& layers = MeshLayers::all());
+
+	// snapshot mini and its neighbors into a mesh gen request
+	std::unique_ptr<MeshGenRequest> make_mesh_gen_request(const MiniChunk& mini, const RequestClass request_class, const MeshLayers& layers);
 
 	// add chunk to chunk coords (x, z)
 	void add_chunk(const int x, const int z, std::shared_ptr<Chunk> chunk);
@@ -58,6 +80,13 @@ public:
 	std::shared_ptr<Chunk> get_chunk(const int x, const int z);
 	std::shared_ptr<Chunk> get_chunk(const vmath::ivec2& xz);
 
+	// remember chunk at `coords` changed, so it gets saved
+	void mark_unsaved(const vmath::ivec2& coords);
+
+	// get chunk or nullptr, without sharing ownership
+	// near the player this is a ChunkRing lookup, elsewhere (far-away physics/water/raycasts) it falls back to chunk_map
+	Chunk* find_chunk(const vmath::ivec2& xz) const;
+
 	// get mini or nullptr
 	std::shared_ptr<MiniChunk> get_mini(const int x, const int y, const int z);
 	std::shared_ptr<MiniChunk> get_mini(const vmath::ivec3& xyz);
@@ -80,20 +109,34 @@ public:
 	BlockType get_type(const vmath::ivec3& xyz);
 	BlockType get_type(const vmath::ivec4& xyz_);
 
+	// check if a block is solid, using its mini's solidity bitmask
+	// unloaded/out-of-range blocks are non-solid
+	bool is_solid(const int x, const int y, const int z);
+	bool is_solid(const vmath::ivec3& xyz);
+	bool is_solid(const vmath::ivec4& xyz_);
+
 	// set a block's type
 	// inefficient when called repeatedly
 	void set_type(const int x, const int y, const int z, const BlockType& val);
 	void set_type(const vmath::ivec3& xyz, const BlockType& val);
 	void set_type(const vmath::ivec4& xyz_, const BlockType& val);
 
+	// bulk edits
+	// boxes are inclusive and in world coordinates
+	// each mini is edited once, and each modified mini (plus neighbors touching the box) is remeshed once
+	void fill_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& val);
+	void replace_in_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& from, const BlockType& to);
+	void paste(const Schematic& schematic, const vmath::ivec3& origin);
+
 	// when a mini updates, update its and its neighbors' meshes, if required.
 	// mini: the mini that changed
-	// block: the mini-coordinates of the block that was added/deleted
-	// TODO: Use block.
-	void on_mini_update(std::shared_ptr<MiniChunk> mini, const vmath::ivec3& block);
+	// block: the coordinates of the block that was added/deleted
+	// only the layers around the block get remeshed (see MeshLayers::around_block)
+	// request_class: what made the change (player, water, ...)
+	void on_mini_update(std::shared_ptr<MiniChunk> mini, const vmath::ivec3& block, const RequestClass request_class = RequestClass::Interactive);
 
 	// update meshes
-	void on_block_update(const vmath::ivec3& block);
+	void on_block_update(const vmath::ivec3& block, const RequestClass request_class = RequestClass::Interactive);
 
 	void destroy_block(const int x, const int y, const int z);
 
@@ -129,17 +172,68 @@ public:
 	// For a certain corner, get height of flowing water at that corner
 	float get_water_height(const vmath::ivec3& corner);
 
-	// Handle any messages on the message bus
+	// Handle any messages in our mailbox
 	void handle_messages();
 
+	// how long chunk gen requests of each class took to come back
+	inline const RequestLatency& get_chunk_latency(const RequestClass request_class) const {
+		return chunk_latency[static_cast<int>(request_class)];
+	}
+
 private:
-	BusNode bus;
+	Mailbox<msg::WorldMessage>& mailbox;
+
+	// chunks near the player, so looking them up doesn't need hashing
+	// holds a subset of chunk_map, re-centered on the player in unload_chunks()
+	ChunkRing chunk_ring;
+
+	// center chunk ring on player, adding whichever loaded chunks came into it
+	void recenter_chunk_ring();
+
+	// loaded chunks waiting on their neighbors before being meshed
+	MeshReadiness mesh_readiness;
+
+	// mesh chunk that was just loaded, and/or neighbors that were waiting on it
+	void on_chunk_loaded(const vmath::ivec2& coords);
+
+	// enqueue mesh generation of every mini in chunk at `coords` (if it's loaded)
+	// minis: mask of which of its minis to mesh
+	void enqueue_chunk_mesh_gen(const vmath::ivec2& coords, const MeshLayers& layers = MeshLayers::all(), const uint16_t minis = 0xFFFF);
+
+	// (chunk coords) -> mask of its minis the renderer dropped the meshes of (see MeshesDroppedEvent), to remesh once in range
+	std::unordered_map<vmath::ivec2, uint16_t, vecN_hash> dropped_meshes;
+
+	// remember to remesh minis the renderer dropped the meshes of, or remesh them now if they're in range
+	void on_meshes_dropped(const std::vector<vmath::ivec3>& coords);
+
+	// whether chunk at `coords` is within the distance we generate chunks at
+	bool in_generation_range(const vmath::ivec2& coords) const;
+
+	// chunks that were edited since they were last saved
+	// (generated chunks aren't saved until they're edited, since generating them again gives the same result)
+	std::unordered_set<vmath::ivec2, vecN_hash> unsaved_chunks;
+
+	// tick we last saved at
+	int last_save_tick = 0;
+
+	// (chunk coords) -> last tick chunk was within render distance, for picking chunks to unload
+	std::unordered_map<vmath::ivec2, int, vecN_hash> chunk_last_used;
+
+	// player's position as of the last unload_chunks(), so we can drop generated chunks that are already too far away
+	vmath::ivec2 player_chunk_coords = { 0, 0 };
+	int render_distance = -1; // -1 = unknown
+
+	RequestLatency chunk_latency[NUM_REQUEST_CLASSES];
+
+	// run `edit` on every loaded chunk overlapping [min_xyz, max_xyz], then remesh and schedule water once for the whole box
+	// edit: (chunk, chunk-relative min, chunk-relative max) -> mask of modified minis
+	void edit_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const std::function<uint16_t(Chunk&, const vmath::ivec3&, const vmath::ivec3&)>& edit);
 };
 
 class World
 {
 public:
-	World(std::shared_ptr<zmq::context_t> ctx_);
+	World();
 
 	void update_world(float time);
 	void update_player_movement(const float dt);
@@ -151,5 +245,7 @@ public:
 
 private:
 	float last_update_time;
-	BusNode bus;
+
+	// render distance as of the last EVENT_PLAYER_MOVED_CHUNKS (-1 = never sent)
+	int last_render_distance = -1;
 };
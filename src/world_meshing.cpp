@@ -3,19 +3,26 @@
 #include "render.h"
 
 #include "vmath.h"
-#include "zmq.hpp"
 
+#include <emmintrin.h>
+
+#include <bit>
+#include <cstring>
 #include <vector>
 
 // Private functions
 std::vector<Quad3D> quads_2d_3d(const std::vector<Quad2D>& quads2d, const int layers_idx, const int layer_no, const vmath::ivec3& face);
-void gen_layer_generalized(const std::shared_ptr<MiniChunk> mini, const std::shared_ptr<MiniChunk> face_mini, const int layers_idx, const int layer_no, const vmath::ivec3 face, BlockType(&result)[16][16]);
 bool is_face_visible(const BlockType& block, const BlockType& face_block);
-void gen_layer(const std::shared_ptr<MeshGenRequest> req, const int layers_idx, const int layer_no, const vmath::ivec3& face, BlockType(&result)[16][16]);
+void gen_layer(const PaddedBlocks& padded, const int layers_idx, const int layer_no, const vmath::ivec3& face, BlockType(&result)[16][16]);
 std::vector<Quad2D> gen_quads(const BlockType(&layer)[16][16], /* const Metadata(&metadata_layer)[16][16], */ bool(&merged)[16][16]);
 void mark_as_merged(bool(&merged)[16][16], const vmath::ivec2& start, const vmath::ivec2& max_size);
 vmath::ivec2 get_max_size(const BlockType(&layer)[16][16], const bool(&merged)[16][16], const vmath::ivec2& start_point, const BlockType& block_type);
-bool check_if_covered(std::shared_ptr<MeshGenRequest> req);
+bool check_if_covered(const MiniChunk& self, const MiniChunk* up, const MiniChunk* down, const MiniChunk* north, const MiniChunk* south, const MiniChunk* east, const MiniChunk* west);
+void copy_padded_layer(const MiniChunk& mini, const int layers_idx, const int layer_no, const int padded_layer_no, PaddedBlocks& padded);
+void add_layer_quads(MiniChunkMesh& mesh, std::vector<Quad2D>& quads2d, const int layers_idx, const int layer_no, const vmath::ivec3& face);
+void gen_face(const int i, int& layers_idx, vmath::ivec3& face);
+void transpose16(uint16_t(&rows)[16]);
+std::vector<Quad2D> gen_quads_binary(const uint8_t(&layer)[16][16], const uint16_t(&visible)[16]);
 
 constexpr void gen_working_indices(const int& layers_idx, int& working_idx_1, int& working_idx_2) {
 	switch (layers_idx) {
@@ -35,51 +42,77 @@ constexpr void gen_working_indices(const int& layers_idx, int& working_idx_1, in
 	return;
 }
 
-bool check_if_covered(std::shared_ptr<MeshGenRequest> req) {
+bool check_if_covered(const MiniChunk& self, const MiniChunk* up, const MiniChunk* down, const MiniChunk* north, const MiniChunk* south, const MiniChunk* east, const MiniChunk* west) {
 	// if contains any translucent blocks, don't know how to handle that yet
 	// TODO?
-	if (req->data->self->any_translucent()) {
+	if (!self.all_opaque()) {
 		return false;
 	}
 
-	// none are air, so only check outside blocks
-	for (int miniY = 0; miniY < MINICHUNK_HEIGHT; miniY++) {
-		for (int miniZ = 0; miniZ < MINICHUNK_DEPTH; miniZ++) {
-			for (int miniX = 0; miniX < MINICHUNK_WIDTH; miniX++) {
-				const auto& mini_coords = req->data->self->get_coords();
-				const vmath::ivec3 coords = { mini_coords[0] * MINICHUNK_WIDTH + miniX, mini_coords[1] + miniY,  mini_coords[2] * MINICHUNK_DEPTH + miniZ };
-
-				// if along east wall, check east
-				if (miniX == MINICHUNK_WIDTH - 1) {
-					if (req->data->east && req->data->east->get_block(get_mini_relative_coords(coords)).is_translucent()) return false;
-				}
-				// if along west wall, check west
-				if (miniX == 0) {
-					if (req->data->west && req->data->west->get_block(get_mini_relative_coords(coords)).is_translucent()) return false;
-				}
+	// none are translucent, so only check the neighbors' layers touching our walls
+	// (missing neighbors don't uncover us)
+	if (east && !east->layer_opaque(0, 0)) return false;
+	if (west && !west->layer_opaque(0, MINICHUNK_WIDTH - 1)) return false;
+	if (north && !north->layer_opaque(2, MINICHUNK_DEPTH - 1)) return false;
+	if (south && !south->layer_opaque(2, 0)) return false;
+	if (down && !down->layer_opaque(1, MINICHUNK_HEIGHT - 1)) return false;
+	if (up && !up->layer_opaque(1, 0)) return false;
 
-				// if along north wall, check north
-				if (miniZ == 0) {
-					if (req->data->north && req->data->north->get_block(get_mini_relative_coords(coords)).is_translucent()) return false;
-				}
-				// if along south wall, check south
-				if (miniZ == MINICHUNK_DEPTH - 1) {
-					if (req->data->south && req->data->south->get_block(get_mini_relative_coords(coords)).is_translucent()) return false;
-				}
+	return true;
+}
 
-				// if along bottom wall, check bottom
-				if (miniY == 0) {
-					if (req->data->down && req->data->down->get_block(get_mini_relative_coords(coords)).is_translucent()) return false;
-				}
-				// if along top wall, check top
-				if (miniY == MINICHUNK_HEIGHT - 1) {
-					if (req->data->up && req->data->up->get_block(get_mini_relative_coords(coords)).is_translucent()) return false;
-				}
+// copy `mini`'s layer `layer_no` into layer `padded_layer_no` of the padded grid
+void copy_padded_layer(const MiniChunk& mini, const int layers_idx, const int layer_no, const int padded_layer_no, PaddedBlocks& padded) {
+	BlockType layer[16][16];
+	mini.extract_layer(layers_idx, layer_no, &layer[0][0]);
+
+	for (int outer = 0; outer < 16; outer++) {
+		for (int inner = 0; inner < 16; inner++) {
+			switch (layers_idx) {
+			case 0: padded[outer + 1][inner + 1][padded_layer_no] = layer[outer][inner]; break;
+			case 1: padded[padded_layer_no][outer + 1][inner + 1] = layer[outer][inner]; break;
+			case 2: padded[outer + 1][padded_layer_no][inner + 1] = layer[outer][inner]; break;
 			}
 		}
 	}
+}
 
-	return true;
+// snapshot `self`, plus its neighbors' layers touching it, into a mesh gen request
+MeshGenRequest* gen_mesh_gen_request(const MiniChunk& self, const MiniChunk* up, const MiniChunk* down, const MiniChunk* north, const MiniChunk* south, const MiniChunk* east, const MiniChunk* west, const MeshLayers& layers) {
+	MeshGenRequest* req = new MeshGenRequest();
+	req->coords = self.get_coords();
+	req->layers = layers;
+
+	// nothing to mesh => no need to copy anything
+	req->invisible = self.all_air() || check_if_covered(self, up, down, north, south, east, west);
+	if (req->invisible) {
+		req->connections = self.all_air() ? FaceConnections::all() : FaceConnections::none();
+		return req;
+	}
+
+	std::shared_ptr<MeshGenRequestData> data = std::make_shared<MeshGenRequestData>();
+	PaddedBlocks& padded = data->blocks;
+	memset(padded, (uint8_t)BlockType::Air, sizeof(padded));
+
+	// ourselves
+	BlockType blocks[MINICHUNK_SIZE];
+	self.extract_blocks(blocks);
+	for (int y = 0; y < 16; y++) {
+		for (int z = 0; z < 16; z++) {
+			memcpy(&padded[y + 1][z + 1][1], &blocks[y * 256 + z * 16], 16);
+		}
+	}
+
+	// neighbors' layers touching us
+	if (west) copy_padded_layer(*west, 0, 15, 0, padded);
+	if (east) copy_padded_layer(*east, 0, 0, 17, padded);
+	if (down) copy_padded_layer(*down, 1, 15, 0, padded);
+	if (up) copy_padded_layer(*up, 1, 0, 17, padded);
+	if (north) copy_padded_layer(*north, 2, 15, 0, padded);
+	if (south) copy_padded_layer(*south, 2, 0, 17, padded);
+
+	req->data = data;
+	return req;
 }
 
 // convert 2D quads to 3D quads
@@ -120,97 +153,49 @@ std::vector<Quad3D> quads_2d_3d(const std::vector<Quad2D>& quads2d, const int la
 	return result;
 }
 
-// generate layer by grabbing face blocks directly from the minichunk
-void gen_layer_generalized(const std::shared_ptr<MiniChunk> mini, const std::shared_ptr<MiniChunk> face_mini, const int layers_idx, const int layer_no, const vmath::ivec3 face, BlockType(&result)[16][16]) {
+bool is_face_visible(const BlockType& block, const BlockType& face_block) {
+	return face_block.is_transparent() || (block != BlockType::StillWater && block != BlockType::FlowingWater && face_block.is_translucent()) || (face_block.is_translucent() && !block.is_translucent());
+}
+
+// generate layer by grabbing blocks and their face blocks from the padded grid
+void gen_layer(const PaddedBlocks& padded, const int layers_idx, const int layer_no, const vmath::ivec3& face, BlockType(&result)[16][16]) {
 	// most efficient to traverse working_idx_1 then working_idx_2;
 	int working_idx_1, working_idx_2;
 	gen_working_indices(layers_idx, working_idx_1, working_idx_2);
 
-	// coordinates of current block
+	// coordinates of current block (in the padded grid)
 	vmath::ivec3 coords = { 0, 0, 0 };
-	coords[layers_idx] = layer_no;
+	coords[layers_idx] = layer_no + 1;
 
 	// reset all to air
 	memset(result, (uint8_t)BlockType::Air, sizeof(result));
-	if (!mini)
-	{
-		OutputDebugString("Uh oh 3501\n");
-		return;
-	}
 
 	// for each coordinate
 	for (int v = 0; v < 16; v++) {
 		for (int u = 0; u < 16; u++) {
-			coords[working_idx_1] = u;
-			coords[working_idx_2] = v;
+			coords[working_idx_1] = u + 1;
+			coords[working_idx_2] = v + 1;
 
 			// get block at these coordinates
-			const BlockType block = mini->get_block(coords);
+			const BlockType block = padded[coords[1]][coords[2]][coords[0]];
 
 			// skip air blocks
 			if (block == BlockType::Air) {
 				continue;
 			}
 
-			// no face mini => face is air
-			else if (face_mini == nullptr) {
-				result[u][v] = block;
-			}
+			// get face block (missing neighbors are air)
+			const vmath::ivec3 face_coords = coords + face;
+			const BlockType face_block = padded[face_coords[1]][face_coords[2]][face_coords[0]];
 
-			// face mini exists
-			else {
-				// get face block
-				vmath::ivec3 face_coords = coords + face;
-				face_coords[layers_idx] = (face_coords[layers_idx] + 16) % 16;
-				const BlockType face_block = face_mini->get_block(face_coords);
-
-				// if block's face is visible, set it
-				if (is_face_visible(block, face_block)) {
-					result[u][v] = block;
-				}
+			// if block's face is visible, set it
+			if (is_face_visible(block, face_block)) {
+				result[u][v] = block;
 			}
 		}
 	}
 }
 
-bool is_face_visible(const BlockType& block, const BlockType& face_block) {
-	return face_block.is_transparent() || (block != BlockType::StillWater && block != BlockType::FlowingWater && face_block.is_translucent()) || (face_block.is_translucent() && !block.is_translucent());
-}
-
-void gen_layer(const std::shared_ptr<MeshGenRequest> req, const int layers_idx, const int layer_no, const vmath::ivec3& face, BlockType(&result)[16][16]) {
-	// get coordinates of a random block
-	vmath::ivec3 coords = { 0, 0, 0 };
-	coords[layers_idx] = layer_no;
-	const vmath::ivec3 face_coords = coords + face;
-
-	// figure out which mini has our face layer (usually ours)
-	std::shared_ptr<MiniChunk> mini = req->data->self;
-	std::shared_ptr<MiniChunk> face_mini = nullptr;
-	if (in_range(face_coords, vmath::ivec3(0, 0, 0), vmath::ivec3(15, 15, 15))) {
-		face_mini = mini;
-	}
-	else {
-		const auto face_mini_coords = mini->get_coords() + (layers_idx == 1 ? vmath::ivec3(face * 16) : face);
-
-#define SET_COORDS(ATTR)\
-			if (face_mini == nullptr && req->data->ATTR && req->data->ATTR->get_coords() == face_mini_coords)\
-			{\
-				face_mini = req->data->ATTR;\
-			}
-
-		SET_COORDS(up);
-		SET_COORDS(down);
-		SET_COORDS(north);
-		SET_COORDS(south);
-		SET_COORDS(east);
-		SET_COORDS(west);
-#undef SET_COORDS
-	}
-
-	// generate layer
-	gen_layer_generalized(mini, face_mini, layers_idx, layer_no, face, result);
-}
-
 // given 2D array of block numbers, generate optimal quads
 std::vector<Quad2D> gen_quads(const BlockType(&layer)[16][16], /* const Metadata(&metadata_layer)[16][16], */ bool(&merged)[16][16]) {
 	memset(merged, false, sizeof(merged));
@@ -312,8 +297,8 @@ vmath::ivec2 get_max_size(const BlockType(&layer)[16][16], const bool(&merged)[1
 }
 
 MeshGenResult* gen_minichunk_mesh_from_req(std::shared_ptr<MeshGenRequest> req) {
-	// update invisibility
-	bool invisible = req->data->self->all_air() || check_if_covered(req);
+	// worked out when the request was made
+	const bool invisible = req->invisible;
 
 	// if visible, update mesh
 	std::unique_ptr<MiniChunkMesh> non_water;
@@ -325,7 +310,7 @@ MeshGenResult* gen_minichunk_mesh_from_req(std::shared_ptr<MeshGenRequest> req)
 		water = std::make_unique<MiniChunkMesh>();
 
 		for (auto& quad : mesh->get_quads()) {
-			if ((BlockType)quad.block == BlockType::StillWater || (BlockType)quad.block == BlockType::FlowingWater) {
+			if ((BlockType)quad.block() == BlockType::StillWater || (BlockType)quad.block() == BlockType::FlowingWater) {
 				water->add_quad(quad);
 			}
 			else {
@@ -340,70 +325,401 @@ MeshGenResult* gen_minichunk_mesh_from_req(std::shared_ptr<MeshGenRequest> req)
 	MeshGenResult* result = nullptr;
 	if (non_water || water)
 	{
-		result = new MeshGenResult(req->data->self->get_coords(), invisible, std::move(non_water), std::move(water));
+		result = new MeshGenResult(req->coords, invisible, std::move(non_water), std::move(water));
+		result->layers = req->layers;
+		result->connections = gen_face_connections(req->data->blocks);
+	}
+	// no meshes, but still let the renderer know: an edit might've just hidden everything, so whatever mesh is there
+	// should go, and cave culling needs to know what it can see through (e.g. nothing, if it's solid stone)
+	else
+	{
+		result = new MeshGenResult(req->coords, invisible, nullptr, nullptr);
+		result->connections = req->connections;
+	}
+
+	if (result)
+	{
+		result->request_class = req->request_class;
+		result->requested_at = req->requested_at;
 	}
 
 	// generated result
 	return result;
 }
 
-std::unique_ptr<MiniChunkMesh> gen_minichunk_mesh(std::shared_ptr<MeshGenRequest> req) {
+// which pairs of faces are connected through non-opaque blocks
+// flood fills each pocket of non-opaque blocks, noting which faces it touches -- all of those are connected
+FaceConnections gen_face_connections(const PaddedBlocks& padded) {
+	FaceConnections result = FaceConnections::none();
+
+	bool seen[MINICHUNK_HEIGHT][MINICHUNK_DEPTH][MINICHUNK_WIDTH] = {};
+	int stack[MINICHUNK_SIZE]; // each block is pushed at most once
+	int stack_size = 0;
+
+	const auto opaque = [&padded](const int x, const int y, const int z) {
+		return !((BlockType)padded[y + 1][z + 1][x + 1]).is_translucent();
+	};
+
+	for (int start = 0; start < MINICHUNK_SIZE; start++) {
+		const int start_y = start / 256, start_z = (start / 16) % 16, start_x = start % 16;
+		if (seen[start_y][start_z][start_x] || opaque(start_x, start_y, start_z)) {
+			continue;
+		}
+
+		// flood fill this pocket, noting which faces it touches (bit per face, see face_to_idx)
+		unsigned faces = 0;
+		seen[start_y][start_z][start_x] = true;
+		stack[stack_size++] = start;
+
+		while (stack_size > 0) {
+			const int idx = stack[--stack_size];
+			const int y = idx / 256, z = (idx / 16) % 16, x = idx % 16;
+
+			if (x == 15) faces |= 1 << 0;
+			if (x == 0) faces |= 1 << 1;
+			if (y == 15) faces |= 1 << 2;
+			if (y == 0) faces |= 1 << 3;
+			if (z == 15) faces |= 1 << 4;
+			if (z == 0) faces |= 1 << 5;
+
+			for (int face = 0; face < 6; face++) {
+				const vmath::ivec3 next = vmath::ivec3(x, y, z) + idx_to_face(face);
+				if (next[0] < 0 || next[0] >= 16 || next[1] < 0 || next[1] >= 16 || next[2] < 0 || next[2] >= 16) {
+					continue;
+				}
+				if (seen[next[1]][next[2]][next[0]] || opaque(next[0], next[1], next[2])) {
+					continue;
+				}
+
+				seen[next[1]][next[2]][next[0]] = true;
+				stack[stack_size++] = next[1] * 256 + next[2] * 16 + next[0];
+			}
+		}
+
+		for (int a = 0; a < 6; a++) {
+			for (int b = a + 1; b < 6; b++) {
+				if ((faces >> a & 1) && (faces >> b & 1)) {
+					result.connect(a, b);
+				}
+			}
+		}
+
+		// can't get any more connected
+		if (result == FaceConnections::all()) {
+			break;
+		}
+	}
+
+	return result;
+}
+
+// flip layer's quads if required, convert them to 3D, and add them to mesh
+void add_layer_quads(MiniChunkMesh& mesh, std::vector<Quad2D>& quads2d, const int layers_idx, const int layer_no, const vmath::ivec3& face) {
+	// if -x, -y, or +z, flip triangles around so that we're not drawing them backwards
+	if (face[0] < 0 || face[1] < 0 || face[2] > 0) {
+		for (auto& quad2d : quads2d) {
+			vmath::ivec2 diffs = quad2d.corners[1] - quad2d.corners[0];
+			quad2d.corners[0][0] += diffs[0];
+			quad2d.corners[1][0] -= diffs[0];
+		}
+	}
+
+	// TODO: rotate texture sides the correct way. (It's noticeable when placing down diamond block.)
+	// -> Or alternatively, can just rotate texture lmao.
+
+	// convert quads back to 3D coordinates
+	std::vector<Quad3D> quads = quads_2d_3d(quads2d, layers_idx, layer_no, face);
+
+	// if not backface (i.e. not facing (0,0,0)), move 1 forwards
+	if (face[0] > 0 || face[1] > 0 || face[2] > 0) {
+		for (auto& quad : quads) {
+			quad.corner1 += face;
+			quad.corner2 += face;
+		}
+	}
+
+	// append quads, packed
+	for (const auto& quad : quads) {
+		mesh.add_quad(PackedQuad::encode(quad));
+	}
+}
+
+// generate face for side `i` (0-2: -x/-y/-z, 3-5: +x/+y/+z)
+void gen_face(const int i, int& layers_idx, vmath::ivec3& face) {
+	bool backface = i < 3;
+	layers_idx = i % 3;
+
+	// generate face variable
+	face = { 0, 0, 0 };
+	// I don't think it matters whether we start with front or back face, as long as we switch halfway through.
+	// BACKFACE => +X/+Y/+Z SIDE. 
+	face[layers_idx] = backface ? -1 : 1;
+}
+
+// Scalar mesher, one get_block per block per face.
+// Slow, but simple -- kept around to check gen_minichunk_mesh against.
+std::unique_ptr<MiniChunkMesh> gen_minichunk_mesh_reference(std::shared_ptr<MeshGenRequest> req) {
 	// got our mesh
 	std::unique_ptr<MiniChunkMesh> mesh = std::make_unique<MiniChunkMesh>();
 
 	// for all 6 sides
 	for (int i = 0; i < 6; i++) {
-		bool backface = i < 3;
-		int layers_idx = i % 3;
-
-		// most efficient to traverse working_idx_1 then working_idx_2;
-		int working_idx_1, working_idx_2;
-		gen_working_indices(layers_idx, working_idx_1, working_idx_2);
-
-		// generate face variable
-		vmath::ivec3 face = { 0, 0, 0 };
-		// I don't think it matters whether we start with front or back face, as long as we switch halfway through.
-		// BACKFACE => +X/+Y/+Z SIDE. 
-		face[layers_idx] = backface ? -1 : 1;
+		int layers_idx;
+		vmath::ivec3 face;
+		gen_face(i, layers_idx, face);
 
 		// for each layer
 		for (int i = 0; i < 16; i++) {
+			// only the ones we were asked for
+			if (!req->layers.contains(layers_idx, i)) {
+				continue;
+			}
+
 			BlockType layer[16][16];
 			bool merged[16][16];
 
 			// extract it from the data
-			gen_layer(req, layers_idx, i, face, layer);
+			gen_layer(req->data->blocks, layers_idx, i, face, layer);
 
 			// get quads from layer
 			std::vector<Quad2D> quads2d = gen_quads(layer, merged);
 
-			// if -x, -y, or +z, flip triangles around so that we're not drawing them backwards
-			if (face[0] < 0 || face[1] < 0 || face[2] > 0) {
-				for (auto& quad2d : quads2d) {
-					vmath::ivec2 diffs = quad2d.corners[1] - quad2d.corners[0];
-					quad2d.corners[0][0] += diffs[0];
-					quad2d.corners[1][0] -= diffs[0];
+			add_layer_quads(*mesh, quads2d, layers_idx, i, face);
+		}
+	}
+
+	return mesh;
+}
+
+/* BINARY MESHER */
+
+static_assert(MINICHUNK_WIDTH == 16 && MINICHUNK_HEIGHT == 16 && MINICHUNK_DEPTH == 16, "binary mesher uses 16-bit rows");
+
+// bitmask of which of the 16 blocks in `row` are `block`
+inline uint16_t row_type_mask(const uint8_t* row, const uint8_t block) {
+	const __m128i blocks = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row));
+	return (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(blocks, _mm_set1_epi8((char)block)));
+}
+
+// bitmask of which of the 18 blocks in padded `row` are `block`
+inline uint32_t padded_row_type_mask(const uint8_t(&row)[PADDED_SIZE], const uint8_t block) {
+	return (uint32_t)(row[0] == block) | ((uint32_t)row_type_mask(&row[1], block) << 1) | ((uint32_t)(row[17] == block) << 17);
+}
+
+// transpose 16x16 bit matrix, so that bit i of rows[j] ends up in bit j of rows[i]
+void transpose16(uint16_t(&rows)[16]) {
+	constexpr uint16_t masks[4] = { 0x00FF, 0x0F0F, 0x3333, 0x5555 };
+	for (int step = 0, j = 8; j > 0; step++, j >>= 1) {
+		for (int k = 0; k < 16; k = (k + j + 1) & ~j) {
+			const uint16_t t = ((rows[k] >> j) ^ rows[k + j]) & masks[step];
+			rows[k + j] ^= t;
+			rows[k] ^= t << j;
+		}
+	}
+}
+
+// given a layer's blocks and which of them have visible faces, generate optimal quads
+// same results as gen_quads: layer[u] holds the blocks along v for each u, and visible[u] has bit v set if that face is visible
+std::vector<Quad2D> gen_quads_binary(const uint8_t(&layer)[16][16], const uint16_t(&visible)[16]) {
+	uint16_t merged[16] = { 0 };
+
+	std::vector<Quad2D> result;
+
+	for (int u = 0; u < 16; u++) {
+		uint16_t remaining = visible[u] & ~merged[u];
+
+		while (remaining) {
+			const int v = std::countr_zero(remaining);
+			const uint8_t block = layer[u][v];
+
+			vmath::ivec2 max_size = { 1, 1 };
+			uint16_t run = (uint16_t)(1 << v);
+
+			// no meshing of flowing water -- see get_max_size
+			if (block != BlockType::FlowingWater) {
+				// maximize height first
+				const uint16_t same = row_type_mask(layer[u], block) & visible[u] & ~merged[u];
+				max_size[1] = std::countr_one((uint16_t)(same >> v));
+				run = (uint16_t)(((1u << max_size[1]) - 1) << v);
+
+				// then width, as long as entire height is correct
+				for (int u2 = u + 1; u2 < 16; u2++) {
+					const uint16_t same2 = row_type_mask(layer[u2], block) & visible[u2] & ~merged[u2];
+					if ((same2 & run) != run) {
+						break;
+					}
+					max_size[0]++;
 				}
 			}
 
-			// TODO: rotate texture sides the correct way. (It's noticeable when placing down diamond block.)
-			// -> Or alternatively, can just rotate texture lmao.
+			// mark all as merged
+			for (int u2 = u; u2 < u + max_size[0]; u2++) {
+				merged[u2] |= run;
+			}
+			remaining &= ~run;
 
-			// convert quads back to 3D coordinates
-			std::vector<Quad3D> quads = quads_2d_3d(quads2d, layers_idx, i, face);
+			Quad2D q;
+			q.block = block;
+			q.corners[0] = { u, v };
+			q.corners[1] = vmath::ivec2(u, v) + max_size;
+			result.push_back(q);
+		}
+	}
+
+	return result;
+}
+
+// Greedy mesher working on bitmasks instead of single blocks.
+// Face visibility is worked out 16 blocks at a time with shifts and ANDs over rows of the padded grid,
+// then quads are merged with count-trailing-zeros scans.
+// Generates exactly the same quads, in the same order, as gen_minichunk_mesh_reference.
+std::unique_ptr<MiniChunkMesh> gen_minichunk_mesh(std::shared_ptr<MeshGenRequest> req) {
+	// got our mesh
+	std::unique_ptr<MiniChunkMesh> mesh = std::make_unique<MiniChunkMesh>();
 
-			// if not backface (i.e. not facing (0,0,0)), move 1 forwards
-			if (face[0] > 0 || face[1] > 0 || face[2] > 0) {
-				for (auto& quad : quads) {
-					quad.corner1 += face;
-					quad.corner2 += face;
+	const PaddedBlocks& padded = req->data->blocks;
+
+	// block types which don't hide faces behind them
+	static const std::vector<uint8_t> translucent_types = [] {
+		std::vector<uint8_t> result;
+		for (int i = 0; i < MAX_BLOCK_TYPES; i++) {
+			if (BlockType((uint8_t)i).is_translucent()) {
+				result.push_back((uint8_t)i);
+			}
+		}
+		return result;
+	}();
+
+	// x-rows of the padded grid, bit x set if block at x is air/translucent/water
+	uint32_t air[PADDED_SIZE][PADDED_SIZE];
+	uint32_t translucent[PADDED_SIZE][PADDED_SIZE];
+	uint32_t water[PADDED_SIZE][PADDED_SIZE];
+
+	for (int y = 0; y < PADDED_SIZE; y++) {
+		for (int z = 0; z < PADDED_SIZE; z++) {
+			air[y][z] = padded_row_type_mask(padded[y][z], BlockType::Air);
+			water[y][z] = padded_row_type_mask(padded[y][z], BlockType::StillWater) | padded_row_type_mask(padded[y][z], BlockType::FlowingWater);
+
+			translucent[y][z] = 0;
+			for (const uint8_t type : translucent_types) {
+				translucent[y][z] |= padded_row_type_mask(padded[y][z], type);
+			}
+		}
+	}
+
+	// for all 6 sides
+	for (int i = 0; i < 6; i++) {
+		int layers_idx;
+		vmath::ivec3 face;
+		gen_face(i, layers_idx, face);
+
+		// no layers along this axis asked for
+		const uint16_t layers_mask = req->layers.masks[layers_idx];
+		if (!layers_mask) {
+			continue;
+		}
+
+		// visible faces, as x-rows of ourselves (bit x set if face of block (x, y, z) is visible)
+		// a face is visible if the block isn't air, and the face block is air, or translucent while we're not water (see is_face_visible)
+		uint16_t visible[16][16];
+		uint16_t any_visible = 0;
+
+		for (int y = 0; y < 16; y++) {
+			for (int z = 0; z < 16; z++) {
+				const int py = y + 1, pz = z + 1;
+
+				// face blocks' rows, lined up with ours
+				uint32_t face_air, face_translucent;
+				if (layers_idx == 0) {
+					face_air = face[0] > 0 ? air[py][pz] >> 1 : air[py][pz] << 1;
+					face_translucent = face[0] > 0 ? translucent[py][pz] >> 1 : translucent[py][pz] << 1;
 				}
+				else {
+					const int fy = py + face[1], fz = pz + face[2];
+					face_air = air[fy][fz];
+					face_translucent = translucent[fy][fz];
+				}
+
+				const uint32_t row = ~air[py][pz] & (face_air | (face_translucent & ~water[py][pz]));
+				visible[y][z] = (uint16_t)(row >> 1);
+				any_visible |= visible[y][z];
+			}
+		}
+
+		// nothing to see
+		if (layers_idx == 0 && !any_visible) {
+			continue;
+		}
+
+		// for -x/+x, transpose each z-slice up front, so that slices[z][x] has bit y set if face of (x, y, z) is visible
+		uint16_t slices[16][16];
+		if (layers_idx == 0) {
+			for (int z = 0; z < 16; z++) {
+				for (int y = 0; y < 16; y++) {
+					slices[z][y] = visible[y][z];
+				}
+				transpose16(slices[z]);
 			}
+		}
 
-			// append quads
-			for (auto quad : quads) {
-				mesh->add_quad(quad);
+		// for each layer we were asked for
+		for (int l = 0; l < 16; l++) {
+			if (!(layers_mask & (1 << l))) {
+				continue;
 			}
+
+			// visible faces in this layer, as rows along working_idx_2 for each working_idx_1 (see gen_working_indices)
+			uint16_t layer_visible[16];
+			bool empty = true;
+
+			switch (layers_idx) {
+			case 0: // u = z, v = y
+				if (!(any_visible & (1 << l))) {
+					continue;
+				}
+				for (int z = 0; z < 16; z++) {
+					layer_visible[z] = slices[z][l];
+				}
+				break;
+			case 1: // u = x, v = z
+				for (int z = 0; z < 16; z++) {
+					layer_visible[z] = visible[l][z];
+				}
+				transpose16(layer_visible);
+				break;
+			case 2: // u = x, v = y
+				for (int y = 0; y < 16; y++) {
+					layer_visible[y] = visible[y][l];
+				}
+				transpose16(layer_visible);
+				break;
+			}
+
+			// gather blocks of rows with anything visible
+			uint8_t layer[16][16] = {};
+			for (int u = 0; u < 16; u++) {
+				if (!layer_visible[u]) {
+					continue;
+				}
+				empty = false;
+
+				for (int v = 0; v < 16; v++) {
+					switch (layers_idx) {
+					case 0: layer[u][v] = padded[v + 1][u + 1][l + 1]; break;
+					case 1: layer[u][v] = padded[l + 1][v + 1][u + 1]; break;
+					case 2: layer[u][v] = padded[v + 1][l + 1][u + 1]; break;
+					}
+				}
+			}
+
+			if (empty) {
+				continue;
+			}
+
+			// get quads from layer
+			std::vector<Quad2D> quads2d = gen_quads_binary(layer, layer_visible);
+
+			add_layer_quads(*mesh, quads2d, layers_idx, l, face);
 		}
 	}
 
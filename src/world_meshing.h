@@ -5,5 +5,14 @@
 
 #include <memory>
 
+// snapshot `self`, plus its neighbors' layers touching it, into a mesh gen request
+// any neighbor may be nullptr, in which case it's treated as air
+// layers: which layers to remesh
+MeshGenRequest* gen_mesh_gen_request(const MiniChunk& self, const MiniChunk* up, const MiniChunk* down, const MiniChunk* north, const MiniChunk* south, const MiniChunk* east, const MiniChunk* west, const MeshLayers& layers = MeshLayers::all());
+
+// which pairs of the mini's faces are connected through non-opaque blocks (for cave culling)
+FaceConnections gen_face_connections(const PaddedBlocks& padded);
+
 MeshGenResult* gen_minichunk_mesh_from_req(std::shared_ptr<MeshGenRequest> req);
 std::unique_ptr<MiniChunkMesh> gen_minichunk_mesh(std::shared_ptr<MeshGenRequest> req);
+std::unique_ptr<MiniChunkMesh> gen_minichunk_mesh_reference(std::shared_ptr<MeshGenRequest> req);
@@ -2,33 +2,22 @@
 
 #include "messaging.h"
 #include "minichunkmesh.h"
+#include "settings.h"
 #include "shapes.h"
 #include "world_utils.h"
 
 #include "vmath.h"
-#include "zmq_addon.hpp"
 
+#include <algorithm>
 #include <vector>
 
-// radius from center of minichunk that must be included in view frustum
-constexpr float FRUSTUM_MINI_RADIUS_ALLOWANCE = 28.0f;
-
-// check if a mini is visible in a frustum
-bool mini_in_frustum(const MiniRender* mini, const vmath::vec4(&planes)[6]) {
-	return sphere_in_frustum(mini->center_coords_v3(), FRUSTUM_MINI_RADIUS_ALLOWANCE, planes);
+WorldRenderPart::WorldRenderPart() : mailbox(msg::get_mailboxes().render)
+{
 }
 
-WorldRenderPart::WorldRenderPart(std::shared_ptr<zmq::context_t> ctx_) : bus(ctx_)
+WorldRenderPart::~WorldRenderPart()
 {
-#ifdef _DEBUG
-	bus.out.setsockopt(ZMQ_SUBSCRIBE, "", 0);
-#else
-	for (const auto& m : msg::render_thread_incoming)
-	{
-		// TODO: Upgrade zmq and replace this with .set()
-		bus.out.setsockopt(ZMQ_SUBSCRIBE, m.c_str(), m.size());
-	}
-#endif // _DEBUG
+	glDeleteBuffers(1, &indirect_buf);
 }
 
 // get mini render component or nullptr
@@ -53,6 +42,7 @@ std::shared_ptr<MiniRender> WorldRenderPart::get_mini_render_component_or_genera
 		result = std::make_shared<MiniRender>();
 		result->set_coords({ x, y, z });
 		mesh_map[{x, y, z}] = result;
+		culler.add({ x, y, z }, result.get());
 	}
 
 	return result;
@@ -62,45 +52,154 @@ std::shared_ptr<MiniRender> WorldRenderPart::get_mini_render_component_or_genera
 
 void WorldRenderPart::handle_messages()
 {
-	std::vector<zmq::message_t> message;
-	auto ret = zmq::recv_multipart(bus.out, std::back_inserter(message), zmq::recv_flags::dontwait);
-	while (ret)
+	msg::RenderMessage message;
+	while (mailbox.try_pop(message))
 	{
 		// Handle generated meshes
-		if (message[0].to_string_view() == msg::MESH_GEN_RESPONSE)
+		if (auto meshes = std::get_if<msg::MeshGenResults>(&message))
 		{
-			// Extract result
-			MeshGenResult* mesh_ = *message[1].data<MeshGenResult*>();
-			std::unique_ptr<MeshGenResult> mesh(mesh_);
-
-			// Update mesh!
-			std::shared_ptr<MiniRender> mini = get_mini_render_component_or_generate(mesh->coords);
-			mini->set_mesh(std::move(mesh->mesh));
-			mini->set_water_mesh(std::move(mesh->water_mesh));
+			for (auto& envelope : *meshes)
+			{
+				on_mesh_gen_result(envelope.open());
+			}
 		}
-		else if (message[0].to_string_view() == msg::EVENT_PLAYER_MOVED_CHUNKS)
+		else if (auto event = std::get_if<PlayerMovedChunksEvent>(&message))
 		{
-			// TODO: Pop meshes that are too far away, request meshes for chunks that are nearby
+			// Pop meshes that are too far away
+			unload_meshes(event->coords, event->render_distance);
 		}
+	}
 
-		message.clear();
-		ret = zmq::recv_multipart(bus.out, std::back_inserter(message), zmq::recv_flags::dontwait);
+	// ask for whole meshes of minis we could only get partial ones for
+	if (!need_whole_meshes.coords.empty())
+	{
+		msg::get_mailboxes().world.push(std::move(need_whole_meshes));
+		need_whole_meshes = MeshesDroppedEvent();
 	}
 }
 
-void WorldRenderPart::render(OpenGLInfo* glInfo, GlfwInfo* windowInfo, const vmath::vec4(&planes)[6], const vmath::ivec3& staring_at) {
-	// collect all the minis we're gonna draw
-	std::vector<MiniRender*> minis_to_draw;
+void WorldRenderPart::on_mesh_gen_result(std::unique_ptr<MeshGenResult> mesh)
+{
+	mesh_latency[static_cast<int>(mesh->request_class)].add(mesh->requested_at);
+
+	// Update mesh! (unless player moved away while it was being generated)
+	const bool too_far = render_distance >= 0 && should_unload_chunk({ mesh->coords[0], mesh->coords[2] }, player_chunk_coords, render_distance);
+	// what it can be seen through, for cave culling (even if there's nothing to draw, e.g. it's solid stone)
+	if (!too_far)
+	{
+		visibility.set_connections(mesh->coords, mesh->connections);
+	}
 
-	for (auto& [coords, mini] : mesh_map)
+	// nothing to draw in the whole mini (whatever layers were asked for) => clear its mesh, if it has one
+	if (!too_far && mesh->invisible)
+	{
+		const auto search = mesh_map.find(mesh->coords);
+		if (search != mesh_map.end()) {
+			search->second->set_mesh(std::make_unique<MiniChunkMesh>());
+			search->second->set_water_mesh(std::make_unique<MiniChunkMesh>());
+			mesh_last_used[mesh->coords] = num_player_moves;
+		}
+		else {
+			empty_minis.insert(mesh->coords);
+		}
+	}
+	else if (!too_far && mesh->layers.is_all())
+	{
+		std::shared_ptr<MiniRender> mini = get_mini_render_component_or_generate(mesh->coords);
+		mini->set_mesh(std::move(mesh->mesh));
+		mini->set_water_mesh(std::move(mesh->water_mesh));
+		mesh_last_used[mesh->coords] = num_player_moves;
+		empty_minis.erase(mesh->coords);
+	}
+	// an edit only touched a few layers => splice them in
+	else if (!too_far)
 	{
-		if (!mini->get_invisible())
+		// no whole mesh to splice them into (it hasn't arrived yet, or was dropped) => we'd end up with just these layers,
+		// e.g. a lone wall, so ask for a whole one instead
+		if (!mesh_map.contains(mesh->coords) && !empty_minis.contains(mesh->coords))
 		{
-			if (mini_in_frustum(mini.get(), planes))
-			{
-				minis_to_draw.push_back(mini.get());
+			need_whole_meshes.coords.push_back(mesh->coords);
+			return;
+		}
+
+		std::shared_ptr<MiniRender> mini = get_mini_render_component_or_generate(mesh->coords);
+		mini->set_mesh_layers(*mesh->mesh, *mesh->water_mesh, mesh->layers);
+		mesh_last_used[mesh->coords] = num_player_moves;
+		empty_minis.erase(mesh->coords);
+	}
+}
+
+// unload meshes of minis too far from the player, then least-recently-nearby ones until we're within the memory budget
+void WorldRenderPart::unload_meshes(const vmath::ivec2& player_chunk_coords, const int render_distance) {
+	this->player_chunk_coords = player_chunk_coords;
+	this->render_distance = render_distance;
+	num_player_moves++;
+
+	const size_t budget = static_cast<size_t>(get_settings().mesh_memory_budget_mb) * 1024 * 1024;
+	size_t memory_usage = 0;
+
+	// (last used, coords) of meshes we can unload if we're over budget
+	std::vector<std::pair<int, vmath::ivec3>> candidates;
+	std::vector<vmath::ivec3> to_unload;
+
+	for (const auto& [coords, mini] : mesh_map) {
+		const vmath::ivec2 chunk_coords = { coords[0], coords[2] };
+		if (should_unload_chunk(chunk_coords, player_chunk_coords, render_distance)) {
+			to_unload.push_back(coords);
+			continue;
+		}
+
+		memory_usage += mini->memory_usage();
+		if (vmath::distance(chunk_coords, player_chunk_coords) <= render_distance) {
+			mesh_last_used[coords] = num_player_moves;
+		}
+		else {
+			candidates.push_back({ mesh_last_used[coords], coords });
+		}
+	}
+
+	// over budget, so unload least recently used first
+	// their chunks may still be loaded, so tell the world to remesh them if they come back in range
+	if (memory_usage > budget) {
+		MeshesDroppedEvent dropped;
+
+		std::sort(candidates.begin(), candidates.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+		for (const auto& [last_used, coords] : candidates) {
+			if (memory_usage <= budget) {
+				break;
 			}
+
+			memory_usage -= mesh_map[coords]->memory_usage();
+			to_unload.push_back(coords);
+			dropped.coords.push_back(coords);
 		}
+
+		if (!dropped.coords.empty()) {
+			msg::get_mailboxes().world.push(std::move(dropped));
+		}
+	}
+
+	visibility.unload(player_chunk_coords, render_distance);
+	std::erase_if(empty_minis, [&](const vmath::ivec3& coords) { return should_unload_chunk({ coords[0], coords[2] }, player_chunk_coords, render_distance); });
+
+	// drop them, freeing their room in the arena
+	for (const auto& coords : to_unload) {
+		mesh_map[coords]->release_gl(arena);
+		culler.remove(coords);
+		mesh_map.erase(coords);
+		mesh_last_used.erase(coords);
+	}
+}
+
+void WorldRenderPart::render(OpenGLInfo* glInfo, GlfwInfo* windowInfo, const vmath::vec3& camera_pos, const vmath::vec4(&planes)[6], const vmath::ivec3& staring_at) {
+	// collect all the minis we're gonna draw
+	culler.cull(planes, minis_to_draw);
+	minis_to_draw.erase(std::remove_if(minis_to_draw.begin(), minis_to_draw.end(), [](const MiniRender* mini) { return mini->get_invisible(); }), minis_to_draw.end());
+
+	// skip ones hidden behind other minis (once we know how far to look)
+	if (get_settings().cave_culling && render_distance >= 0) {
+		visibility.update(camera_pos, planes, render_distance);
+		minis_to_draw.erase(std::remove_if(minis_to_draw.begin(), minis_to_draw.end(), [this](const MiniRender* mini) { return !visibility.is_visible(mini->get_coords()); }), minis_to_draw.end());
 	}
 
 	if (minis_to_draw.size() == 0) return;
@@ -117,9 +216,25 @@ void WorldRenderPart::render(OpenGLInfo* glInfo, GlfwInfo* windowInfo, const vma
 	glClearBufferfv(GL_DEPTH, 0, &one);
 	glEnable(GL_BLEND);
 
-	// draw terrain
+	// upload meshes that changed, then collect draws (in that order, since uploading can move things around in the arena)
 	for (auto& mini : minis_to_draw) {
-		mini->render_meshes(glInfo);
+		mini->prepare_render(arena);
+	}
+
+	terrain_draws.clear();
+	water_draws.clear();
+	for (auto& mini : minis_to_draw) {
+		mini->add_draws(arena, terrain_draws, water_draws);
+	}
+	terrain_draws.sort_by_first();
+	water_draws.sort_by_first();
+	upload_draw_commands();
+
+	// draw terrain
+	arena.bind(glInfo);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buf);
+	if (!terrain_draws.empty()) {
+		glMultiDrawArraysIndirect(GL_POINTS, 0, static_cast<GLsizei>(terrain_draws.size()), 0);
 	}
 
 	// highlight block
@@ -133,10 +248,13 @@ void WorldRenderPart::render(OpenGLInfo* glInfo, GlfwInfo* windowInfo, const vma
 	glClearBufferfv(GL_DEPTH, 0, &one);
 	glDisable(GL_BLEND); // DEBUG
 
-	// draw water onto water fbo
-	for (auto& mini : minis_to_draw) {
-		mini->render_water_meshes(glInfo);
+	// draw water onto water fbo (highlight_block rebinds vao_quad, so bind it again)
+	arena.bind(glInfo);
+	if (!water_draws.empty()) {
+		glMultiDrawArraysIndirect(GL_POINTS, reinterpret_cast<const void*>(sizeof(DrawArraysIndirectCommand) * terrain_draws.size()), static_cast<GLsizei>(water_draws.size()), 0);
 	}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
 
 	// merge water fbo onto terrain fbo
 	merge_fbos(glInfo, glInfo->fbo_terrain.get_fbo(), glInfo->fbo_water);
@@ -150,6 +268,25 @@ void WorldRenderPart::render(OpenGLInfo* glInfo, GlfwInfo* windowInfo, const vma
 	rendered++;
 }
 
+// upload this frame's draws to indirect_buf
+void WorldRenderPart::upload_draw_commands() {
+	const size_t num_commands = terrain_draws.size() + water_draws.size();
+	if (num_commands == 0) {
+		return;
+	}
+
+	// doesn't fit => start over with a bigger buffer
+	if (num_commands > indirect_capacity) {
+		indirect_capacity = std::max(num_commands + num_commands / 2, indirect_capacity * 2);
+		glDeleteBuffers(1, &indirect_buf);
+		glCreateBuffers(1, &indirect_buf);
+		glNamedBufferStorage(indirect_buf, sizeof(DrawArraysIndirectCommand) * indirect_capacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+	}
+
+	glNamedBufferSubData(indirect_buf, 0, sizeof(DrawArraysIndirectCommand) * terrain_draws.size(), terrain_draws.get_commands().data());
+	glNamedBufferSubData(indirect_buf, sizeof(DrawArraysIndirectCommand) * terrain_draws.size(), sizeof(DrawArraysIndirectCommand) * water_draws.size(), water_draws.get_commands().data());
+}
+
 void WorldRenderPart::highlight_block(const OpenGLInfo* glInfo, const GlfwInfo* windowInfo, const int x, const int y, const int z) {
 	// Figure out mini-relative quads
 	Quad3D quads[6];
@@ -215,14 +352,18 @@ void WorldRenderPart::highlight_block(const OpenGLInfo* glInfo, const GlfwInfo*
 	glCreateBuffers(1, &mini_coords_buf);
 
 	// allocate them just enough space
-	glNamedBufferStorage(quad_data_buf, sizeof(Quad3D) * 6, quads, NULL);
+	PackedQuad packed[6];
+	for (int i = 0; i < 6; i++) {
+		packed[i] = PackedQuad::encode(quads[i]);
+	}
+	glNamedBufferStorage(quad_data_buf, sizeof(packed), packed, NULL);
 	glNamedBufferStorage(mini_coords_buf, sizeof(vmath::ivec3), mini_coords, NULL);
 
 	// quad VAO
 	glBindVertexArray(glInfo->vao_quad);
 
 	// bind to quads attribute binding point
-	glVertexArrayVertexBuffer(glInfo->vao_quad, glInfo->quad_data_bidx, quad_data_buf, 0, sizeof(Quad3D));
+	glVertexArrayVertexBuffer(glInfo->vao_quad, glInfo->quad_data_bidx, quad_data_buf, 0, sizeof(PackedQuad));
 	glVertexArrayVertexBuffer(glInfo->vao_quad, glInfo->q_base_coords_bidx, mini_coords_buf, 0, sizeof(vmath::ivec3));
 
 	// save properties before we overwrite them
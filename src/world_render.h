@@ -1,17 +1,22 @@
 #pragma once
 
+#include "draw_commands.h"
+#include "mesh_arena.h"
 #include "messaging.h"
+#include "mini_culler.h"
 #include "minichunk.h" // renderer part
-
-#include "zmq.hpp"
+#include "visibility_graph.h"
+#include "world_utils.h"
 
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 
 class WorldRenderPart
 {
 public:
-	WorldRenderPart(std::shared_ptr<zmq::context_t> ctx_);
+	WorldRenderPart();
+	~WorldRenderPart();
 
 	// get mini render component or nullptr
 	std::shared_ptr<MiniRender> get_mini_render_component(const int x, const int y, const int z);
@@ -22,13 +27,84 @@ public:
 	std::shared_ptr<MiniRender> get_mini_render_component_or_generate(const vmath::ivec3& xyz);
 
 	void handle_messages();
-	void render(OpenGLInfo* glInfo, GlfwInfo* windowInfo, const vmath::vec4(&planes)[6], const vmath::ivec3& staring_at);
+
+	// how long mesh gen requests of each class took, from being made to their mesh being used
+	inline const RequestLatency& get_mesh_latency(const RequestClass request_class) const {
+		return mesh_latency[static_cast<int>(request_class)];
+	}
+
+	// GL buffer all minis' quads live in
+	inline const MeshArena& get_mesh_arena() const {
+		return arena;
+	}
+
+	// frustum culling, as of last frame
+	inline const MiniCuller& get_culler() const {
+		return culler;
+	}
+
+	// cave culling, as of last frame
+	inline const VisibilityGraph& get_visibility() const {
+		return visibility;
+	}
+
+	// last frame's terrain/water draws
+	inline const DrawCommandList& get_terrain_draws() const {
+		return terrain_draws;
+	}
+
+	inline const DrawCommandList& get_water_draws() const {
+		return water_draws;
+	}
+
+	// camera_pos: in real coords
+	void render(OpenGLInfo* glInfo, GlfwInfo* windowInfo, const vmath::vec3& camera_pos, const vmath::vec4(&planes)[6], const vmath::ivec3& staring_at);
 
 	void highlight_block(const OpenGLInfo* glInfo, const GlfwInfo* windowInfo, const int x, const int y, const int z);
 	void highlight_block(const OpenGLInfo* glInfo, const GlfwInfo* windowInfo, const vmath::ivec3& xyz);
 
+	// unload meshes of minis too far from the player (see should_unload_chunk), then, if we're over the memory budget,
+	// meshes outside render distance that were least recently within it
+	void unload_meshes(const vmath::ivec2& player_chunk_coords, const int render_distance);
+
 private:
-	BusNode bus;
+	Mailbox<msg::RenderMessage>& mailbox;
+
+	// use a generated mesh (unless it's too far away already)
+	void on_mesh_gen_result(std::unique_ptr<MeshGenResult> mesh);
+
 	std::unordered_map<vmath::ivec3, std::shared_ptr<MiniRender>, vecN_hash> mesh_map;
+
+	// minis whose last whole mesh had nothing to draw, and that have no MiniRender
+	// a mini has a whole mesh iff it's in mesh_map or here, and only then can partial remeshes be spliced in
+	std::unordered_set<vmath::ivec3, vecN_hash> empty_minis;
+
+	// minis we got partial remeshes for without having a whole mesh, to ask the world for whole ones at the end of handle_messages()
+	MeshesDroppedEvent need_whole_meshes;
+	MeshArena arena;
+	MiniCuller culler; // has every mini in mesh_map
+	VisibilityGraph visibility; // has every mini we've had a mesh gen result for (even ones with nothing to draw)
+
+	// this frame's minis in view (kept around to reuse the memory)
+	std::vector<MiniRender*> minis_to_draw;
+
+	// this frame's draws, and the GL_DRAW_INDIRECT_BUFFER they're uploaded to (terrain draws, then water draws)
+	DrawCommandList terrain_draws;
+	DrawCommandList water_draws;
+	GLuint indirect_buf = 0;
+	size_t indirect_capacity = 0; // in commands
+
+	// upload terrain_draws and water_draws to indirect_buf, growing it if needed
+	void upload_draw_commands();
 	int rendered = 0; // how many times render() was called
+
+	// player's position as of the last EVENT_PLAYER_MOVED_CHUNKS, so we can drop meshes that are already too far away
+	vmath::ivec2 player_chunk_coords = { 0, 0 };
+	int render_distance = -1; // -1 = unknown
+
+	// (mini coords) -> last EVENT_PLAYER_MOVED_CHUNKS it was within render distance at, for picking meshes to unload
+	std::unordered_map<vmath::ivec3, int, vecN_hash> mesh_last_used;
+	int num_player_moves = 0;
+
+	RequestLatency mesh_latency[NUM_REQUEST_CLASSES];
 };
@@ -2,6 +2,8 @@
 
 #include "messaging.h"
 
+#include <algorithm>
+
 float intbound(const float s, const float ds)
 {
 	// Some kind of edge case, see:
@@ -171,6 +173,10 @@ MeshGenResult::MeshGenResult(MeshGenResult&& other) noexcept
 		invisible = other.invisible;
 		mesh = std::move(other.mesh);
 		water_mesh = std::move(other.water_mesh);
+		layers = other.layers;
+		connections = other.connections;
+		request_class = other.request_class;
+		requested_at = other.requested_at;
 	}
 }
 
@@ -182,12 +188,90 @@ MeshGenResult& MeshGenResult::operator=(MeshGenResult&& other)
 		invisible = other.invisible;
 		mesh = std::move(other.mesh);
 		water_mesh = std::move(other.water_mesh);
+		layers = other.layers;
+		connections = other.connections;
+		request_class = other.request_class;
+		requested_at = other.requested_at;
 	}
 	return *this;
 }
 
 ///////////////////////////////
 
+// pick which class to serve next
+int pick_request_class(const bool(&waiting)[NUM_REQUEST_CLASSES], int(&passed_over)[NUM_REQUEST_CLASSES]) {
+	int result = -1;
+	for (int i = 0; i < NUM_REQUEST_CLASSES; i++) {
+		if (!waiting[i]) {
+			continue;
+		}
+
+		// most urgent, or starving
+		if (result < 0 || passed_over[i] >= REQUEST_STARVATION_LIMIT) {
+			result = i;
+			if (passed_over[i] >= REQUEST_STARVATION_LIMIT) {
+				break;
+			}
+		}
+	}
+
+	// everyone else who was waiting got passed over
+	for (int i = 0; i < NUM_REQUEST_CLASSES; i++) {
+		passed_over[i] = waiting[i] && i != result ? passed_over[i] + 1 : 0;
+	}
+
+	return result;
+}
+
+WorkCounters& get_mesh_work_counters() {
+	static WorkCounters counters;
+	return counters;
+}
+
+WorkCounters& get_chunk_work_counters() {
+	static WorkCounters counters;
+	return counters;
+}
+
+void RequestLatency::add(const std::chrono::steady_clock::time_point& requested_at) {
+	const auto now = std::chrono::steady_clock::now();
+	const double ms = std::chrono::duration<double, std::milli>(now - requested_at).count();
+
+	recent_ms = count > 0 ? 0.9 * recent_ms + 0.1 * ms : ms;
+	count++;
+	total_ms += ms;
+
+	// start a new window (forgetting the last one if it's been more than a whole window since)
+	if (now - window_start >= LATENCY_MAX_WINDOW) {
+		last_window_max_ms = now - window_start < 2 * LATENCY_MAX_WINDOW ? window_max_ms : 0;
+		window_max_ms = 0;
+		window_start = now;
+	}
+	window_max_ms = std::max(window_max_ms, ms);
+}
+
+// max over this window and the last one (0 if nothing came in during them)
+double RequestLatency::recent_max_ms() const {
+	const auto age = std::chrono::steady_clock::now() - window_start;
+
+	// window's still going
+	if (age < LATENCY_MAX_WINDOW) {
+		return std::max(last_window_max_ms, window_max_ms);
+	}
+	// it ended with nothing coming in since, so it's the last one now
+	if (age < 2 * LATENCY_MAX_WINDOW) {
+		return window_max_ms;
+	}
+	return 0;
+}
+
+///////////////////////////////
+
+// whether chunk at `coords` is far enough from the player to unload (see UNLOAD_DISTANCE_MARGIN)
+bool should_unload_chunk(const vmath::ivec2& coords, const vmath::ivec2& player_chunk_coords, const int render_distance) {
+	return vmath::distance(coords, player_chunk_coords) > render_distance + UNLOAD_DISTANCE_MARGIN;
+}
+
 // get chunk-coordinates of chunk containing the block at (x, _, z)
 vmath::ivec2 get_chunk_coords(const int x, const int z) {
 	return get_chunk_coords(static_cast<float>(x), static_cast<float>(z));
@@ -1,10 +1,15 @@
 #pragma once
 
 #include "chunk.h"
+#include "envelope.h"
+#include "face_connections.h"
 
 #include "vmath.h"
 
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <vector>
 
 // Rendering part
 #include "minichunkmesh.h"
@@ -19,7 +24,64 @@ struct Quad2D {
 
 bool operator==(const Quad2D& lhs, const Quad2D& rhs);
 
-struct MeshGenResult
+// how urgent a mesh/chunk gen request is
+// the Mesher/Chunker serve more urgent classes first (see pick_request_class)
+enum class RequestClass : uint8_t {
+	Interactive, // player edits, and chunks right around the player
+	Water,       // water flowing
+	Background,  // terrain streaming in
+};
+
+constexpr int NUM_REQUEST_CLASSES = 3;
+
+// a class with requests waiting gets served after being passed over for more urgent ones this many times in a row
+constexpr int REQUEST_STARVATION_LIMIT = 8;
+
+// queued requests' priorities (distance to the player) are only all recomputed, and ones too far to bother with dropped,
+// once the player's moved this many chunks
+// until then, that's done as they reach the front of the queue, so the order can be off by at most this much
+constexpr int MAX_QUEUE_PRIORITY_DRIFT = 4;
+
+// pick which class to serve next: the most urgent one with requests waiting, unless a less urgent one's starving
+// waiting: whether each class has requests waiting
+// passed_over: how many times in a row each class was waiting but not picked (updated)
+// returns -1 if nothing's waiting
+int pick_request_class(const bool(&waiting)[NUM_REQUEST_CLASSES], int(&passed_over)[NUM_REQUEST_CLASSES]);
+
+// how long the max in RequestLatency looks back: between this and twice this
+constexpr auto LATENCY_MAX_WINDOW = std::chrono::seconds(5);
+
+// how long requests of one class took, from being made to their result being used
+struct RequestLatency {
+	int count = 0;
+	double total_ms = 0;
+	double recent_ms = 0; // moving average, mostly the last ~10
+
+	// max per LATENCY_MAX_WINDOW-long window, so old spikes age out
+	std::chrono::steady_clock::time_point window_start;
+	double window_max_ms = 0;
+	double last_window_max_ms = 0;
+
+	void add(const std::chrono::steady_clock::time_point& requested_at);
+
+	inline double average_ms() const {
+		return count > 0 ? total_ms / count : 0;
+	}
+
+	// max over this window and the last one (0 if nothing came in during them)
+	double recent_max_ms() const;
+};
+
+// how many queued requests the Mesher/Chunker got through, vs dropped because the player moved away before they got to them
+struct WorkCounters {
+	std::atomic<int> completed = 0;
+	std::atomic<int> cancelled = 0;
+};
+
+WorkCounters& get_mesh_work_counters();
+WorkCounters& get_chunk_work_counters();
+
+struct MeshGenResult : LiveCounted<MeshGenResult>
 {
 	MeshGenResult(const vmath::ivec3& coords_, bool invisible_, const std::unique_ptr<MiniChunkMesh>& mesh_, const std::unique_ptr<MiniChunkMesh>& water_mesh_) = delete;
 	MeshGenResult(const vmath::ivec3& coords_, bool invisible_, std::unique_ptr<MiniChunkMesh>&& mesh_, std::unique_ptr<MiniChunkMesh>&& water_mesh_);
@@ -33,36 +95,91 @@ struct MeshGenResult
 	bool invisible;
 	std::unique_ptr<MiniChunkMesh> mesh;
 	std::unique_ptr<MiniChunkMesh> water_mesh;
+
+	// which layers the meshes hold -- if not all, they replace just those layers of the existing meshes
+	MeshLayers layers = MeshLayers::all();
+
+	// which of the mini's faces you can see through it between (for cave culling), always for the whole mini
+	FaceConnections connections = FaceConnections::all();
+
+	// copied from the request, for measuring latency
+	RequestClass request_class = RequestClass::Background;
+	std::chrono::steady_clock::time_point requested_at;
 };
 
+// mini plus a 1-block border taken from its 6 neighbors, indexed [y][z][x]
+// border is at 0 and PADDED_SIZE - 1; missing neighbors, and the edges/corners (which meshing never looks at), are air
+constexpr int PADDED_SIZE = MINICHUNK_WIDTH + 2;
+using PaddedBlocks = uint8_t[PADDED_SIZE][PADDED_SIZE][PADDED_SIZE];
+
+// blocks to mesh, copied out of the world when the request was made (see gen_mesh_gen_request)
+// never changes afterwards, and doesn't point into the world, so the world can keep editing while we mesh
 struct MeshGenRequestData
 {
-	std::shared_ptr<MiniChunk> self;
-	std::shared_ptr<MiniChunk> north;
-	std::shared_ptr<MiniChunk> south;
-	std::shared_ptr<MiniChunk> east;
-	std::shared_ptr<MiniChunk> west;
-	std::shared_ptr<MiniChunk> up;
-	std::shared_ptr<MiniChunk> down;
+	PaddedBlocks blocks;
 };
 
-struct MeshGenRequest
+struct MeshGenRequest : LiveCounted<MeshGenRequest>
 {
 	vmath::ivec3 coords;
-	std::shared_ptr<MeshGenRequestData> data;
+
+	// all air, or hidden behind its neighbors -- nothing to mesh
+	bool invisible = false;
+
+	// if invisible, its face connections (all if it's all air, none if it's all opaque); worked out by the mesher otherwise
+	FaceConnections connections = FaceConnections::all();
+
+	// layers to remesh (e.g. just the ones around an edited block)
+	MeshLayers layers = MeshLayers::all();
+
+	RequestClass request_class = RequestClass::Background;
+	std::chrono::steady_clock::time_point requested_at = std::chrono::steady_clock::now();
+
+	// nullptr if invisible
+	std::shared_ptr<const MeshGenRequestData> data;
 };
 
-struct ChunkGenRequest
+// chunks (and their meshes) further than render distance + this from the player get unloaded
+// the margin stops walking back and forth over a chunk border from unloading and reloading the same chunks
+constexpr int UNLOAD_DISTANCE_MARGIN = 2;
+
+// EVENT_PLAYER_MOVED_CHUNKS data
+// sent whenever the player's chunk or render distance changes
+struct PlayerMovedChunksEvent
+{
+	vmath::ivec2 coords; // chunk coords player is in
+	int render_distance;
+};
+
+// sent by the renderer when it drops meshes of minis whose chunks might still be loaded (e.g. to stay within its memory budget),
+// or drops partial remeshes of minis it has no whole mesh for
+// the world remeshes them once they're within render distance, since it won't regenerate (and so remesh) chunks it has
+struct MeshesDroppedEvent
+{
+	std::vector<vmath::ivec3> coords; // mini coords
+};
+
+struct ChunkGenRequest : LiveCounted<ChunkGenRequest>
 {
 	vmath::ivec2 coords;
+
+	RequestClass request_class = RequestClass::Background;
+	std::chrono::steady_clock::time_point requested_at = std::chrono::steady_clock::now();
 };
 
-struct ChunkGenResponse
+struct ChunkGenResponse : LiveCounted<ChunkGenResponse>
 {
 	vmath::ivec2 coords;
 	std::unique_ptr<Chunk> chunk;
+
+	// copied from the request, for measuring latency
+	RequestClass request_class = RequestClass::Background;
+	std::chrono::steady_clock::time_point requested_at;
 };
 
+// whether chunk at `coords` is far enough from the player to unload (see UNLOAD_DISTANCE_MARGIN)
+bool should_unload_chunk(const vmath::ivec2& coords, const vmath::ivec2& player_chunk_coords, const int render_distance);
+
 // get chunk-coordinates of chunk containing the block at (x, _, z)
 vmath::ivec2 get_chunk_coords(const int x, const int z);
 
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// like assert, but also checked in Release, and says where it failed
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+		std::exit(1); \
+	} \
+} while (0)
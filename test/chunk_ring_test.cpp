@@ -0,0 +1,141 @@
+// ChunkRing: random single steps, long jumps and radius changes, with chunks loading and unloading in between,
+// checked against a plain map of what's loaded.
+#include "check.h"
+
+#include "chunk_ring.h"
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+
+namespace {
+	std::mt19937 rng(10);
+
+	// what's loaded, like WorldDataPart::chunk_map
+	std::map<std::pair<int, int>, std::shared_ptr<Chunk>> loaded;
+
+	std::shared_ptr<Chunk> lookup(const vmath::ivec2& coords) {
+		const auto search = loaded.find({ coords[0], coords[1] });
+		return search == loaded.end() ? nullptr : search->second;
+	}
+
+	int random_in(const int min, const int max) {
+		return min + static_cast<int>(rng() % (max - min + 1));
+	}
+
+	// window the ring should have: smallest power of 2 fitting [center - radius, center + radius], starting size/2 before center
+	void check_matches(const ChunkRing& ring, const vmath::ivec2& center, const int radius) {
+		int size = 1;
+		while (size < 2 * radius + 1) {
+			size *= 2;
+		}
+		CHECK(ring.size() == size);
+
+		const vmath::ivec2 window_min = center - vmath::ivec2(size / 2, size / 2);
+		for (int z = window_min[1] - 2; z < window_min[1] + size + 2; z++) {
+			for (int x = window_min[0] - 2; x < window_min[0] + size + 2; x++) {
+				const bool inside = window_min[0] <= x && x < window_min[0] + size && window_min[1] <= z && z < window_min[1] + size;
+				CHECK(ring.in_window({ x, z }) == inside);
+				if (inside) {
+					const std::shared_ptr<Chunk> expected = lookup({ x, z });
+					CHECK(ring.get({ x, z }) == expected.get());
+					CHECK(ring.get_shared({ x, z }) == expected);
+				}
+			}
+		}
+
+		// everything within radius fits
+		CHECK(ring.in_window(center - vmath::ivec2(radius, radius)) && ring.in_window(center + vmath::ivec2(radius, radius)));
+	}
+
+	// load/unload a few chunks around center, keeping the ring up to date like the world does
+	void load_and_unload(ChunkRing& ring, const vmath::ivec2& center, const int radius) {
+		const int num = random_in(0, 20);
+		for (int i = 0; i < num; i++) {
+			const vmath::ivec2 coords = center + vmath::ivec2(random_in(-radius - 4, radius + 4), random_in(-radius - 4, radius + 4));
+			if (rng() % 3 == 0) {
+				loaded.erase({ coords[0], coords[1] });
+				ring.set(coords, nullptr); // outside the window => ignored
+			}
+			else {
+				auto chunk = std::make_shared<Chunk>(coords);
+				loaded[{ coords[0], coords[1] }] = chunk;
+				ring.set(coords, chunk);
+			}
+		}
+	}
+
+	void test_random() {
+		ChunkRing ring;
+		vmath::ivec2 center = { 0, 0 };
+		int radius = 6;
+		ring.reset(center, radius);
+		check_matches(ring, center, radius);
+
+		for (int i = 0; i < 3000; i++) {
+			switch (rng() % 8) {
+			case 0: case 1: case 2: case 3: // single step, like walking (including diagonally, and not moving at all)
+				center += vmath::ivec2(random_in(-1, 1), random_in(-1, 1));
+				break;
+			case 4: // a few chunks at once, some of the window left
+				center += vmath::ivec2(random_in(-12, 12), random_in(-12, 12));
+				break;
+			case 5: // teleport, further than a whole window
+				center += vmath::ivec2(random_in(-300, 300), random_in(-300, 300));
+				break;
+			case 6: // render distance changed (sometimes to the same size)
+				radius = random_in(0, 20);
+				break;
+			case 7: // both at once
+				radius = random_in(0, 20);
+				center += vmath::ivec2(random_in(-2, 2), random_in(-2, 2));
+				break;
+			}
+
+			ring.recenter(center, radius, lookup);
+			check_matches(ring, center, radius);
+
+			load_and_unload(ring, center, radius);
+			check_matches(ring, center, radius);
+		}
+	}
+
+	// negative coords mask into the same slots as positive ones -- make sure they never alias inside the window
+	void test_negative_coords() {
+		loaded.clear();
+		ChunkRing ring;
+		ring.reset({ -1, -1 }, 3);
+
+		for (int z = -9; z <= 7; z++) {
+			for (int x = -9; x <= 7; x++) {
+				auto chunk = std::make_shared<Chunk>(vmath::ivec2(x, z));
+				loaded[{ x, z }] = chunk;
+				ring.set({ x, z }, chunk);
+			}
+		}
+		check_matches(ring, { -1, -1 }, 3);
+
+		// across 0 and back, a step at a time
+		vmath::ivec2 center = { -1, -1 };
+		for (int i = 0; i < 6; i++) {
+			center += vmath::ivec2(1, -1);
+			ring.recenter(center, 3, lookup);
+			check_matches(ring, center, 3);
+		}
+		for (int i = 0; i < 6; i++) {
+			center -= vmath::ivec2(1, -1);
+			ring.recenter(center, 3, lookup);
+			check_matches(ring, center, 3);
+		}
+	}
+}
+
+int main() {
+	test_random();
+	test_negative_coords();
+
+	std::printf("chunk_ring_test: ok\n");
+	return 0;
+}
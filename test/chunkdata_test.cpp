@@ -0,0 +1,232 @@
+// BlockPalette, and ChunkData switching between RLE and bit-packed storage: every block has to read back the same
+// across every index width and every switch, and switches happen exactly at PALETTE_MIN_INTERVALS / RLE_MAX_INTERVALS.
+#include "check.h"
+
+#include "chunkdata.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+	std::mt19937 rng(2);
+
+	constexpr int SIZE = 16;
+	constexpr int NUM_BLOCKS = SIZE * SIZE * SIZE;
+
+	int count_runs(const std::vector<BlockType>& model) {
+		int result = 1;
+		for (int i = 1; i < NUM_BLOCKS; i++) {
+			result += model[i] != model[i - 1];
+		}
+		return result;
+	}
+
+	void check_matches(const BlockPalette& palette, const std::vector<BlockType>& model) {
+		for (int i = 0; i < NUM_BLOCKS; i++) {
+			CHECK(palette.get(i) == model[i]);
+		}
+		CHECK(palette.num_runs() == count_runs(model));
+	}
+
+	// adding types widens indices at 2, 4, 16 types; removing them frees slots for re-use without shrinking
+	void test_palette_widths() {
+		BlockPalette palette;
+		palette.init(NUM_BLOCKS, BlockType::Air);
+		std::vector<BlockType> model(NUM_BLOCKS, BlockType::Air);
+		CHECK(palette.bits_per_block() == 1 && palette.num_types() == 1);
+
+		// type t goes in every 257th block (offset by t), so they're spread over every word and never overwrite each other
+		for (int t = 1; t < 256; t++) {
+			const BlockType type = (uint8_t)t;
+			for (int i = t; i < NUM_BLOCKS; i += 257) {
+				palette.set(i, type);
+				model[i] = type;
+			}
+
+			const int num_types = t + 1;
+			CHECK(palette.num_types() == num_types);
+			const int expected_bits = num_types <= 2 ? 1 : num_types <= 4 ? 2 : num_types <= 16 ? 4 : 8;
+			CHECK(palette.bits_per_block() == expected_bits);
+			CHECK(palette.contains(type));
+
+			// right after each widening, and now and then otherwise
+			if (num_types == 3 || num_types == 5 || num_types == 17 || t % 32 == 0) {
+				check_matches(palette, model);
+			}
+		}
+		check_matches(palette, model);
+
+		// all 256 types are in there; overwrite a whole type, then reuse its slot for another
+		for (int i = 0; i < NUM_BLOCKS; i++) {
+			if (model[i] == BlockType(uint8_t(200))) {
+				palette.set(i, BlockType::Stone);
+				model[i] = BlockType::Stone;
+			}
+		}
+		CHECK(!palette.contains(BlockType(uint8_t(200))) && palette.num_types() == 255);
+		palette.set(5, (uint8_t)200);
+		model[5] = (uint8_t)200;
+		CHECK(palette.contains(BlockType(uint8_t(200))) && palette.num_types() == 256);
+		check_matches(palette, model);
+
+		// ranges (partial words, whole words, single blocks), including ones that widen indices as they go in
+		palette.init(NUM_BLOCKS, BlockType::Stone);
+		model.assign(NUM_BLOCKS, BlockType::Stone);
+		for (int i = 0; i < 2000; i++) {
+			const int begin = static_cast<int>(rng() % NUM_BLOCKS);
+			const int end = std::min(NUM_BLOCKS, begin + static_cast<int>(rng() % (i % 3 == 0 ? 1000 : 70)));
+			const BlockType type = (uint8_t)(rng() % (i < 1000 ? 20 : 256));
+			palette.set_range(begin, end, type);
+			std::fill(model.begin() + begin, model.begin() + end, type);
+
+			if (i % 20 == 0) {
+				check_matches(palette, model);
+			}
+		}
+		check_matches(palette, model);
+	}
+
+	void check_matches(const ChunkData& data, const std::vector<BlockType>& model) {
+		std::vector<BlockType> extracted(NUM_BLOCKS);
+		data.extract_blocks(extracted.data());
+
+		for (int y = 0; y < SIZE; y++) {
+			for (int z = 0; z < SIZE; z++) {
+				for (int x = 0; x < SIZE; x++) {
+					const BlockType expected = model[x + z * SIZE + y * SIZE * SIZE];
+					CHECK(data.get_block(x, y, z) == expected);
+					CHECK(extracted[x + z * SIZE + y * SIZE * SIZE] == expected);
+					CHECK(data.is_opaque(x, y, z) == !expected.is_translucent());
+					CHECK(data.is_solid(x, y, z) == expected.is_solid());
+				}
+			}
+		}
+	}
+
+	// runs the RLE map would have for `model`
+	// the map's air before block 0 and after the last block are runs too, unless they merge with the blocks' own ones
+	int rle_intervals(const std::vector<BlockType>& model) {
+		return count_runs(model) + (model[0] != BlockType::Air) + (model[NUM_BLOCKS - 1] != BlockType::Air);
+	}
+
+	struct Tester {
+		ChunkData data{ SIZE, SIZE, SIZE };
+		std::vector<BlockType> model = std::vector<BlockType>(NUM_BLOCKS, BlockType::Air);
+		int edits_since_palette = 0; // single-block edits since switching to palette
+
+		Tester() {
+			data.allocate();
+		}
+
+		void set_block(const int idx, const BlockType& val) {
+			const bool was_palette = data.uses_palette();
+			data.set_block(idx % SIZE, idx / (SIZE * SIZE), (idx / SIZE) % SIZE, val);
+			model[idx] = val;
+
+			if (!was_palette) {
+				// RLE => palette as soon as there are too many runs
+				CHECK(data.uses_palette() == (rle_intervals(model) > PALETTE_MIN_INTERVALS));
+				edits_since_palette = 0;
+			}
+			else if (++edits_since_palette % PALETTE_RECHECK_EDITS == 0) {
+				// palette => RLE only when re-checked, and only once runs are few enough
+				CHECK(data.uses_palette() == (count_runs(model) >= RLE_MAX_INTERVALS));
+			}
+			else {
+				CHECK(data.uses_palette());
+			}
+		}
+
+		void fill_box(const vmath::ivec3& min_xyz, const vmath::ivec3& max_xyz, const BlockType& val) {
+			const bool was_palette = data.uses_palette();
+			data.fill_box(min_xyz, max_xyz, val);
+			for (int y = min_xyz[1]; y <= max_xyz[1]; y++) {
+				for (int z = min_xyz[2]; z <= max_xyz[2]; z++) {
+					for (int x = min_xyz[0]; x <= max_xyz[0]; x++) {
+						model[x + z * SIZE + y * SIZE * SIZE] = val;
+					}
+				}
+			}
+
+			// bulk edits re-check right away, in both directions
+			if (was_palette) {
+				CHECK(data.uses_palette() == (count_runs(model) >= RLE_MAX_INTERVALS));
+			}
+			else {
+				CHECK(data.uses_palette() == (rle_intervals(model) > PALETTE_MIN_INTERVALS));
+			}
+			edits_since_palette = 0;
+		}
+	};
+
+	// single-block edits: get noisy until it switches to palette, then smooth it out until it switches back, a few times over
+	void test_switching_by_block() {
+		Tester tester;
+		int num_switches = 0;
+
+		for (int cycle = 0; cycle < 6; cycle++) {
+			// more block types every cycle, so the palette switches at different index widths
+			const int num_types = cycle < 2 ? 2 : cycle < 4 ? 6 : 40;
+
+			// noise, until it's bit-packed (and a bit beyond, so runs end up well clear of RLE_MAX_INTERVALS)
+			int extra = 0;
+			while (extra < 300) {
+				const int idx = static_cast<int>(rng() % NUM_BLOCKS);
+				tester.set_block(idx, (uint8_t)(1 + rng() % num_types));
+				extra += tester.data.uses_palette();
+			}
+			CHECK(tester.data.uses_palette());
+			num_switches++;
+			check_matches(tester.data, tester.model);
+
+			// smooth it out a block at a time, from the bottom up, until it's RLE again
+			// runs pass through [RLE_MAX_INTERVALS, PALETTE_MIN_INTERVALS] on the way, where it has to stay bit-packed
+			const BlockType fill = (uint8_t)(1 + cycle % 3);
+			for (int idx = 0; idx < NUM_BLOCKS && tester.data.uses_palette(); idx++) {
+				tester.set_block(idx, fill);
+			}
+			CHECK(!tester.data.uses_palette());
+			num_switches++;
+			check_matches(tester.data, tester.model);
+		}
+
+		CHECK(num_switches == 12);
+	}
+
+	// bulk edits: scatter little boxes of random blocks through solid stone, then wipe most of them with a big slab
+	void test_switching_by_box() {
+		Tester tester;
+		tester.fill_box({ 0, 0, 0 }, { SIZE - 1, SIZE - 1, SIZE - 1 }, BlockType::Stone);
+		CHECK(!tester.data.uses_palette());
+
+		for (int cycle = 0; cycle < 20; cycle++) {
+			// lots of little boxes of random types, one at a time -- some switch it, most don't
+			for (int i = 0; i < 150; i++) {
+				const vmath::ivec3 min_xyz = { int(rng() % SIZE), int(rng() % SIZE), int(rng() % SIZE) };
+				const vmath::ivec3 max_xyz = {
+					std::min(SIZE - 1, min_xyz[0] + int(rng() % 3)),
+					std::min(SIZE - 1, min_xyz[1] + int(rng() % 3)),
+					std::min(SIZE - 1, min_xyz[2] + int(rng() % 3)),
+				};
+				tester.fill_box(min_xyz, max_xyz, (uint8_t)(rng() % 30));
+			}
+			check_matches(tester.data, tester.model);
+
+			// then wipe most of it in a few big slabs
+			const int top = static_cast<int>(rng() % SIZE);
+			tester.fill_box({ 0, 0, 0 }, { SIZE - 1, top, SIZE - 1 }, BlockType::Stone);
+			check_matches(tester.data, tester.model);
+		}
+	}
+}
+
+int main() {
+	test_palette_widths();
+	test_switching_by_block();
+	test_switching_by_box();
+
+	std::printf("chunkdata_test: ok\n");
+	return 0;
+}
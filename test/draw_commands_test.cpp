@@ -0,0 +1,84 @@
+// DrawCommandList: skipping empty draws, vertex counts, sorting by first, and clear() keeping its memory between frames.
+#include "check.h"
+
+#include "draw_commands.h"
+
+#include <cstdio>
+#include <vector>
+
+namespace {
+	void test_add() {
+		DrawCommandList list;
+		CHECK(list.empty() && list.num_vertices() == 0);
+
+		list.add(100, 6, 3);
+		list.add(50, 0, 4); // empty -> skipped
+		list.add(0, 12, 5);
+
+		CHECK(list.size() == 2);
+		CHECK(list.num_vertices() == 18);
+
+		const auto& cmd = list.get_commands()[0];
+		CHECK(cmd.count == 6);
+		CHECK(cmd.instance_count == 1);
+		CHECK(cmd.first == 100);
+		CHECK(cmd.base_instance == 3);
+
+		// all empty
+		DrawCommandList nothing;
+		nothing.add(0, 0, 0);
+		nothing.add(10, 0, 1);
+		CHECK(nothing.empty() && nothing.num_vertices() == 0);
+	}
+
+	void test_sort_by_first() {
+		DrawCommandList list;
+		const uint32_t firsts[] = { 300, 0, 120, 60, 240, 30 };
+		for (uint32_t i = 0; i < 6; i++) {
+			list.add(firsts[i], 3 + i, i);
+		}
+		list.sort_by_first();
+
+		const auto& cmds = list.get_commands();
+		CHECK(cmds.size() == 6);
+		for (size_t i = 1; i < cmds.size(); i++) {
+			CHECK(cmds[i - 1].first < cmds[i].first);
+		}
+
+		// whole commands move, not just `first`
+		for (const auto& cmd : cmds) {
+			CHECK(firsts[cmd.base_instance] == cmd.first);
+			CHECK(cmd.count == 3 + cmd.base_instance);
+		}
+		CHECK(list.num_vertices() == 3 + 4 + 5 + 6 + 7 + 8);
+	}
+
+	void test_clear() {
+		DrawCommandList list;
+		for (uint32_t i = 0; i < 100; i++) {
+			list.add(i * 6, 6, i);
+		}
+		const size_t capacity = list.get_commands().capacity();
+		const auto* data = list.get_commands().data();
+
+		list.clear();
+		CHECK(list.empty() && list.num_vertices() == 0);
+		CHECK(list.get_commands().capacity() == capacity);
+
+		// next frame reuses the same memory
+		for (uint32_t i = 0; i < 100; i++) {
+			list.add(i * 3, 3, i);
+		}
+		CHECK(list.get_commands().data() == data);
+		CHECK(list.num_vertices() == 300);
+	}
+}
+
+int main() {
+	test_add();
+	test_sort_by_first();
+	test_clear();
+
+	std::printf("draw_commands_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,181 @@
+// FlatIntervalMap: random set_interval calls (overlapping, nested, adjacent, empty), checked against a std::map of runs
+// that's rebuilt the slow way -- including that equal neighboring runs always get merged.
+#include "check.h"
+
+#include "util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+	std::mt19937 rng(1);
+
+	constexpr short NUM_KEYS = 4096; // a mini's worth, like ChunkData uses
+
+	// (run start) -> value, set the obvious way
+	struct Model {
+		std::map<short, int> runs;
+
+		explicit Model(const int v) {
+			runs[std::numeric_limits<short>::lowest()] = v;
+		}
+
+		int get(const short k) const {
+			return std::prev(runs.upper_bound(k))->second;
+		}
+
+		void set_interval(const short begin, const short end, const int v) {
+			if (begin >= end) {
+				return;
+			}
+
+			const int end_v = get(end);
+			runs.erase(runs.lower_bound(begin), runs.upper_bound(end));
+			runs[begin] = v;
+			runs[end] = end_v;
+
+			// merge runs with the same value as the one before them
+			for (auto it = std::next(runs.begin()); it != runs.end();) {
+				if (std::prev(it)->second == it->second) {
+					it = runs.erase(it);
+				}
+				else {
+					++it;
+				}
+			}
+		}
+	};
+
+	void check_matches(const FlatIntervalMap<short, int>& map, const Model& model) {
+		// same runs, in the same order -- so nothing's left unmerged
+		CHECK(map.num_intervals() == model.runs.size());
+		auto expected = model.runs.begin();
+		for (const auto& [start, v] : map) {
+			CHECK(start == expected->first && v == expected->second);
+			++expected;
+		}
+
+		for (short k = 0; k <= NUM_KEYS; k++) {
+			CHECK(map[k] == model.get(k));
+			CHECK(map.get_interval(k)->first == std::prev(model.runs.upper_bound(k))->first);
+		}
+	}
+
+	short random_key() {
+		return static_cast<short>(rng() % (NUM_KEYS + 1));
+	}
+
+	void test_random() {
+		FlatIntervalMap<short, int> map(0);
+		Model model(0);
+
+		for (int i = 0; i < 20000; i++) {
+			short begin = random_key();
+			short end;
+			switch (rng() % 6) {
+			case 0: // single key, like setting a block
+				end = static_cast<short>(begin + 1);
+				break;
+			case 1: // short
+				end = static_cast<short>(begin + rng() % 16);
+				break;
+			case 2: // right up against an existing run, on either side
+			{
+				const auto run = model.runs.upper_bound(begin);
+				end = run == model.runs.end() ? NUM_KEYS : run->first;
+				if (rng() % 2) {
+					begin = std::prev(run)->first;
+				}
+				break;
+			}
+			case 3: // exactly an existing run (so it can merge with both neighbors)
+			{
+				const auto run = std::prev(model.runs.upper_bound(begin));
+				begin = std::max<short>(run->first, 0);
+				const auto next = std::next(run);
+				end = next == model.runs.end() ? NUM_KEYS : next->first;
+				break;
+			}
+			case 4: // empty or backwards => nothing
+				end = static_cast<short>(begin - static_cast<int>(rng() % 3));
+				break;
+			default: // anything, usually overlapping lots of runs
+				end = random_key();
+				break;
+			}
+			end = std::min(end, NUM_KEYS);
+
+			// few values, so merges happen all the time
+			const int v = static_cast<int>(rng() % 4);
+			map.set_interval(begin, end, v);
+			model.set_interval(begin, end, v);
+
+			// checking every key each time is slow, so just look at the runs most of the time
+			if (i % 50 == 0) {
+				check_matches(map, model);
+			}
+			else {
+				CHECK(map.num_intervals() == model.runs.size());
+				CHECK(map[begin] == model.get(begin) && map[end] == model.get(end));
+			}
+		}
+		check_matches(map, model);
+	}
+
+	void test_merges() {
+		FlatIntervalMap<short, int> map(0);
+		Model model(0);
+		const auto set = [&](const short begin, const short end, const int v) {
+			map.set_interval(begin, end, v);
+			model.set_interval(begin, end, v);
+			check_matches(map, model);
+		};
+
+		set(10, 20, 1);
+		CHECK(map.num_intervals() == 3);
+
+		// adjacent, same value => one run
+		set(20, 30, 1);
+		set(5, 10, 1);
+		CHECK(map.num_intervals() == 3 && map.num_intervals(5, 30) == 1);
+
+		// split in the middle, then fill the hole back in
+		set(15, 16, 2);
+		CHECK(map.num_intervals() == 5);
+		set(15, 16, 1);
+		CHECK(map.num_intervals() == 3);
+
+		// back to the default => the map's back to a single run
+		set(0, 40, 0);
+		CHECK(map.num_intervals() == 1);
+
+		// covering several runs at once
+		set(1, 2, 1);
+		set(3, 4, 2);
+		set(5, 6, 3);
+		set(0, 10, 2);
+		CHECK(map.num_intervals() == 3);
+
+		// right at the end of the keys
+		set(NUM_KEYS - 1, NUM_KEYS, 3);
+		set(0, NUM_KEYS, 3);
+		CHECK(map.num_intervals() == 3);
+
+		map.clear(7);
+		CHECK(map.num_intervals() == 1 && map[0] == 7 && map[NUM_KEYS] == 7);
+	}
+}
+
+int main() {
+	test_merges();
+	test_random();
+
+	std::printf("flat_interval_map_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,216 @@
+// FreeListAllocator: best fit, merging, grow, compact and fragmentation, then a long random run checked against a model
+// that just remembers which units are in use.
+#include "check.h"
+
+#include "free_list_allocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+	using Block = FreeListAllocator::Block;
+
+	void test_best_fit() {
+		FreeListAllocator a(100);
+		const size_t b0 = a.allocate(10), b1 = a.allocate(30), b2 = a.allocate(10), b3 = a.allocate(20), b4 = a.allocate(10);
+		CHECK(b0 == 0 && b1 == 10 && b2 == 40 && b3 == 50 && b4 == 70);
+
+		// free: 30 at 10, 20 at 50, 20 at 80
+		a.free(b1, 30);
+		a.free(b3, 20);
+		CHECK(a.get_stats().num_free_ranges == 3);
+
+		// smallest range that fits (lowest offset on ties), splitting off the rest
+		CHECK(a.allocate(15) == 50);
+		CHECK(a.allocate(25) == 10);
+		CHECK(a.allocate(20) == 80);
+		CHECK(a.allocate(6) == FreeListAllocator::NONE);
+		// 5 left at 35 and 65
+		CHECK(a.allocate(5) == 35);
+	}
+
+	void test_merge() {
+		FreeListAllocator a(30);
+		const size_t b0 = a.allocate(10), b1 = a.allocate(10), b2 = a.allocate(10);
+		CHECK(a.get_stats().num_free_ranges == 0);
+
+		a.free(b0, 10);
+		a.free(b2, 10);
+		CHECK(a.get_stats().num_free_ranges == 2);
+		CHECK(a.allocate(11) == FreeListAllocator::NONE);
+
+		// free range between two free ranges merges with both
+		a.free(b1, 10);
+		const auto stats = a.get_stats();
+		CHECK(stats.num_free_ranges == 1);
+		CHECK(stats.largest_free_range == 30);
+		CHECK(stats.used == 0 && stats.num_allocations == 0);
+		CHECK(a.allocate(30) == 0);
+	}
+
+	void test_grow() {
+		// full -> new range at the end
+		FreeListAllocator a(10);
+		CHECK(a.allocate(10) == 0);
+		CHECK(a.allocate(5) == FreeListAllocator::NONE);
+		a.grow(20);
+		CHECK(a.capacity() == 20 && a.used() == 10);
+		CHECK(a.get_stats().num_allocations == 1);
+		CHECK(a.allocate(5) == 10);
+
+		// free space at the end -> merges with the new space
+		FreeListAllocator b(10);
+		CHECK(b.allocate(5) == 0);
+		b.grow(20);
+		const auto stats = b.get_stats();
+		CHECK(stats.num_free_ranges == 1);
+		CHECK(stats.largest_free_range == 15);
+		CHECK(b.allocate(15) == 5);
+	}
+
+	void test_compact() {
+		FreeListAllocator a(100);
+		Block b0{ a.allocate(10), 10 }, b1{ a.allocate(20), 20 }, b2{ a.allocate(5), 5 }, b3{ a.allocate(15), 15 };
+		a.free(b0.offset, b0.size);
+		a.free(b2.offset, b2.size);
+		CHECK(a.get_stats().num_free_ranges == 3);
+
+		// order of `live` doesn't matter, the order of offsets does
+		a.compact({ &b3, &b1 });
+		CHECK(b1.offset == 0);
+		CHECK(b3.offset == 20);
+
+		const auto stats = a.get_stats();
+		CHECK(stats.total_moved == 35);
+		CHECK(stats.num_compactions == 1);
+		CHECK(stats.num_free_ranges == 1);
+		CHECK(stats.largest_free_range == 65);
+		CHECK(stats.used == 35 && stats.num_allocations == 2);
+		CHECK(a.allocate(65) == 35);
+
+		// already packed -> nothing moves
+		a.free(35, 65);
+		a.compact({ &b1, &b3 });
+		CHECK(a.get_stats().total_moved == 35);
+		CHECK(a.get_stats().num_compactions == 2);
+	}
+
+	void test_fragmentation() {
+		FreeListAllocator a(40);
+		CHECK(a.fragmentation() == 0.0f);
+
+		const size_t b0 = a.allocate(10), b1 = a.allocate(10), b2 = a.allocate(10), b3 = a.allocate(10);
+		(void)b1;
+		// full
+		CHECK(a.fragmentation() == 0.0f);
+
+		// 10 + 10 free, largest 10
+		a.free(b0, 10);
+		a.free(b2, 10);
+		CHECK(std::abs(a.fragmentation() - 0.5f) < 1e-6f);
+
+		// 10 + 20 free, largest 20
+		a.free(b3, 10);
+		CHECK(std::abs(a.fragmentation() - 1.0f / 3.0f) < 1e-6f);
+	}
+
+	// random allocs, frees, grows and compactions, checking offsets and stats against which units are actually in use
+	void test_random() {
+		std::mt19937 rng(1);
+		FreeListAllocator a(1000);
+		std::vector<bool> in_use(1000, false);
+		std::vector<Block> live;
+
+		for (int i = 0; i < 20000; i++) {
+			if (rng() % 2 == 0) {
+				const size_t size = 1 + rng() % 50;
+				const size_t offset = a.allocate(size);
+
+				if (offset == FreeListAllocator::NONE) {
+					// there mustn't have been a big enough range
+					size_t run = 0;
+					for (size_t j = 0; j < in_use.size(); j++) {
+						run = in_use[j] ? 0 : run + 1;
+						CHECK(run < size);
+					}
+
+					if (rng() % 2 == 0) {
+						a.grow(a.capacity() + 100);
+						in_use.resize(a.capacity(), false);
+					} else {
+						std::vector<Block*> ptrs;
+						for (Block& block : live) {
+							ptrs.push_back(&block);
+						}
+						a.compact(ptrs);
+						CHECK(a.get_stats().num_free_ranges <= 1);
+
+						std::fill(in_use.begin(), in_use.end(), false);
+						for (const Block& block : live) {
+							for (size_t j = block.offset; j < block.offset + block.size; j++) {
+								CHECK(!in_use[j]);
+								in_use[j] = true;
+							}
+						}
+					}
+					continue;
+				}
+
+				CHECK(offset + size <= a.capacity());
+				for (size_t j = offset; j < offset + size; j++) {
+					CHECK(!in_use[j]);
+					in_use[j] = true;
+				}
+				live.push_back({ offset, size });
+			} else if (!live.empty()) {
+				const size_t k = rng() % live.size();
+				const Block block = live[k];
+				live[k] = live.back();
+				live.pop_back();
+
+				a.free(block.offset, block.size);
+				for (size_t j = block.offset; j < block.offset + block.size; j++) {
+					in_use[j] = false;
+				}
+			}
+
+			size_t used = 0, num_free_ranges = 0, largest = 0, run = 0;
+			for (size_t j = 0; j < in_use.size(); j++) {
+				if (in_use[j]) {
+					used++;
+					run = 0;
+				} else {
+					num_free_ranges += run == 0;
+					run++;
+					largest = std::max(largest, run);
+				}
+			}
+
+			const auto stats = a.get_stats();
+			CHECK(stats.capacity == in_use.size());
+			CHECK(stats.used == used);
+			CHECK(stats.num_allocations == live.size());
+			CHECK(stats.num_free_ranges == num_free_ranges);
+			CHECK(stats.largest_free_range == largest);
+		}
+
+		// should've hit both
+		CHECK(a.capacity() > 1000);
+		CHECK(a.get_stats().num_compactions > 0);
+	}
+}
+
+int main() {
+	test_best_fit();
+	test_merge();
+	test_grow();
+	test_compact();
+	test_fragmentation();
+	test_random();
+
+	std::printf("free_list_allocator_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,163 @@
+// IndexedHeap: random push, update, erase, pop, erase_if and reprioritize, checked against a sorted model of what should be in it.
+#include "check.h"
+
+#include "indexed_heap.h"
+
+#include <climits>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+	// what should be in the heap
+	struct Model {
+		std::map<int, std::pair<int, int>> entries; // key -> (priority, value)
+		std::multiset<int> priorities; // sorted
+
+		auto find(const int key) {
+			return entries.find(key);
+		}
+
+		void set(const int key, const int priority, const int value) {
+			remove(key);
+			entries[key] = { priority, value };
+			priorities.insert(priority);
+		}
+
+		void remove(const int key) {
+			const auto search = entries.find(key);
+			if (search != entries.end()) {
+				priorities.erase(priorities.find(search->second.first));
+				entries.erase(search);
+			}
+		}
+
+		int min_priority() const {
+			return *priorities.begin();
+		}
+	};
+
+	template <int D>
+	void check_matches(IndexedHeap<int, int, std::hash<int>, D>& heap, const Model& model) {
+		CHECK(heap.size() == model.entries.size());
+		CHECK(heap.empty() == model.entries.empty());
+		if (!heap.empty()) {
+			CHECK(heap.top().priority == model.min_priority());
+		}
+	}
+
+	template <int D>
+	void test_random(const unsigned seed) {
+		std::mt19937 rng(seed);
+		IndexedHeap<int, int, std::hash<int>, D> heap;
+		Model model;
+
+		for (int i = 0; i < 30000; i++) {
+			const int key = static_cast<int>(rng() % 300);
+			const int priority = static_cast<int>(rng() % 100) - 50; // lots of ties
+			const auto in_model = model.find(key);
+
+			switch (rng() % 16) {
+			case 0: case 1: case 2: case 3: case 4: // push (or update, if it's already in)
+				if (in_model == model.entries.end()) {
+					heap.push(key, priority, i);
+					model.set(key, priority, i);
+				}
+				else {
+					CHECK(heap.update(key, priority));
+					model.set(key, priority, in_model->second.second);
+				}
+				break;
+			case 5: case 6: case 7: // update
+				CHECK(heap.update(key, priority) == (in_model != model.entries.end()));
+				if (in_model != model.entries.end()) {
+					model.set(key, priority, in_model->second.second);
+				}
+				break;
+			case 8: case 9: { // erase
+				int value = -1;
+				CHECK(heap.erase(key, &value) == (in_model != model.entries.end()));
+				if (in_model != model.entries.end()) {
+					CHECK(value == in_model->second.second);
+					model.remove(key);
+				}
+				break;
+			}
+			case 10: case 11: case 12: // pop (any entry with the lowest priority)
+				if (!model.entries.empty()) {
+					const auto entry = heap.pop();
+					const auto popped = model.find(entry.key);
+					CHECK(popped != model.entries.end());
+					CHECK(entry.priority == model.min_priority());
+					CHECK(entry.priority == popped->second.first);
+					CHECK(entry.value == popped->second.second);
+					model.remove(entry.key);
+				}
+				break;
+			case 13: { // find
+				const int* value = heap.find(key);
+				CHECK((value != nullptr) == (in_model != model.entries.end()));
+				CHECK(heap.contains(key) == (in_model != model.entries.end()));
+				if (value) {
+					CHECK(*value == in_model->second.second);
+				}
+				break;
+			}
+			case 14: { // erase_if
+				const int cutoff = static_cast<int>(rng() % 300);
+				std::vector<int> to_remove;
+				for (const auto& [k, entry] : model.entries) {
+					if (k % 7 == cutoff % 7 && entry.first > 30) {
+						to_remove.push_back(k);
+					}
+				}
+				for (const int k : to_remove) {
+					model.remove(k);
+				}
+				const size_t expected = to_remove.size();
+				CHECK(heap.erase_if([cutoff](const auto& entry) { return entry.key % 7 == cutoff % 7 && entry.priority > 30; }) == expected);
+				break;
+			}
+			case 15: { // reprioritize, like the queues do when the player moves
+				const int shift = static_cast<int>(rng() % 50);
+				const auto priority_of = [shift](const int k) { return (k * 31 + shift) % 97 - 40; };
+				heap.reprioritize(priority_of);
+				const auto old_entries = model.entries;
+				for (const auto& [k, entry] : old_entries) {
+					model.set(k, priority_of(k), entry.second);
+				}
+				break;
+			}
+			}
+
+			check_matches(heap, model);
+		}
+
+		// drain: priorities come out in order, and every key comes out exactly once
+		int last = INT_MIN;
+		while (!heap.empty()) {
+			const auto entry = heap.pop();
+			CHECK(entry.priority >= last);
+			last = entry.priority;
+
+			const auto popped = model.find(entry.key);
+			CHECK(popped != model.entries.end() && popped->second.first == entry.priority && popped->second.second == entry.value);
+			model.remove(entry.key);
+		}
+		CHECK(model.entries.empty() && model.priorities.empty());
+	}
+}
+
+int main() {
+	// the default, plus other arities, so every sift path gets a workout
+	test_random<4>(1);
+	test_random<4>(2);
+	test_random<2>(3);
+	test_random<8>(4);
+
+	std::printf("indexed_heap_test: ok\n");
+	return 0;
+}
@@ -0,0 +1,114 @@
+// Differential test: the binary greedy mesher (gen_minichunk_mesh) must produce the same quads as the scalar reference
+// mesher (gen_minichunk_mesh_reference), on random minis with water, leaves and missing neighbors.
+#include "check.h"
+
+#include "block.h"
+#include "world_meshing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+	std::mt19937 rng(5);
+
+	// mostly air, stone, dirt, grass, water and leaves, so there's plenty of translucent-next-to-opaque
+	constexpr BlockType::Value TYPES[] = {
+		BlockType::Air, BlockType::Air, BlockType::Air, BlockType::Stone, BlockType::Dirt, BlockType::Grass,
+		BlockType::FlowingWater, BlockType::StillWater, BlockType::OakLeaves, BlockType::Bedrock, BlockType::Sand,
+	};
+	constexpr int NUM_TYPES = sizeof(TYPES) / sizeof(TYPES[0]);
+
+	uint8_t random_block(const int style, const int y) {
+		switch (style) {
+		case 0: // noise
+			return (uint8_t)TYPES[rng() % NUM_TYPES];
+		case 1: // terrain-ish: solid-ish bottom half, sparse top half
+			if (y < 8) {
+				return (uint8_t)TYPES[3 + rng() % 2];
+			}
+			return rng() % 20 == 0 ? (uint8_t)TYPES[rng() % NUM_TYPES] : (uint8_t)BlockType::Air;
+		default: // mostly stone, with pockets of anything
+			return rng() % 3 ? (uint8_t)BlockType::Stone : (uint8_t)TYPES[rng() % NUM_TYPES];
+		}
+	}
+
+	// random mini, with each of the 6 neighbors' borders either random or missing (air)
+	std::shared_ptr<MeshGenRequest> random_request(const int style, const MeshLayers& layers) {
+		auto data = std::make_shared<MeshGenRequestData>();
+		std::memset(data->blocks, (uint8_t)BlockType::Air, sizeof(data->blocks));
+
+		// which neighbors are missing: -x, +x, -y, +y, -z, +z
+		bool missing[6];
+		for (bool& m : missing) {
+			m = rng() % 4 == 0;
+		}
+
+		for (int y = 0; y < PADDED_SIZE; y++) {
+			for (int z = 0; z < PADDED_SIZE; z++) {
+				for (int x = 0; x < PADDED_SIZE; x++) {
+					const int xb = x == 0 ? 0 : x == PADDED_SIZE - 1 ? 1 : -1;
+					const int yb = y == 0 ? 2 : y == PADDED_SIZE - 1 ? 3 : -1;
+					const int zb = z == 0 ? 4 : z == PADDED_SIZE - 1 ? 5 : -1;
+					const int num_borders = (xb >= 0) + (yb >= 0) + (zb >= 0);
+
+					// edges/corners are always air
+					if (num_borders > 1) {
+						continue;
+					}
+					const int border = std::max({ xb, yb, zb });
+					if (border >= 0 && missing[border]) {
+						continue;
+					}
+
+					data->blocks[y][z][x] = random_block(style, y);
+				}
+			}
+		}
+
+		auto req = std::make_shared<MeshGenRequest>();
+		req->coords = { 3, 32, -2 };
+		req->layers = layers;
+		req->data = data;
+		return req;
+	}
+
+	// quads as a sorted list, to compare meshes regardless of quad order
+	std::vector<uint64_t> sorted_quads(const MiniChunkMesh& mesh) {
+		std::vector<uint64_t> result;
+		for (const PackedQuad& quad : mesh.get_quads()) {
+			result.push_back((uint64_t(quad.attrs) << 32) | quad.corners);
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+}
+
+int main() {
+	size_t total_quads = 0;
+
+	for (int i = 0; i < 600; i++) {
+		// whole mesh mostly, but also the partial remeshes edits do
+		MeshLayers layers = MeshLayers::all();
+		if (i % 4 == 3) {
+			layers = MeshLayers::around_block({ int(rng() % 18) - 1, int(rng() % 18) - 1, int(rng() % 18) - 1 });
+		}
+
+		const auto req = random_request(i % 3, layers);
+		const auto expected = gen_minichunk_mesh_reference(req);
+		const auto actual = gen_minichunk_mesh(req);
+
+		CHECK(actual->size() == expected->size());
+		CHECK(sorted_quads(*actual) == sorted_quads(*expected));
+		total_quads += expected->size();
+	}
+
+	// something must've actually been meshed
+	CHECK(total_quads > 0);
+
+	std::printf("mesher_test: ok (%zu quads)\n", total_quads);
+	return 0;
+}
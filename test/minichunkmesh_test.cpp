@@ -0,0 +1,128 @@
+// MiniChunkMesh::replace_layers + MeshLayers::around_block: editing a block, remeshing just the layers around it and
+// splicing them into the old mesh must give the same quads as remeshing the whole mini.
+#include "check.h"
+
+#include "block.h"
+#include "world_meshing.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+	std::mt19937 rng(13);
+
+	// mostly air and stone, plus water and leaves, so edits both hide and uncover faces
+	constexpr BlockType::Value TYPES[] = {
+		BlockType::Air, BlockType::Air, BlockType::Air, BlockType::Stone, BlockType::Stone, BlockType::Dirt,
+		BlockType::Grass, BlockType::StillWater, BlockType::FlowingWater, BlockType::OakLeaves,
+	};
+	constexpr int NUM_TYPES = sizeof(TYPES) / sizeof(TYPES[0]);
+
+	// whether padded coords are on an edge/corner of the border (always air, never looked at)
+	bool is_edge(const int x, const int y, const int z) {
+		const int num_borders = (x == 0 || x == PADDED_SIZE - 1) + (y == 0 || y == PADDED_SIZE - 1) + (z == 0 || z == PADDED_SIZE - 1);
+		return num_borders > 1;
+	}
+
+	std::shared_ptr<MeshGenRequestData> random_data() {
+		auto data = std::make_shared<MeshGenRequestData>();
+		std::memset(data->blocks, (uint8_t)BlockType::Air, sizeof(data->blocks));
+
+		for (int y = 0; y < PADDED_SIZE; y++) {
+			for (int z = 0; z < PADDED_SIZE; z++) {
+				for (int x = 0; x < PADDED_SIZE; x++) {
+					if (!is_edge(x, y, z)) {
+						data->blocks[y][z][x] = (uint8_t)TYPES[rng() % NUM_TYPES];
+					}
+				}
+			}
+		}
+
+		return data;
+	}
+
+	std::unique_ptr<MiniChunkMesh> mesh(const std::shared_ptr<MeshGenRequestData>& data, const MeshLayers& layers) {
+		auto req = std::make_shared<MeshGenRequest>();
+		req->coords = { -5, 48, 7 };
+		req->layers = layers;
+		req->data = data;
+		return gen_minichunk_mesh(req);
+	}
+
+	// quads as a sorted list, to compare meshes regardless of quad order
+	std::vector<uint64_t> sorted_quads(const MiniChunkMesh& mesh) {
+		std::vector<uint64_t> result;
+		for (const PackedQuad& quad : mesh.get_quads()) {
+			result.push_back((uint64_t(quad.attrs) << 32) | quad.corners);
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	// random block an edit can change: inside the mini, or on a face of its border (i.e. in a neighbor)
+	vmath::ivec3 random_rel() {
+		while (true) {
+			const vmath::ivec3 rel = { int(rng() % PADDED_SIZE) - 1, int(rng() % PADDED_SIZE) - 1, int(rng() % PADDED_SIZE) - 1 };
+			if (!is_edge(rel[0] + 1, rel[1] + 1, rel[2] + 1)) {
+				return rel;
+			}
+		}
+	}
+
+	// a run of edits to one mini, each spliced into the mesh the previous one left behind
+	size_t test_edits(const int num_edits) {
+		auto data = random_data();
+		std::unique_ptr<MiniChunkMesh> spliced = mesh(data, MeshLayers::all());
+		size_t total_changed = 0;
+
+		for (int i = 0; i < num_edits; i++) {
+			// edit a copy, like the world does (requests in flight keep the old data)
+			auto edited = std::make_shared<MeshGenRequestData>(*data);
+			const vmath::ivec3 rel = random_rel();
+			uint8_t& block = edited->blocks[rel[1] + 1][rel[2] + 1][rel[0] + 1];
+			block = block == (uint8_t)BlockType::Air ? (uint8_t)TYPES[3 + rng() % (NUM_TYPES - 3)] : (uint8_t)BlockType::Air;
+			data = edited;
+
+			const MeshLayers layers = MeshLayers::around_block(rel);
+			const std::unique_ptr<MiniChunkMesh> partial = mesh(data, layers);
+			const std::vector<PackedQuad> old_quads = spliced->get_quads();
+			const std::vector<int> changed = spliced->replace_layers(*partial, layers);
+
+			CHECK(sorted_quads(*spliced) == sorted_quads(*mesh(data, MeshLayers::all())));
+
+			// changed indices are sorted, unique, and within the new mesh
+			CHECK(std::is_sorted(changed.begin(), changed.end()));
+			CHECK(std::adjacent_find(changed.begin(), changed.end()) == changed.end());
+			CHECK(changed.empty() || (changed.front() >= 0 && changed.back() < spliced->size()));
+
+			// every quad that wasn't reported stayed put
+			for (int j = 0; j < spliced->size(); j++) {
+				if (!std::binary_search(changed.begin(), changed.end(), j)) {
+					CHECK(j < static_cast<int>(old_quads.size()));
+					CHECK(spliced->get_quads()[j].attrs == old_quads[j].attrs && spliced->get_quads()[j].corners == old_quads[j].corners);
+				}
+			}
+
+			total_changed += changed.size();
+		}
+
+		return total_changed;
+	}
+}
+
+int main() {
+	size_t total_changed = 0;
+	for (int i = 0; i < 60; i++) {
+		total_changed += test_edits(20);
+	}
+
+	// edits must've actually changed something
+	CHECK(total_changed > 0);
+
+	std::printf("minichunkmesh_test: ok (%zu quads changed)\n", total_changed);
+	return 0;
+}